@@ -55,13 +55,25 @@ SOURCES   = src/QtMain.cpp  \
             src/Cfg.cpp \
             src/Piano.cpp \
             src/Draw.cpp \
+            src/DrawBatch.cpp \
+            src/GlyphAtlas.cpp \
             src/Scroll.cpp \
             src/Notation.cpp \
             src/TrackList.cpp \
             src/Rating.cpp \
             src/Bar.cpp \
             src/Settings.cpp \
-            src/Merge.cpp
+            src/Merge.cpp \
+            src/MidiRecorder.cpp \
+            src/Replay.cpp \
+            src/LatencyCalibration.cpp \
+            src/Trace.cpp \
+            src/EngineStats.cpp \
+            src/AudioRender.cpp \
+            src/AudioTuner.cpp \
+            src/MidiDeviceAlsa.cpp \
+            src/MidiDeviceJack.cpp \
+            src/MidiLoopback.cpp
 
 
 
@@ -0,0 +1,180 @@
+/*********************************************************************************/
+/*!
+@file           AudioRender.cpp
+
+@brief          Renders a song to an audio file as fast as possible with FluidSynth.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include "AudioRender.h"
+#include "MidiDeviceFluidSynth.h"
+#include "Song.h"
+
+#define RENDER_SAMPLE_RATE      44100
+#define RENDER_BLOCK_SIZE       64      // samples, the events are placed to within one block
+#define RENDER_TICK             1       // msec the engine is moved on between the blocks
+#define RENDER_RELEASE_TIME     2000    // msec left at the end for the last notes to die away
+
+CAudioRender::CAudioRender()
+{
+    m_fluidSettings = nullptr;
+    m_synth = nullptr;
+    m_fileRenderer = nullptr;
+    m_renderedSamples = 0;
+}
+
+CAudioRender::~CAudioRender()
+{
+    deleteSynth();
+}
+
+bool CAudioRender::createSynth(const QString &fileName)
+{
+    const QStringList fontList = qsettings->value("FluidSynth/SoundFont").toStringList();
+    if (fontList.isEmpty())
+    {
+        ppLogError("There is no SoundFont to render with");
+        return false;
+    }
+
+    m_fluidSettings = new_fluid_settings();
+    fluid_settings_setnum(m_fluidSettings, "synth.sample-rate", RENDER_SAMPLE_RATE);
+    fluid_settings_setint(m_fluidSettings, "audio.period-size", RENDER_BLOCK_SIZE);
+    fluid_settings_setstr(m_fluidSettings, "audio.file.name", qPrintable(fileName));
+    fluid_settings_setstr(m_fluidSettings, "audio.file.type", "auto");
+    // render with the same sound as the internal synth
+    m_synth = new_fluid_synth(m_fluidSettings);
+#if (FLUIDSYNTH_VERSION_MAJOR >= 2) && (FLUIDSYNTH_VERSION_MINOR >= 2)
+    fluid_synth_reverb_on(m_synth, -1, 0);
+    fluid_synth_chorus_on(m_synth, -1, 0);
+#else
+    fluid_synth_set_reverb_on(m_synth, 0);
+    fluid_synth_set_chorus_on(m_synth, 0);
+#endif
+    fluid_synth_set_gain(m_synth, qsettings->value("FluidSynth/masterGainSpin", FLUID_DEFAULT_GAIN).toFloat()/100.0f );
+
+    if (fluid_synth_sfload(m_synth, qPrintable(fontList.at(0)), 1) == -1)
+    {
+        ppLogError("Cannot load the sound font \"%s\"", qPrintable(fontList.at(0)));
+        return false;
+    }
+
+    m_fileRenderer = new_fluid_file_renderer(m_synth);
+    if (m_fileRenderer == nullptr)
+    {
+        ppLogError("Cannot write the audio file \"%s\"", qPrintable(fileName));
+        return false;
+    }
+    m_renderedSamples = 0;
+    return true;
+}
+
+void CAudioRender::deleteSynth()
+{
+    if (m_fileRenderer != nullptr)
+        delete_fluid_file_renderer(m_fileRenderer); // this also closes the file
+    if (m_synth != nullptr)
+        delete_fluid_synth(m_synth);
+    if (m_fluidSettings != nullptr)
+        delete_fluid_settings(m_fluidSettings);
+    m_fileRenderer = nullptr;
+    m_synth = nullptr;
+    m_fluidSettings = nullptr;
+}
+
+// Render whole blocks until the audio has caught up with the engine
+void CAudioRender::renderTo(qint64 usec)
+{
+    const qint64 wantedSamples = usec * RENDER_SAMPLE_RATE / 1000000;
+    while (m_renderedSamples + RENDER_BLOCK_SIZE <= wantedSamples)
+    {
+        if (fluid_file_renderer_process_block(m_fileRenderer) != FLUID_OK)
+            break;
+        m_renderedSamples += RENDER_BLOCK_SIZE;
+    }
+}
+
+bool CAudioRender::run(CSong* song, const QString &fileName)
+{
+    if (!createSynth(fileName))
+    {
+        deleteSynth();
+        return false;
+    }
+
+    song->setReplayDevice(this);
+
+    // The modes that wait for the pianist would never finish, play along keeps the pianist's part muted
+    const playMode_t playMode = CConductor::getPlayMode();
+    if (playMode == PB_PLAY_MODE_followYou || playMode == PB_PLAY_MODE_rhythmTapping)
+        song->setPlayMode(PB_PLAY_MODE_playAlong);
+
+    song->rewind();
+    song->playMusic(true);
+
+    qint64 virtualTime = 0; // usec
+    while (true)
+    {
+        const eventBits_t eventBits = song->task(RENDER_TICK);
+        if ((eventBits & EVENT_BITS_UptoBarReached) != 0)
+            song->playFromStartBar();
+        if ((eventBits & EVENT_BITS_playingStopped) != 0 || !song->playingMusic())
+            break;
+        virtualTime += RENDER_TICK * 1000;
+        renderTo(virtualTime);
+    }
+    song->playMusic(false);
+    renderTo(virtualTime + RENDER_RELEASE_TIME * 1000);
+
+    song->setPlayMode(playMode);
+    song->setReplayDevice(nullptr);
+    ppLogInfo("Rendered %.1f seconds to \"%s\"", static_cast<double>(m_renderedSamples) / RENDER_SAMPLE_RATE, qPrintable(fileName));
+    deleteSynth();
+    return true;
+}
+
+void CAudioRender::playMidiEvent(const CMidiEvent & event)
+{
+    const int channel = event.channel() & 0x0f;
+    switch(event.type())
+    {
+        case MIDI_NOTE_OFF:
+            fluid_synth_noteoff(m_synth, channel, event.note());
+            break;
+        case MIDI_NOTE_ON:
+            fluid_synth_noteon(m_synth, channel, event.note(), event.velocity());
+            break;
+        case MIDI_CONTROL_CHANGE:
+            fluid_synth_cc(m_synth, channel, event.data1(), event.data2());
+            break;
+        case MIDI_PROGRAM_CHANGE:
+            fluid_synth_program_change(m_synth, channel, event.programme());
+            break;
+        case MIDI_CHANNEL_PRESSURE:
+            fluid_synth_channel_pressure(m_synth, channel, event.programme());
+            break;
+        case MIDI_PITCH_BEND:
+            fluid_synth_pitch_bend(m_synth, channel, (event.data2() << 7) | event.data1());
+            break;
+    }
+}
@@ -0,0 +1,84 @@
+/*********************************************************************************/
+/*!
+@file           AudioRender.h
+
+@brief          Renders a song to an audio file as fast as possible with FluidSynth.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __AUDIO_RENDER_H__
+#define __AUDIO_RENDER_H__
+
+#include <fluidsynth.h>
+
+#include "MidiDeviceBase.h"
+
+class CSong;
+
+/*!
+ * @brief   A MIDI device that renders the song straight into an audio file.
+ *
+ * The song is run through the conductor on a virtual clock with no pianist input, so the
+ * channel, mute and volume boost settings apply just as they do when playing live. The
+ * output events go to a FluidSynth instance that has no audio driver, and the samples are
+ * pulled from it as fast as the CPU allows and written by the FluidSynth file renderer.
+ */
+class CAudioRender : public CMidiDeviceBase
+{
+public:
+    CAudioRender();
+    ~CAudioRender();
+
+    //! render the current song to the file (the type comes from the file name), returns false on an error
+    bool run(CSong* song, const QString &fileName);
+
+    virtual void init() {}
+    virtual void playMidiEvent(const CMidiEvent & event);
+    virtual int checkMidiInput() {return 0;}
+    virtual CMidiEvent readMidiInput() {return CMidiEvent();}
+    virtual qint64 midiInputTimeStamp() {return -1;}
+
+    virtual QStringList getMidiPortList(midiType_t type) { Q_UNUSED(type) return QStringList(); }
+    virtual bool openMidiPort(midiType_t type, const QString &portName) { Q_UNUSED(type) Q_UNUSED(portName) return true; }
+    virtual bool validMidiConnection() {return true;}
+    virtual void closeMidiPort(midiType_t type, int index) { Q_UNUSED(type) Q_UNUSED(index) }
+
+    virtual int     midiSettingsSetStr(const QString &name, const QString &str) { Q_UNUSED(name) Q_UNUSED(str) return 0; }
+    virtual int     midiSettingsSetNum(const QString &name, double val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual int     midiSettingsSetInt(const QString &name, int val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual QString midiSettingsGetStr(const QString &name) { Q_UNUSED(name) return QString(); }
+    virtual double  midiSettingsGetNum(const QString &name) { Q_UNUSED(name) return 0.0; }
+    virtual int     midiSettingsGetInt(const QString &name) { Q_UNUSED(name) return 0; }
+
+private:
+    bool createSynth(const QString &fileName);
+    void deleteSynth();
+    void renderTo(qint64 usec);
+
+    fluid_settings_t* m_fluidSettings;
+    fluid_synth_t* m_synth;
+    fluid_file_renderer_t* m_fileRenderer;
+    qint64 m_renderedSamples;
+};
+
+#endif //__AUDIO_RENDER_H__
@@ -0,0 +1,259 @@
+/*********************************************************************************/
+/*!
+@file           AudioTuner.cpp
+
+@brief          Finds the smallest FluidSynth audio buffer that plays without glitches.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include "AudioTuner.h"
+#include "MidiEvent.h"
+#include "Util.h"
+
+#define TUNER_STEP_MSEC         3000    // how long each buffer size is played for
+#define TUNER_SETTLE_MSEC       300     // the start of each step is ignored while the audio driver settles
+#define TUNER_MAX_LOAD          70      // percent, more than this leaves too little headroom
+#define TEST_CHORD_MSEC         60      // a new chord is started this often
+#define TEST_CHORD_NOTES        12
+#define TEST_CHANNELS           4
+
+// tried from the safest to the fastest
+static const int bufferSizes[] = {1024, 512, 256, 128, 64};
+// piano, strings, choir and organ give lots of long overlapping voices
+static const int testPatches[TEST_CHANNELS] = {GM_PIANO_PATCH, 48, 52, 19};
+
+CAudioTuner::CAudioTuner()
+{
+    m_fluidSettings = nullptr;
+    m_synth = nullptr;
+    m_audioDriver = nullptr;
+    m_sampleRate = 0.0;
+    m_bufferCount = 0;
+    m_step = 0;
+    m_finished = false;
+    m_underruns = 0;
+    m_worstLoad = 0;
+    m_lastCallback = -1;
+    m_bufferedTime = 0;
+    m_renderedSamples = 0;
+    m_nextChord = 0;
+    m_chord = 0;
+}
+
+CAudioTuner::~CAudioTuner()
+{
+    stop();
+}
+
+bool CAudioTuner::start(const QString &soundFont, const QString &driver, int sampleRate, int bufferCount)
+{
+    stop();
+    m_results.clear();
+    m_step = 0;
+    m_finished = false;
+    m_bufferCount = qMax(bufferCount, 2);
+
+    m_fluidSettings = new_fluid_settings();
+    fluid_settings_setnum(m_fluidSettings, "synth.sample-rate", sampleRate);
+    fluid_settings_setint(m_fluidSettings, "audio.periods", m_bufferCount);
+#if !defined (Q_OS_WINDOWS)
+    fluid_settings_setstr(m_fluidSettings, "audio.driver", qPrintable(driver));
+#else
+    Q_UNUSED(driver)
+#endif
+    fluid_settings_getnum(m_fluidSettings, "synth.sample-rate", &m_sampleRate);
+    m_synth = new_fluid_synth(m_fluidSettings);
+    if (fluid_synth_sfload(m_synth, qPrintable(soundFont), 1) == -1)
+    {
+        ppLogError("Cannot load the sound font \"%s\"", qPrintable(soundFont));
+        stop();
+        return false;
+    }
+    for (int channel = 0; channel < TEST_CHANNELS; channel++)
+        fluid_synth_program_change(m_synth, channel, testPatches[channel]);
+
+    if (!startStep())
+    {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void CAudioTuner::stop()
+{
+    if (m_audioDriver != nullptr)
+        delete_fluid_audio_driver(m_audioDriver);
+    if (m_synth != nullptr)
+        delete_fluid_synth(m_synth);
+    if (m_fluidSettings != nullptr)
+        delete_fluid_settings(m_fluidSettings);
+    m_audioDriver = nullptr;
+    m_synth = nullptr;
+    m_fluidSettings = nullptr;
+}
+
+bool CAudioTuner::startStep()
+{
+    const int bufferSize = bufferSizes[m_step];
+    fluid_settings_setint(m_fluidSettings, "audio.period-size", bufferSize);
+
+    m_underruns = 0;
+    m_worstLoad = 0;
+    m_lastCallback = -1;
+    m_bufferedTime = static_cast<qint64>(bufferSize * m_bufferCount * 1000000.0 / m_sampleRate);
+    m_renderedSamples = 0;
+    m_nextChord = 0;
+    m_callbackClock.start();
+
+    m_audioDriver = new_fluid_audio_driver2(m_fluidSettings, audioCallback, this);
+    if (m_audioDriver == nullptr)
+    {
+        ppLogError("Cannot open the audio driver with a buffer size of %d", bufferSize);
+        return false;
+    }
+    m_stepClock.start();
+    return true;
+}
+
+void CAudioTuner::endStep()
+{
+    delete_fluid_audio_driver(m_audioDriver); // the audio thread has stopped after this
+    m_audioDriver = nullptr;
+    for (int channel = 0; channel < TEST_CHANNELS; channel++)
+        fluid_synth_cc(m_synth, channel, MIDI_ALL_SOUND_OFF, 0);
+
+    tunerResult_t result;
+    result.bufferSize = bufferSizes[m_step];
+    result.underruns = m_underruns.load();
+    result.worstLoad = m_worstLoad.load();
+    m_results.push_back(result);
+    ppLogInfo("Audio buffer size %d underruns %u worst load %d%%", result.bufferSize, result.underruns, result.worstLoad);
+}
+
+void CAudioTuner::task()
+{
+    if (m_finished || m_audioDriver == nullptr || m_stepClock.elapsed() < TUNER_STEP_MSEC)
+        return;
+
+    endStep();
+    const tunerResult_t &result = m_results.back();
+    // the smaller buffers will only be worse
+    const bool failed = (result.underruns > 0 || result.worstLoad > TUNER_MAX_LOAD);
+    m_step++;
+    if (failed || m_step >= arraySize(bufferSizes) || !startStep())
+    {
+        m_finished = true;
+        stop();
+    }
+}
+
+int CAudioTuner::progress()
+{
+    if (m_finished)
+        return 100;
+    const qint64 elapsed = m_step * TUNER_STEP_MSEC + qMin(m_stepClock.elapsed(), static_cast<qint64>(TUNER_STEP_MSEC));
+    // never report 100 before the end as that closes the progress dialog
+    return static_cast<int>(qMin(elapsed * 100 / (static_cast<qint64>(arraySize(bufferSizes)) * TUNER_STEP_MSEC), static_cast<qint64>(99)));
+}
+
+bool CAudioTuner::getResult(int* bufferSize, int* latency)
+{
+    for (auto it = m_results.rbegin(); it != m_results.rend(); ++it)
+    {
+        if (it->underruns == 0 && it->worstLoad <= TUNER_MAX_LOAD)
+        {
+            *bufferSize = it->bufferSize;
+            *latency = static_cast<int>(it->bufferSize * m_bufferCount * 1000.0 / m_sampleRate);
+            return true;
+        }
+    }
+    return false;
+}
+
+QString CAudioTuner::getReport()
+{
+    QString report;
+    for (const tunerResult_t &result : m_results)
+        report += QString::asprintf("%5d: %u underruns, worst load %d%%\n", result.bufferSize, result.underruns, result.worstLoad);
+    return report;
+}
+
+int CAudioTuner::audioCallback(void* data, int len, int nfx, float* fx[], int nout, float* out[])
+{
+    Q_UNUSED(nfx)
+    Q_UNUSED(fx)
+    return static_cast<CAudioTuner*>(data)->renderAudio(len, nout, out);
+}
+
+// Called from the audio thread
+int CAudioTuner::renderAudio(int len, int nout, float* out[])
+{
+    if (nout < 2)
+        return FLUID_FAILED;
+
+    const qint64 start = m_callbackClock.nsecsElapsed() / 1000;
+    const bool settled = start > TUNER_SETTLE_MSEC * 1000;
+    // everything that was buffered has been played so there has been a gap in the sound
+    if (settled && m_lastCallback >= 0 && start - m_lastCallback > m_bufferedTime)
+        m_underruns++;
+    m_lastCallback = start;
+
+    playTestPassage(len);
+    fluid_synth_write_float(m_synth, len, out[0], 0, 1, out[1], 0, 1);
+    m_renderedSamples += len;
+
+    const qint64 renderTime = m_callbackClock.nsecsElapsed() / 1000 - start;
+    const qint64 blockTime = static_cast<qint64>(len * 1000000.0 / m_sampleRate);
+    const int load = static_cast<int>(renderTime * 100 / qMax(blockTime, static_cast<qint64>(1)));
+    if (settled)
+    {
+        if (load >= 100)
+            m_underruns++;
+        if (load > m_worstLoad.load(std::memory_order_relaxed))
+            m_worstLoad.store(load, std::memory_order_relaxed);
+    }
+    return FLUID_OK;
+}
+
+static int testNote(int chord, int i)
+{
+    return 36 + (chord * 7 + i * 5) % 60;
+}
+
+// Wide chords on all the test channels, the release of each one overlaps the next
+void CAudioTuner::playTestPassage(int len)
+{
+    if (m_renderedSamples + len <= m_nextChord)
+        return;
+
+    if (m_chord > 0)
+    {
+        for (int i = 0; i < TEST_CHORD_NOTES; i++)
+            fluid_synth_noteoff(m_synth, i % TEST_CHANNELS, testNote(m_chord - 1, i));
+    }
+    for (int i = 0; i < TEST_CHORD_NOTES; i++)
+        fluid_synth_noteon(m_synth, i % TEST_CHANNELS, testNote(m_chord, i), 100);
+    m_chord++;
+    m_nextChord += static_cast<qint64>(TEST_CHORD_MSEC * m_sampleRate / 1000);
+}
@@ -0,0 +1,105 @@
+/*********************************************************************************/
+/*!
+@file           AudioTuner.h
+
+@brief          Finds the smallest FluidSynth audio buffer that plays without glitches.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __AUDIO_TUNER_H__
+#define __AUDIO_TUNER_H__
+
+#include <atomic>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <fluidsynth.h>
+
+/*!
+ * @brief   Plays a dense test passage through FluidSynth at smaller and smaller buffer sizes.
+ *
+ * Each buffer size is played for a few seconds through our own audio callback, which counts
+ * the underruns (the callback came too late or took longer than the block lasts) and the
+ * worst time taken to render a block. The test stops at the first buffer size that glitches.
+ * The GUI drives it by calling task() regularly.
+ */
+class CAudioTuner
+{
+public:
+    CAudioTuner();
+    ~CAudioTuner();
+
+    //! returns false if the SoundFont cannot be loaded
+    bool start(const QString &soundFont, const QString &driver, int sampleRate, int bufferCount);
+    void stop();
+    //! called regularly to move on to the next buffer size
+    void task();
+    bool isFinished() {return m_finished;}
+    //! the percentage of the test done
+    int progress();
+
+    //! returns false if none of the buffer sizes were glitch free, the latency is in msec
+    bool getResult(int* bufferSize, int* latency);
+    //! a line for each buffer size tested
+    QString getReport();
+
+private:
+    typedef struct
+    {
+        int bufferSize;
+        unsigned int underruns;
+        int worstLoad; // percent of the block time spent rendering it
+    } tunerResult_t;
+
+    bool startStep();
+    void endStep();
+    static int audioCallback(void* data, int len, int nfx, float* fx[], int nout, float* out[]);
+    int renderAudio(int len, int nout, float* out[]);
+    void playTestPassage(int len);
+
+    fluid_settings_t* m_fluidSettings;
+    fluid_synth_t* m_synth;
+    fluid_audio_driver_t* m_audioDriver;
+    double m_sampleRate;
+    int m_bufferCount;
+    int m_step;
+    bool m_finished;
+    QElapsedTimer m_stepClock;
+    std::vector<tunerResult_t> m_results;
+
+    // shared with the audio thread
+    std::atomic<unsigned int> m_underruns;
+    std::atomic<int> m_worstLoad;
+
+    // only used by the audio thread
+    QElapsedTimer m_callbackClock;
+    qint64 m_lastCallback;  // usec
+    qint64 m_bufferedTime;  // usec of audio held in all the buffers
+    qint64 m_renderedSamples;
+    qint64 m_nextChord;     // sample
+    int m_chord;
+};
+
+#endif //__AUDIO_TUNER_H__
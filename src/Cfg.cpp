@@ -41,6 +41,7 @@ bool Cfg::midiInputDump = false;
 int Cfg::keyboardLightsChan = -1;
 
 int Cfg::experimentalSwapInterval = -1;
+bool Cfg::experimentalAudioClock = false;
 int Cfg::tickRate;
 
 const int Cfg::m_playZoneEarly = 25; // Was 25
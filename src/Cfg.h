@@ -29,17 +29,6 @@
 #ifndef __CFG_H__
 #define __CFG_H__
 
-#define OPTION_BENCHMARK_TEST     0
-#if OPTION_BENCHMARK_TEST
-#define BENCHMARK_INIT()        benchMarkInit()
-#define BENCHMARK(id,mesg)      benchMark(id,mesg)
-#define BENCHMARK_RESULTS()     benchMarkResults()
-#else
-#define BENCHMARK_INIT()
-#define BENCHMARK(id,mesg)
-#define BENCHMARK_RESULTS()
-#endif
-
 #define LOG_LEVEL_NONE  0
 #define LOG_LEVEL_INFO  1
 #define LOG_LEVEL_WARN  2
@@ -138,7 +127,8 @@ public:
     static bool experimentalTempo;
     static bool experimentalNoteLength;
     static int experimentalSwapInterval;
-    static int tickRate;
+    static bool experimentalAudioClock;
+    static int tickRate; // msec, the tick for the replay and loopback tests, the live engine sleeps until it is needed
     static bool useLogFile;
     static bool midiInputDump;
     static int keyboardLightsChan;
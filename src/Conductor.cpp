@@ -37,6 +37,9 @@
 #include "Score.h"
 #include "Piano.h"
 #include "Cfg.h"
+#include "Trace.h"
+
+#define MAX_SCROLL_PREDICTION   50  // mSec, the scroll stops if the engine falls further behind than this
 
 playMode_t CConductor::m_playMode = PB_PLAY_MODE_listen;
 
@@ -127,6 +130,7 @@ void CConductor::channelSoundOff(int channel)
 
 void CConductor::allSoundOff()
 {
+    CMidiBatch batch(this);
     int channel;
 
     for ( channel = 0; channel < MAX_MIDI_CHANNELS; channel++)
@@ -140,6 +144,7 @@ void CConductor::allSoundOff()
 
 void CConductor::resetAllChannels()
 {
+    CMidiBatch batch(this);
     int channel;
 
     CMidiEvent midi;
@@ -214,6 +219,7 @@ int CConductor::calcBoostVolume(int channel, int volume)
 /* send boost volume by adjusting all channels */
 void CConductor::outputBoostVolume()
 {
+    CMidiBatch batch(this);
     int chan;
 
     for ( chan =0; chan <MAX_MIDI_CHANNELS; chan++ )
@@ -331,6 +337,7 @@ void CConductor::playMusic(bool start)
 {
     reconnectMidi();
     m_playing = start;
+    m_recorder.recordMarker(start ? RECORDER_MARKER_START : RECORDER_MARKER_STOP);
     allSoundOff();
     if (start)
     {
@@ -384,11 +391,17 @@ void CConductor::playTransposeEvent(CMidiEvent event)
 
     // Don't output note on if we are seeking to bar
     if (!seekingBarNumber())
+    {
+        m_recorder.recordAccompaniment(event);
         playTrackEvent(event); // Play the midi note or event
+    }
     else
     {
         if (event.type() == MIDI_PROGRAM_CHANGE || event.type() == MIDI_CONTROL_CHANGE)
+        {
+            m_recorder.recordAccompaniment(event);
             playTrackEvent(event); // Play the midi note or event
+        }
     }
 }
 
@@ -478,6 +491,7 @@ void CConductor::turnOnKeyboardLights(bool on)
         return;
 
     m_KeyboardLightsOn = on;
+    setOutputPriority(MIDI_PRIORITY_background);
     for(i = 0; i < m_wantedChord.length(); i++)
     {
         note = m_wantedChord.getNote(i).pitch();
@@ -487,6 +501,7 @@ void CConductor::turnOnKeyboardLights(bool on)
             event.noteOffEvent(0, Cfg::keyboardLightsChan, note, 1);
        playMidiEvent( event ); // don't use the track  settings
     }
+    setOutputPriority(MIDI_PRIORITY_normal);
 }
 
 void CConductor::fetchNextChord()
@@ -558,8 +573,10 @@ bool CConductor::validatePianistChord()
 /**
  * Add in the extra notes in rhythm practice
  */
-void CConductor::expandPianistInput(CMidiEvent inputNote)
+void CConductor::expandPianistInput(CMidiEvent inputNote, qint64 deviceTime)
 {
+    m_recorder.recordPianist(inputNote, deviceTime);
+
     if (m_playMode == PB_PLAY_MODE_rhythmTapping)
     {
         CChord chord;
@@ -652,8 +669,7 @@ void CConductor::pianistInput(CMidiEvent inputNote)
 
             if (validatePianistChord() == true)
             {
-                if (m_chordDeltaTime < 0)
-                    m_tempo.removePlayingTicks(-m_chordDeltaTime);
+                m_tempo.pianistOnset(-m_chordDeltaTime);
 
                 m_goodPlayedNotes.clear();
                 fetchNextChord();
@@ -709,8 +725,7 @@ void CConductor::pianistInput(CMidiEvent inputNote)
 
                         if (validatePianistChord() == true)
                           {
-                        if (m_chordDeltaTime < 0)
-                          m_tempo.removePlayingTicks(-m_chordDeltaTime);
+                        m_tempo.pianistOnset(-m_chordDeltaTime);
 
                         m_goodPlayedNotes.clear();
                         fetchNextChord();
@@ -756,6 +771,7 @@ void CConductor::pianistInput(CMidiEvent inputNote)
     if ( inputNote.velocity() == -1 )
         return;
 
+    setOutputPriority(MIDI_PRIORITY_pianist);
     if (goodSound == true || m_cfg_wrongNoteSound < 0)
     {
         if (m_cfg_rightNoteSound >= 0) // don't play anything if the sound is set to -1 (none)
@@ -797,6 +813,7 @@ void CConductor::pianistInput(CMidiEvent inputNote)
         }
         playTrackEvent( inputNote );
     }
+    setOutputPriority(MIDI_PRIORITY_normal);
 
     /*
     // use the same channel for the right and wrong note
@@ -899,14 +916,83 @@ void CConductor::missedNotesColor(CColor color)
     }
 }
 
+// Called instead of the real time engine while the latency is being measured
+void CConductor::latencyCalibrationTask()
+{
+    while (checkMidiInput() > 0)
+    {
+        const qint64 deviceTime = midiInputTimeStamp();
+        m_latencyCalibration.midiInput(readMidiInput(), deviceTime);
+    }
+    m_latencyCalibration.task(this);
+}
+
+// The display is drawn between the engine ticks so it guesses where the scroll has got to,
+// this must never run past the point where the music would stop for the pianist
+qint64 CConductor::predictScrollTicks(qint64 mSec)
+{
+    if (m_playing == false || getfollowState() == PB_FOLLOW_waiting || seekingBarNumber())
+        return 0;
+
+    qint64 ticks = m_tempo.mSecToTicks(qMin(mSec, static_cast<qint64>(MAX_SCROLL_PREDICTION)));
+    if ((m_playMode == PB_PLAY_MODE_followYou || m_playMode == PB_PLAY_MODE_rhythmTapping) && m_wantedChord.length() > 0)
+        ticks = qBound(static_cast<qint64>(0), ticks, -m_stopPoint*SPEED_ADJUST_FACTOR - m_chordDeltaTime);
+    return ticks;
+}
+
+// This follows the same tests as realTimeEngine() and followPlaying()
+qint64 CConductor::mSecToNextEvent()
+{
+    qint64 mSec = mSecToPendingOutput(); // the output waiting for the MIDI link to go quiet
+    auto dueIn = [this, &mSec](qint64 ticks) {
+        const qint64 due = qMax(static_cast<qint64>(0), m_tempo.ticksToMSec(ticks));
+        if (mSec < 0 || due < mSec)
+            mSec = due;
+    };
+
+    if (getfollowState() == PB_FOLLOW_waiting)
+    {
+        if (!m_followPlayingTimeOut)
+            dueIn(m_cfg_playZoneLate - m_pianistTiming);
+        if (m_silenceTimeOut > 0 && (mSec < 0 || m_silenceTimeOut < mSec))
+            mSec = m_silenceTimeOut;
+        return mSec;
+    }
+
+    if (m_playing == false)
+        return mSec;
+    if (seekingBarNumber())
+        return 0;
+
+    dueIn(m_leadLagAdjust - m_playingDeltaTime); // the next song event
+
+    if (m_wantedChord.length() > 0 && m_playMode != PB_PLAY_MODE_listen)
+    {
+        if (m_playMode == PB_PLAY_MODE_playAlong)
+            dueIn(m_cfg_playZoneLate - m_chordDeltaTime);
+        else
+        {
+            if (getfollowState() < PB_FOLLOW_earlyNotes)
+                dueIn(-m_cfg_earlyNotesPoint*SPEED_ADJUST_FACTOR - m_chordDeltaTime);
+            dueIn(-m_stopPoint*SPEED_ADJUST_FACTOR - m_chordDeltaTime);
+        }
+    }
+    return mSec;
+}
+
 void CConductor::realTimeEngine(qint64 mSecTicks)
 {
+    TRACE_SPAN("realTimeEngine");
+    CMidiBatch batch(this); // everything due in this tick is sent together
     auto ticks = m_tempo.mSecToTicks(mSecTicks);
     if (!m_followPlayingTimeOut)
         m_pianistTiming += ticks;
 
     while (checkMidiInput() > 0)
-        expandPianistInput(readMidiInput());
+    {
+        const qint64 deviceTime = midiInputTimeStamp();
+        expandPianistInput(readMidiInput(), deviceTime);
+    }
 
     if (getfollowState() == PB_FOLLOW_waiting )
     {
@@ -1022,7 +1108,10 @@ void CConductor::realTimeEngine(qint64 mSecTicks)
                 }
                 else
                 {
+                    // how long ago the event was due, so it can be placed accurately by the audio clock
+                    setEventLateness(seekingBarNumber() ? 0 : m_tempo.ticksToUSec(m_playingDeltaTime - m_leadLagAdjust));
                     playTransposeEvent(m_nextMidiEvent); // Play the midi note or event
+                    setEventLateness(0); // the other output in this tick is played now
                     ppDEBUG_CONDUCTOR(("playEvent() chan %d type %d note %d", m_nextMidiEvent.channel() , m_nextMidiEvent.type() , m_nextMidiEvent.note(), m_songEventQueue->length() ));
                 }
             }
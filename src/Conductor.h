@@ -37,6 +37,9 @@
 #include "Rating.h"
 #include "Tempo.h"
 #include "Bar.h"
+#include "MidiRecorder.h"
+#include "LatencyCalibration.h"
+#include "EngineStats.h"
 
 class CScore;
 class CPiano;
@@ -98,8 +101,15 @@ public:
     void reset();
 
     void realTimeEngine(qint64 mSecTicks);
+    //! how far the scroll will move in the mSec since the last realTimeEngine() call
+    qint64 predictScrollTicks(qint64 mSec);
+    //! the mSec until realTimeEngine() next has something to do, -1 if only the input can change anything
+    qint64 mSecToNextEvent();
     void playMusic(bool start);
     bool playingMusic() {return m_playing;}
+    bool isWaitingForPianist() {return getfollowState() == PB_FOLLOW_waiting;}
+    //! nothing changes until there is some input so the engine does not have to keep running
+    bool isEngineIdle() {return m_playing == false && loadProgress() < 0 && mSecToPendingOutput() < 0;}
     void reconnectMidi();
 
     float getSpeed() {return m_tempo.getSpeed();}
@@ -114,6 +124,13 @@ public:
         m_leadLagAdjust = m_tempo.mSecToTicks( -getLatencyFix());
     }
     int getLatencyFix() { return m_latencyFix; }
+    void enableFollowTempo(bool enable)
+    {
+        CTempo::enableFollowTempo(enable);
+        // a tempo left over from before it was turned off is no longer the pianist's
+        m_tempo.resetFollowSpeed();
+        m_leadLagAdjust = m_tempo.mSecToTicks( -getLatencyFix());
+    }
 
     void transpose(int transpose);
 
@@ -129,7 +146,31 @@ public:
     }
 
     void pianistInput(CMidiEvent inputNote);
-    void expandPianistInput(CMidiEvent inputNote);
+    // deviceTime is the MIDI input device time in usec (or -1 for the PC keyboard)
+    void expandPianistInput(CMidiEvent inputNote, qint64 deviceTime = -1);
+
+    //! save what the pianist and the accompaniment play to a MIDI file
+    bool startRecording(const QString &fileName) { return m_recorder.start(fileName); }
+    void stopRecording() { m_recorder.stop(); }
+    bool isRecording() { return m_recorder.isRecording(); }
+
+    //! the real time engine must be stopped and latencyCalibrationTask() called instead
+    void startLatencyCalibration(calibrationMode_t mode)
+    {
+        playMusic(false);
+        m_latencyCalibration.start(mode);
+    }
+    void latencyCalibrationTask();
+    void stopLatencyCalibration()
+    {
+        m_latencyCalibration.stop();
+        allSoundOff();
+    }
+    CLatencyCalibration* getLatencyCalibration() { return &m_latencyCalibration; }
+
+    CEngineStats* getEngineStats() { return &m_engineStats; }
+    void engineStatsPaused() { m_engineStats.taskPaused(); }
+    void engineStatsScheduled(qint64 mSec) { m_engineStats.taskScheduled(mSec); }
 
     void setPlayMode(playMode_t mode);
 
@@ -153,6 +194,8 @@ public:
     static playMode_t getPlayMode() {return m_playMode;}
 
     CChord getWantedChord() {return m_wantedChord;}
+    //! how long (in usec) until the wanted chord is due, negative once it is late
+    qint64 wantedChordDueIn() {return -m_tempo.ticksToUSec(m_chordDeltaTime);}
     void setActiveHand(whichPart_t hand);
 
     void setActiveChannel(int channel);
@@ -226,6 +269,13 @@ protected:
 
     int track2Channel(int track) {return m_track2ChannelLookUp[track];}
 
+    void engineStatsTaskStarted() { m_engineStats.taskStarted(getPlayedEventCount()); }
+    void engineStatsTaskFinished()
+    {
+        m_engineStats.taskFinished(getPlayedEventCount(), m_songEventQueue->length(),
+                                   m_wantedChordQueue->length(), m_savedNoteQueue->length());
+    }
+
 private:
     void allSoundOff();
     void resetAllChannels();
@@ -312,6 +362,9 @@ private:
     bool m_mutePianistPart;
     int m_latencyFix;     // Try to fix the latency (put the time in msec, 0 disables it)
     int m_track2ChannelLookUp[MAX_MIDI_TRACKS];
+    CMidiRecorder m_recorder;
+    CLatencyCalibration m_latencyCalibration;
+    CEngineStats m_engineStats;
 };
 
 #endif //__CONDUCTOR_H__
@@ -26,6 +26,8 @@
 */
 /*********************************************************************************/
 
+#include <QFontDatabase>
+
 #include "Draw.h"
 #include "Cfg.h"
 #include "Settings.h"
@@ -37,54 +39,144 @@ typedef unsigned char guint8;
 whichPart_t CDraw::m_displayHand;
 int CDraw::m_forceCompileRedraw;
 
+CGlyphAtlas* CDraw::m_textAtlas;
+int CDraw::m_noteNameFontId = -1;
+
 CDraw::CDraw(CSettings* settings)
-#ifndef NO_USE_FTGL
-    :font(nullptr)
-#endif
 {
-#ifndef NO_USE_FTGL
-    QStringList listPathFonts;
+    m_settings = settings;
+    m_displayHand = PB_PART_both;
+    m_forceCompileRedraw = 1;
+    m_scrollProperties = &m_scrollPropertiesHorizontal;
+    m_batch = nullptr;
+    m_batchLayer = BATCH_LAYER_FOREGROUND;
+    m_batchMode = GL_LINES;
+    m_batchLineWidth = 1.0f;
+    m_batchNoteColor = false;
+    m_batchSymbol = -1;
+    m_drawNoteDecorations = true;
+}
 
-    listPathFonts.append(Util::dataDir()+"/fonts/DejaVuSans.ttf");
-    listPathFonts.append(QApplication::applicationDirPath() + "/fonts/DejaVuSans.ttf");
-    listPathFonts.append(QApplication::applicationDirPath() + "/../Resources/fonts/DejaVuSans.ttf");
-    listPathFonts.append("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
-    listPathFonts.append("/usr/share/fonts/dejavu/DejaVuSans.ttf");
-    listPathFonts.append("/usr/share/fonts/TTF/dejavu/DejaVuSans.ttf");
-    listPathFonts.append("/usr/share/fonts/TTF/DejaVuSans.ttf");
-    listPathFonts.append("/usr/share/fonts/truetype/DejaVuSans.ttf");
-    listPathFonts.append("/usr/local/share/fonts/dejavu/DejaVuSans.ttf");
+void CDraw::drEnd()
+{
+    if (m_batch == nullptr)
+    {
+        glEnd();
+        return;
+    }
 
-    for (int i=0;i<listPathFonts.size();i++){
-        QFile file(listPathFonts.at(i));
-        if (file.exists()){
-            font = new FTBitmapFont(listPathFonts.at(i).toStdString().c_str());
-            break;
+    // everything is turned into separate lines or triangles so it can all go in one batch
+    const std::vector<batchVertex_t> &v = m_batchPrimitive;
+    const size_t count = v.size();
+    const int layer = m_batchLayer;
+    const float width = m_batchLineWidth;
+    size_t i;
+    m_batch->setAttribute(m_batchNoteColor ? m_batchSymbol : -1);
+    switch (m_batchMode)
+    {
+    case GL_LINES:
+        for (i = 0; i + 1 < count; i += 2)
+        {
+            m_batch->addVertex(layer, GL_LINES, width, v[i]);
+            m_batch->addVertex(layer, GL_LINES, width, v[i + 1]);
+        }
+        break;
+    case GL_LINE_STRIP:
+    case GL_LINE_LOOP:
+        for (i = 0; i + 1 < count; i++)
+        {
+            m_batch->addVertex(layer, GL_LINES, width, v[i]);
+            m_batch->addVertex(layer, GL_LINES, width, v[i + 1]);
         }
+        if (m_batchMode == GL_LINE_LOOP && count > 2)
+        {
+            m_batch->addVertex(layer, GL_LINES, width, v[count - 1]);
+            m_batch->addVertex(layer, GL_LINES, width, v[0]);
+        }
+        break;
+    case GL_POLYGON:
+    case GL_TRIANGLE_FAN:
+        for (i = 1; i + 1 < count; i++)
+        {
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[0]);
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i]);
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i + 1]);
+        }
+        break;
+    case GL_QUADS:
+        for (i = 0; i + 3 < count; i += 4)
+        {
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i]);
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i + 1]);
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i + 2]);
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i]);
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i + 2]);
+            m_batch->addVertex(layer, GL_TRIANGLES, width, v[i + 3]);
+        }
+        break;
+    default:
+        ppLogError("drEnd unsupported mode %d", m_batchMode);
+        break;
+    }
+    m_batchPrimitive.clear();
+    m_batch->setAttribute(-1);
+}
+
+void CDraw::drRect(float x1, float y1, float x2, float y2)
+{
+    if (m_batch == nullptr)
+    {
+        glRectf(x1, y1, x2, y2);
+        return;
     }
-    if (font==nullptr){
-        ppLogError("Font DejaVuSans.ttf was not found !");
-        exit(0);
+    drBegin(GL_QUADS);
+        drVertex(x1, y1);
+        drVertex(x2, y1);
+        drVertex(x2, y2);
+        drVertex(x1, y2);
+    drEnd();
+}
+
+// Draws everything in the batch, one glDrawArrays for each layer and line width
+void CDraw::drawBatch(const CDrawBatch &batch)
+{
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    for (const auto &bucket : batch.getBuckets())
+    {
+        if (bucket.vertices.empty())
+            continue;
+        if (bucket.mode == GL_LINES)
+            glLineWidth(bucket.width);
+        glVertexPointer(2, GL_FLOAT, sizeof(batchVertex_t), &bucket.vertices[0].x);
+        glColorPointer(3, GL_FLOAT, sizeof(batchVertex_t), &bucket.vertices[0].red);
+        glDrawArrays(bucket.mode, 0, static_cast<GLsizei>(bucket.vertices.size()));
     }
-    font->FaceSize(FONT_SIZE, FONT_SIZE);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+#ifndef NO_USE_FTGL
+    for (const auto &text : batch.getTexts())
+    {
+        renderText(text.x, text.y, text.color, text.text.c_str());
+    }
+    flushText();
 #endif
-    m_settings = settings;
-    m_displayHand = PB_PART_both;
-    m_forceCompileRedraw = 1;
-    m_scrollProperties = &m_scrollPropertiesHorizontal;
 }
 
 void CDraw::oneLine(float x1, float y1, float x2, float y2)
 {
-    glBegin(GL_LINES);
-    glVertex2f ((x1),(y1));
-    glVertex2f ((x2),(y2));
-    glEnd();
+    drBegin(GL_LINES);
+    drVertex ((x1),(y1));
+    drVertex ((x2),(y2));
+    drEnd();
     //ppLogTrace("oneLine %f %f %f %f", x1, y1, x2, y2);
 }
 
 void  CDraw::drawStaveExtentsion(CSymbol symbol, float x, int noteWidth, bool playable)
 {
+    if (!m_drawNoteDecorations)
+        return;
     int index;
     index = symbol.getStavePos().getStaveIndex();
     if (index < 6 && index > -6)
@@ -92,18 +184,19 @@ void  CDraw::drawStaveExtentsion(CSymbol symbol, float x, int noteWidth, bool pl
     index =  index & ~1; // Force index to be even
     whichPart_t hand = symbol.getStavePos().getHand();
 
+    drLayer(BATCH_LAYER_BACKGROUND);
     if (playable)
-        drColor(Cfg::staveColor());
+        drawColor(Cfg::staveColor());
     else
-        drColor(Cfg::staveColorDim());
+        drawColor(Cfg::staveColorDim());
 
-    glLineWidth (Cfg::staveThickness());
-    glBegin(GL_LINES);
+    drLineWidth (Cfg::staveThickness());
+    drBegin(GL_LINES);
     while (index >= 6 || index <= -6)
     {
 
-        glVertex2f (x - static_cast<float>(noteWidth)/2.0f - 4.0f, CStavePos(hand, index).getPosYRelative());
-        glVertex2f (x + static_cast<float>(noteWidth)/2.0f + 4.0f, CStavePos(hand, index).getPosYRelative());
+        drVertex (x - static_cast<float>(noteWidth)/2.0f - 4.0f, CStavePos(hand, index).getPosYRelative());
+        drVertex (x + static_cast<float>(noteWidth)/2.0f + 4.0f, CStavePos(hand, index).getPosYRelative());
 
         // Move the index closer to the stave centre
         if (index > 0)
@@ -111,18 +204,82 @@ void  CDraw::drawStaveExtentsion(CSymbol symbol, float x, int noteWidth, bool pl
         else
             index += 2;
     }
-    glEnd();
+    drEnd();
+    drLayer(BATCH_LAYER_FOREGROUND);
 }
 
-#define scaleGlVertex(xa, xb, ya, yb) glVertex2f( ((xa) * 1.2f) + (xb), ((ya) * 1.2f) + (yb))
+#define scaleGlVertex(xa, xb, ya, yb) drVertex( ((xa) * 1.2f) + (xb), ((ya) * 1.2f) + (yb))
 
 #ifndef NO_USE_FTGL
-void CDraw::renderText(float x, float y, const char* s)
+// The note names use the DejaVuSans font that comes with PianoBooster
+static QFont noteNameFont()
 {
-  const auto w = font->Advance(s);
-  const auto h = font->Descender();
-  glRasterPos2f(x - w/2, y - h);
-  font->Render(s);
+    QStringList listPathFonts;
+
+    listPathFonts.append(Util::dataDir()+"/fonts/DejaVuSans.ttf");
+    listPathFonts.append(QApplication::applicationDirPath() + "/fonts/DejaVuSans.ttf");
+    listPathFonts.append(QApplication::applicationDirPath() + "/../Resources/fonts/DejaVuSans.ttf");
+    listPathFonts.append("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
+    listPathFonts.append("/usr/share/fonts/dejavu/DejaVuSans.ttf");
+    listPathFonts.append("/usr/share/fonts/TTF/dejavu/DejaVuSans.ttf");
+    listPathFonts.append("/usr/share/fonts/TTF/DejaVuSans.ttf");
+    listPathFonts.append("/usr/share/fonts/truetype/DejaVuSans.ttf");
+    listPathFonts.append("/usr/local/share/fonts/dejavu/DejaVuSans.ttf");
+
+    QString family = "DejaVu Sans";
+    int i;
+    for (i=0;i<listPathFonts.size();i++){
+        QFile file(listPathFonts.at(i));
+        if (file.exists()){
+            const int id = QFontDatabase::addApplicationFont(listPathFonts.at(i));
+            if (id >= 0 && !QFontDatabase::applicationFontFamilies(id).isEmpty())
+            {
+                family = QFontDatabase::applicationFontFamilies(id).at(0);
+                break;
+            }
+        }
+    }
+    if (i == listPathFonts.size())
+        ppLogWarn("Font DejaVuSans.ttf was not found, using the nearest system font");
+
+    QFont font(family);
+    font.setPixelSize(FONT_SIZE);
+    return font;
+}
+#endif
+
+void CDraw::setTextAtlas(CGlyphAtlas* atlas)
+{
+    m_textAtlas = atlas;
+    m_noteNameFontId = -1;
+#ifndef NO_USE_FTGL
+    if (m_textAtlas != nullptr)
+        m_noteNameFontId = m_textAtlas->addFont(noteNameFont());
+#endif
+}
+
+void CDraw::flushText()
+{
+    if (m_textAtlas != nullptr)
+        m_textAtlas->draw();
+}
+
+#ifndef NO_USE_FTGL
+// The text is centred on x and sits on y, it is only drawn by flushText()
+void CDraw::renderText(float x, float y, CColor color, const char* s)
+{
+    if (m_textAtlas == nullptr)
+        return;
+    const float baseLine = y + m_textAtlas->descent(m_noteNameFontId);
+    m_textAtlas->addText(m_noteNameFontId, x, baseLine, color, QString::fromUtf8(s), true);
+}
+
+void CDraw::drText(float x, float y, const char* s)
+{
+    if (m_batch == nullptr)
+        renderText(x, y, m_batchColor, s);
+    else
+        m_batch->addText(x, y, m_batchColor, s);
 }
 #endif
 
@@ -135,9 +292,9 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
 
     staveLookup_t item = CStavePos::midiNote2Name(midiNote);
 
-    drColor(Cfg::noteNameColor());
+    drawColor(Cfg::noteNameColor());
 
-    glLineWidth (1.0);
+    drLineWidth (1.0);
 
 #ifdef NO_USE_FTGL
     if (item.accidental != 0)
@@ -146,7 +303,7 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
           x += accidentalOffset/2;
           if (item.accidental == 1)
           {
-              glBegin(GL_LINES);
+              drBegin(GL_LINES);
                   //  letterSharp4
                   scaleGlVertex( -1.317895f, x,   5.794585f, y);  //  1
                   scaleGlVertex( -1.265845f, x,   -6.492455f, y);  //  2
@@ -156,12 +313,12 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
                   scaleGlVertex( 2.648325f, x,   3.625485f, y);  //  6
                   scaleGlVertex( -2.648325f, x,   -3.306965f, y);  //  7
                   scaleGlVertex( 2.596205f, x,   -1.675765f, y);  //  8
-              glEnd();
+              drEnd();
 
           }
           else
           {
-              glBegin(GL_LINE_STRIP);
+              drBegin(GL_LINE_STRIP);
                   //  letterFlat
                   scaleGlVertex( -2.52933f, x,   6.25291f, y);  //  1
                   scaleGlVertex( -2.50344f, x,   -6.25291f, y);  //  2
@@ -172,7 +329,7 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
                   scaleGlVertex( -0.53943f, x,   0.90755f, y);  //  7
                   scaleGlVertex( -2.46252f, x,   -1.01554f, y);  //  8
                   scaleGlVertex( -2.50344f, x,   -1.67021f, y);  //  9
-              glEnd();
+              drEnd();
 
           }
           x -= accidentalOffset;
@@ -181,7 +338,7 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
       switch(item.pianoNote)
       {
       case 1:
-          glBegin(GL_LINE_STRIP);
+          drBegin(GL_LINE_STRIP);
               //  letterC
               scaleGlVertex( 3.513445f, x,   2.17485f, y);  //  1
               scaleGlVertex( 1.880175f, x,   4.47041f, y);  //  2
@@ -191,11 +348,11 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
               scaleGlVertex( -1.630675f, x,   -4.47041f, y);  //  6
               scaleGlVertex( 1.932545f, x,   -4.44064f, y);  //  7
               scaleGlVertex( 3.702055f, x,   -1.88554f, y);  //  8
-          glEnd();
+          drEnd();
       break;
 
       case 2:
-          glBegin(GL_LINE_STRIP);
+          drBegin(GL_LINE_STRIP);
               //  letterD
               scaleGlVertex( -3.30696f, x,   4.31878f, y);  //  1
               scaleGlVertex( -3.3428f, x,   -4.31878f, y);  //  2
@@ -204,39 +361,39 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
               scaleGlVertex( 3.3428f, x,   1.66626f, y);  //  5
               scaleGlVertex( 0.70825f, x,   4.31317f, y);  //  6
               scaleGlVertex( -3.22083f, x,   4.29495f, y);  //  7
-          glEnd();
+          drEnd();
       break;
 
       case 3: // E
-          glBegin(GL_LINE_STRIP);
+          drBegin(GL_LINE_STRIP);
               //  letterE2
               scaleGlVertex( 2.966065f, x,   4.416055f, y);  //  1
               scaleGlVertex( -3.007275f, x,   4.403495f, y);  //  2
               scaleGlVertex( -3.037615f, x,   -4.416055f, y);  //  3
               scaleGlVertex( 3.037615f, x,   -4.415435f, y);  //  4
-          glEnd();
-          glBegin(GL_LINES);
+          drEnd();
+          drBegin(GL_LINES);
               scaleGlVertex( 3.011705f, x,   0.197675f, y);  //  5
               scaleGlVertex( -2.990845f, x,   0.196615f, y);  //  6
-          glEnd();
+          drEnd();
       break;
 
       case 4: // F
-          glBegin(GL_LINE_STRIP);
+          drBegin(GL_LINE_STRIP);
               //  letterF2
               scaleGlVertex( -2.55172f, x,   -4.434285f, y);  //  1
               scaleGlVertex( -2.51956f, x,   4.433665ff, y);  //  2
               scaleGlVertex( 2.39942f, x,   4.434285f, y);  //  3
-          glEnd();
-          glBegin(GL_LINES);
+          drEnd();
+          drBegin(GL_LINES);
               scaleGlVertex( 2.58143f, x,   0.244465f, y);  //  4
               scaleGlVertex( -2.58143f, x,   0.243405f, y);  //  5
 
-          glEnd();
+          drEnd();
       break;
 
       case 5:
-          glBegin(GL_LINE_STRIP);
+          drBegin(GL_LINE_STRIP);
               //  letterG
               scaleGlVertex( 0.58123f, x,   -0.34005f, y);  //  1
               scaleGlVertex( 3.66047f, x,   -0.48722f, y);  //  2
@@ -248,25 +405,25 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
               scaleGlVertex( -1.25347f, x,   4.57846f, y);  //  8
               scaleGlVertex( 1.90018f, x,   4.55293f, y);  //  9
               scaleGlVertex( 3.54236f, x,   2.38612f, y);  //  10
-          glEnd();
+          drEnd();
       break;
 
       case 6: // A
-          glBegin(GL_LINE_STRIP);
+          drBegin(GL_LINE_STRIP);
               //  letterA2
               scaleGlVertex( -3.91146f, x,   -4.907395f, y);  //  1
               scaleGlVertex( 0.06571f, x,   4.907395f, y);  //  2
               scaleGlVertex( 3.91146f, x,   -4.803315f, y);  //  3
-          glEnd();
-          glBegin(GL_LINES);
+          drEnd();
+          drBegin(GL_LINES);
               scaleGlVertex( 2.60111f, x,   -1.400435f, y);  //  4
               scaleGlVertex( -2.56175f, x,   -1.357305f, y);  //  5
 
-          glEnd();
+          drEnd();
       break;
 
       case 7:
-          glBegin(GL_LINE_STRIP);
+          drBegin(GL_LINE_STRIP);
               //  letterB
               scaleGlVertex( 1.038555f, x,   0.105285f, y);  //  1
               scaleGlVertex( -3.001935f, x,   0.121925f, y);  //  2
@@ -280,23 +437,23 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
               scaleGlVertex( 1.176815f, x,   -4.451255f, y);  //  10
               scaleGlVertex( -2.981475f, x,   -4.445735f, y);  //  11
               scaleGlVertex( -3.021355f, x,   0.176035f, y);  //  12
-          glEnd();
+          drEnd();
       break;
 
       default:
-          glBegin(GL_LINES);
-              glVertex2f(  3.0f + x,   -15.0f  + y);  //  1
-              glVertex2f(  3.0f + x,   8.0f    + y);  //  2
+          drBegin(GL_LINES);
+              drVertex(  3.0f + x,   -15.0f  + y);  //  1
+              drVertex(  3.0f + x,   8.0f    + y);  //  2
 
-              glVertex2f( -3.0f + x,   -8.0f   + y);  //  3
-              glVertex2f( -3.0f + x,   15.0f   + y);  //  4
+              drVertex( -3.0f + x,   -8.0f   + y);  //  3
+              drVertex( -3.0f + x,   15.0f   + y);  //  4
 
-              glVertex2f(  3.0f + x,   8.0f    + y);  //  5
-              glVertex2f( -3.0f + x,   2.0f    + y);  //  6
+              drVertex(  3.0f + x,   8.0f    + y);  //  5
+              drVertex( -3.0f + x,   2.0f    + y);  //  6
 
-              glVertex2f(  3.0f + x,   -2.0f   + y);  //  7
-              glVertex2f( -3.0f + x,   -8.0f   + y);  //  8
-          glEnd();
+              drVertex(  3.0f + x,   -2.0f   + y);  //  7
+              drVertex( -3.0f + x,   -8.0f   + y);  //  8
+          drEnd();
       break;
       }
 #else
@@ -330,13 +487,15 @@ void CDraw::drawNoteName(int midiNote, float x, float y, int type)
           break;
        }
       QString note = n[item.pianoNote-1] + accident;
-      renderText(x, y, note.toUtf8().data());
+      drText(x, y, note.toUtf8().data());
      }
 #endif
 }
 
 void CDraw::drawStaveNoteName(CSymbol symbol, float x, float y)
 {
+    if (!m_drawNoteDecorations)
+        return;
     if ( symbol.getNoteIndex() + 1 != symbol.getNoteTotal())
         return;
     if (m_settings->showNoteNames() == false)
@@ -347,6 +506,8 @@ void CDraw::drawStaveNoteName(CSymbol symbol, float x, float y)
 
 void CDraw::checkAccidental(CSymbol symbol, float x, float y)
 {
+    if (!m_drawNoteDecorations)
+        return;
     int accidental;
     const int xGap = 16;
 
@@ -365,7 +526,7 @@ void CDraw::checkAccidental(CSymbol symbol, float x, float y)
 
     if (accidental != 0)
     {
-        //drColor (Cfg::lineColor());
+        //drawColor(Cfg::lineColor());
         if (accidental == 1)
             drawSymbol(CSymbol(PB_SYMBOL_sharp, symbol.getStavePos()), x - xGap, y);
         else if (accidental == -1)
@@ -383,12 +544,9 @@ bool CDraw::drawNote(CSymbol* symbol, float x, float y, CSlot* slot, CColor colo
 
     //ppLogTrace("PB_SYMBOL_noteHead x %f y %f", x, y);
     if (!CChord::isNotePlayable(symbol->getNote(), 0))
-    {
-        color = Cfg::noteColorDim();
         playable = false;
-    }
     drawStaveExtentsion(*symbol, x, 16, playable);
-    drColor(color);
+    drawNoteColor(color);
     bool solidNoteHead = false;
     bool showNoteStem = false;
     int stemFlagCount = 0;
@@ -408,60 +566,60 @@ bool CDraw::drawNote(CSymbol* symbol, float x, float y, CSlot* slot, CColor colo
     {
         if (!solidNoteHead)
             noteWidth += 1.0f;
-        glLineWidth(2.0f);
-        glBegin(GL_LINE_STRIP);
-            glVertex2f(noteWidth + x,  0.0f + y); // 1
-            glVertex2f(noteWidth + x, stemLength + y); // 2
-        glEnd();
+        drLineWidth(2.0f);
+        drBegin(GL_LINE_STRIP);
+            drVertex(noteWidth + x,  0.0f + y); // 1
+            drVertex(noteWidth + x, stemLength + y); // 2
+        drEnd();
     }
 
     float offset = stemLength;
     while (stemFlagCount>0)
     {
 
-        glLineWidth(2.0);
-        glBegin(GL_LINE_STRIP);
-            glVertex2f(noteWidth + x, offset  + y); // 1
-            glVertex2f(noteWidth + 8.0f + x, offset - 16.0f + y); // 2
-        glEnd();
+        drLineWidth(2.0);
+        drBegin(GL_LINE_STRIP);
+            drVertex(noteWidth + x, offset  + y); // 1
+            drVertex(noteWidth + 8.0f + x, offset - 16.0f + y); // 2
+        drEnd();
         offset -= 8;
         stemFlagCount--;
     }
 
     if (solidNoteHead)
     {
-        glBegin(GL_POLYGON);
-            glVertex2f(-7.0f + x,  2.0f + y); // 1
-            glVertex2f(-5.0f + x,  4.0f + y); // 2
-            glVertex2f(-1.0f + x,  6.0f + y); // 3
-            glVertex2f( 4.0f + x,  6.0f + y); // 4
-            glVertex2f( 7.0f + x,  4.0f + y); // 5
-            glVertex2f( 7.0f + x,  1.0f + y); // 6
-            glVertex2f( 6.0f + x, -2.0f + y); // 7
-            glVertex2f( 4.0f + x, -4.0f + y); // 8
-            glVertex2f( 0.0f + x, -6.0f + y); // 9
-            glVertex2f(-4.0f + x, -6.0f + y); // 10
-            glVertex2f(-8.0f + x, -3.0f + y); // 11
-            glVertex2f(-8.0f + x, -0.0f + y); // 12
-        glEnd();
+        drBegin(GL_POLYGON);
+            drVertex(-7.0f + x,  2.0f + y); // 1
+            drVertex(-5.0f + x,  4.0f + y); // 2
+            drVertex(-1.0f + x,  6.0f + y); // 3
+            drVertex( 4.0f + x,  6.0f + y); // 4
+            drVertex( 7.0f + x,  4.0f + y); // 5
+            drVertex( 7.0f + x,  1.0f + y); // 6
+            drVertex( 6.0f + x, -2.0f + y); // 7
+            drVertex( 4.0f + x, -4.0f + y); // 8
+            drVertex( 0.0f + x, -6.0f + y); // 9
+            drVertex(-4.0f + x, -6.0f + y); // 10
+            drVertex(-8.0f + x, -3.0f + y); // 11
+            drVertex(-8.0f + x, -0.0f + y); // 12
+        drEnd();
     }
     else
     {
-        glLineWidth(2.0);
-        glBegin(GL_LINE_STRIP);
-            glVertex2f(-7.0f + x,  2.0f + y); // 1
-            glVertex2f(-5.0f + x,  4.0f + y); // 2
-            glVertex2f(-1.0f + x,  6.0f + y); // 3
-            glVertex2f( 4.0f + x,  6.0f + y); // 4
-            glVertex2f( 7.0f + x,  4.0f + y); // 5
-            glVertex2f( 7.0f + x,  1.0f + y); // 6
-            glVertex2f( 6.0f + x, -2.0f + y); // 7
-            glVertex2f( 4.0f + x, -4.0f + y); // 8
-            glVertex2f( 0.0f + x, -6.0f + y); // 9
-            glVertex2f(-4.0f + x, -6.0f + y); // 10
-            glVertex2f(-8.0f + x, -3.0f + y); // 11
-            glVertex2f(-8.0f + x, -0.0f + y); // 12
-        glEnd();
+        drLineWidth(2.0);
+        drBegin(GL_LINE_STRIP);
+            drVertex(-7.0f + x,  2.0f + y); // 1
+            drVertex(-5.0f + x,  4.0f + y); // 2
+            drVertex(-1.0f + x,  6.0f + y); // 3
+            drVertex( 4.0f + x,  6.0f + y); // 4
+            drVertex( 7.0f + x,  4.0f + y); // 5
+            drVertex( 7.0f + x,  1.0f + y); // 6
+            drVertex( 6.0f + x, -2.0f + y); // 7
+            drVertex( 4.0f + x, -4.0f + y); // 8
+            drVertex( 0.0f + x, -6.0f + y); // 9
+            drVertex(-4.0f + x, -6.0f + y); // 10
+            drVertex(-8.0f + x, -3.0f + y); // 11
+            drVertex(-8.0f + x, -0.0f + y); // 12
+        drEnd();
     }
 
     checkAccidental(*symbol, x, y);
@@ -469,10 +627,59 @@ bool CDraw::drawNote(CSymbol* symbol, float x, float y, CSlot* slot, CColor colo
     return playable;
 }
 
-void CDraw::drawSymbol(CSymbol symbol, float x, float y, CSlot* slot)
+// See forum post at link below from PianoBooster forum user Kory.
+// http://piano-booster.2625608.n2.nabble.com/Pianobooster-port-to-arm-linux-or-Android-td7572459.html
+// http://piano-booster.2625608.n2.nabble.com/Pianobooster-port-to-arm-linux-or-Android-td7572459.html#a7572676
+static CColor coloredNoteColor(int midiNote)
+{
+    int note = midiNote % MIDI_OCTAVE;
+    CColor color;
+    switch (note)
+    {
+        case 0: //note::PitchLabel::C:
+            color = CColor(1.0, 0.0, 0.0); //Red
+          break;
+        case 1: //note::PitchLabel::C♯:
+            color = CColor(1.0, 0.25, 0.0); //Red
+          break;
+        case 2: //note::PitchLabel::D:
+            color = CColor(1.0, 0.5, 0.0); //Orange
+          break;
+        case 3: //note::PitchLabel::D♯:
+            color = CColor(1.0, 0.75, 0.0); //Orange
+          break;
+        case 4: //note::PitchLabel::E:
+            color = CColor(1.0, 1.0, 0.0); //Yellow
+          break;
+        case 5: //note::PitchLabel::F:
+            color = CColor(0.0, 1.0, 0.0); //Green
+          break;
+        case 6: //note::PitchLabel::F♯:
+            color = CColor(0.0, 0.5, 0.5); //Green
+          break;
+        case 7: //note::PitchLabel::G:
+            color = CColor(0.0, 0.0, 1.0); //Blue
+          break;
+        case 8: //note::PitchLabel::G♯:
+            color = CColor(0.290, 0.0, 0.903); //Blue
+          break;
+        case 9: //note::PitchLabel::A:
+            color = CColor(0.580, 0.0, 0.827); //Dark Violet #9400D3
+          break;
+        case 10: //note::PitchLabel::A♯:
+            color = CColor(0.790, 0.0, 0.903); //Dark Violet #9400D3
+          break;
+        case 11: //note::PitchLabel::B:
+            color = CColor(1.0, 0.0, 1.0); //Magenta
+          break;
+    }
+    return color;
+}
+
+// The colour a symbol is drawn in, this is also used to change the colour of a note already in a batch
+CColor CDraw::getSymbolColor(CSymbol symbol)
 {
     CColor color = symbol.getColor();
-    bool playable = true;
 
     if (m_displayHand != symbol.getHand() && m_displayHand != PB_PART_both)
     {
@@ -480,290 +687,261 @@ void CDraw::drawSymbol(CSymbol symbol, float x, float y, CSlot* slot)
             color = Cfg::noteColorDim();
         if (color == Cfg::staveColor())
             color = Cfg::staveColorDim();
-        playable = false;
     }
 
+    if (symbol.getType() == PB_SYMBOL_drum || symbol.getType() >= PB_SYMBOL_noteHead)
+    {
+        if (!CChord::isNotePlayable(symbol.getNote(), 0))
+            color = Cfg::noteColorDim();
+        else if (symbol.getType() == PB_SYMBOL_noteHead && m_settings->coloredNotes() && color == Cfg::noteColor()) //KORY added
+            color = coloredNoteColor(symbol.getNote());
+    }
+    return color;
+}
+
+void CDraw::drawSymbol(CSymbol symbol, float x, float y, CSlot* slot)
+{
+    CColor color = getSymbolColor(symbol);
+    bool playable = true;
+
+    if (m_displayHand != symbol.getHand() && m_displayHand != PB_PART_both)
+        playable = false;
+
     switch (symbol.getType())
     {
          case PB_SYMBOL_gClef: // The Treble Clef
             y += 4;
-            drColor(color);
-            glLineWidth (3.0f);
-            glBegin(GL_LINE_STRIP);
-            glVertex2f( -0.011922f  + x,   -16.11494f  + y);  //  1
-            glVertex2f( -3.761922f  + x,   -12.48994f  + y);  //  2
-            glVertex2f( -4.859633f  + x,   -8.85196f  + y);  //  3
-            glVertex2f( -4.783288f  + x,   -5.42815f  + y);  //  4
-            glVertex2f( -0.606711f  + x,   -1.11108f  + y);  //  5
-            glVertex2f( 5.355545f  + x,   0.48711f  + y);  //  6
-            glVertex2f( 10.641104f  + x,   -1.6473f  + y);  //  7
-            glVertex2f( 14.293812f  + x,   -6.18241f  + y);  //  8
-            glVertex2f( 14.675578f  + x,   -11.42744f  + y);  //  9
-            glVertex2f( 12.550578f  + x,   -17.30244f  + y);  //  10
-            glVertex2f( 7.912166f  + x,   -20.944f  + y);  //  11
-            glVertex2f( 3.049705f  + x,   -21.65755f  + y);  //  12
-            glVertex2f( -1.711005f  + x,   -21.36664f  + y);  //  13
-            glVertex2f( -6.283661f  + x,   -19.66739f  + y);  //  14
-            glVertex2f( -10.123329f  + x,   -16.79162f  + y);  //  15
-            glVertex2f( -13.363008f  + x,   -12.28184f  + y);  //  16
-            glVertex2f( -14.675578f  + x,   -5.79969f  + y);  //  17
-            glVertex2f( -13.66821f  + x,   0.20179f  + y);  //  18
-            glVertex2f( -10.385341f  + x,   6.27562f  + y);  //  19
-            glVertex2f( 5.539491f  + x,   20.32671f  + y);  //  20
-            glVertex2f( 10.431588f  + x,   28.20584f  + y);  //  21
-            glVertex2f( 11.00141f  + x,   34.71585f  + y);  //  22
-            glVertex2f( 9.204915f  + x,   39.62875f  + y);  //  23
-            glVertex2f( 7.854166f  + x,   42.08262f  + y);  //  24
-            glVertex2f( 5.481415f  + x,   42.66649f  + y);  //  25
-            glVertex2f( 3.57972f  + x,   41.4147f  + y);  //  26
-            glVertex2f( 1.507889f  + x,   37.35642f  + y);  //  27
-            glVertex2f( -0.381338f  + x,   31.14317f  + y);  //  28
-            glVertex2f( -0.664306f  + x,   25.51354f  + y);  //  29
-            glVertex2f( 8.296044f  + x,   -32.22694f  + y);  //  30
-            glVertex2f( 8.050507f  + x,   -36.6687f  + y);  //  31
-            glVertex2f( 6.496615f  + x,   -39.52999f  + y);  //  32
-            glVertex2f( 3.368583f  + x,   -41.7968f  + y);  //  33
-            glVertex2f( 0.253766f  + x,   -42.66649f  + y);  //  34
-            glVertex2f( -3.599633f  + x,   -42.23514f  + y);  //  35
-            glVertex2f( -8.098754f  + x,   -39.46637f  + y);  //  36
-            glVertex2f( -9.463279f  + x,   -35.49796f  + y);  //  37
-            glVertex2f( -7.08037f  + x,   -31.36512f  + y);  //  38
-            glVertex2f( -3.336421f  + x,   -31.14057f  + y);  //  39
-            glVertex2f( -1.360313f  + x,   -34.07738f  + y);  //  40
-            glVertex2f( -1.608342f  + x,   -37.11828f  + y);  //  41
-            glVertex2f( -5.729949f  + x,   -39.24759f  + y);  //  42
-            glVertex2f( -7.480646f  + x,   -36.2136f  + y);  //  43
-            glVertex2f( -6.826918f  + x,   -33.36919f  + y);  //  44
-            glVertex2f( -4.069083f  + x,   -32.9226f  + y);  //  45
-            glVertex2f( -3.040669f  + x,   -34.433f  + y);  //  46
-            glVertex2f( -3.737535f  + x,   -36.38759f  + y);  //  47
-            glVertex2f( -5.496558f  + x,   -36.97633f  + y);  //  48
-            glVertex2f( -5.295932f  + x,   -34.01951f  + y);  //  49
-
-            glEnd();
+            drawColor(color);
+            drLineWidth (3.0f);
+            drBegin(GL_LINE_STRIP);
+            drVertex( -0.011922f  + x,   -16.11494f  + y);  //  1
+            drVertex( -3.761922f  + x,   -12.48994f  + y);  //  2
+            drVertex( -4.859633f  + x,   -8.85196f  + y);  //  3
+            drVertex( -4.783288f  + x,   -5.42815f  + y);  //  4
+            drVertex( -0.606711f  + x,   -1.11108f  + y);  //  5
+            drVertex( 5.355545f  + x,   0.48711f  + y);  //  6
+            drVertex( 10.641104f  + x,   -1.6473f  + y);  //  7
+            drVertex( 14.293812f  + x,   -6.18241f  + y);  //  8
+            drVertex( 14.675578f  + x,   -11.42744f  + y);  //  9
+            drVertex( 12.550578f  + x,   -17.30244f  + y);  //  10
+            drVertex( 7.912166f  + x,   -20.944f  + y);  //  11
+            drVertex( 3.049705f  + x,   -21.65755f  + y);  //  12
+            drVertex( -1.711005f  + x,   -21.36664f  + y);  //  13
+            drVertex( -6.283661f  + x,   -19.66739f  + y);  //  14
+            drVertex( -10.123329f  + x,   -16.79162f  + y);  //  15
+            drVertex( -13.363008f  + x,   -12.28184f  + y);  //  16
+            drVertex( -14.675578f  + x,   -5.79969f  + y);  //  17
+            drVertex( -13.66821f  + x,   0.20179f  + y);  //  18
+            drVertex( -10.385341f  + x,   6.27562f  + y);  //  19
+            drVertex( 5.539491f  + x,   20.32671f  + y);  //  20
+            drVertex( 10.431588f  + x,   28.20584f  + y);  //  21
+            drVertex( 11.00141f  + x,   34.71585f  + y);  //  22
+            drVertex( 9.204915f  + x,   39.62875f  + y);  //  23
+            drVertex( 7.854166f  + x,   42.08262f  + y);  //  24
+            drVertex( 5.481415f  + x,   42.66649f  + y);  //  25
+            drVertex( 3.57972f  + x,   41.4147f  + y);  //  26
+            drVertex( 1.507889f  + x,   37.35642f  + y);  //  27
+            drVertex( -0.381338f  + x,   31.14317f  + y);  //  28
+            drVertex( -0.664306f  + x,   25.51354f  + y);  //  29
+            drVertex( 8.296044f  + x,   -32.22694f  + y);  //  30
+            drVertex( 8.050507f  + x,   -36.6687f  + y);  //  31
+            drVertex( 6.496615f  + x,   -39.52999f  + y);  //  32
+            drVertex( 3.368583f  + x,   -41.7968f  + y);  //  33
+            drVertex( 0.253766f  + x,   -42.66649f  + y);  //  34
+            drVertex( -3.599633f  + x,   -42.23514f  + y);  //  35
+            drVertex( -8.098754f  + x,   -39.46637f  + y);  //  36
+            drVertex( -9.463279f  + x,   -35.49796f  + y);  //  37
+            drVertex( -7.08037f  + x,   -31.36512f  + y);  //  38
+            drVertex( -3.336421f  + x,   -31.14057f  + y);  //  39
+            drVertex( -1.360313f  + x,   -34.07738f  + y);  //  40
+            drVertex( -1.608342f  + x,   -37.11828f  + y);  //  41
+            drVertex( -5.729949f  + x,   -39.24759f  + y);  //  42
+            drVertex( -7.480646f  + x,   -36.2136f  + y);  //  43
+            drVertex( -6.826918f  + x,   -33.36919f  + y);  //  44
+            drVertex( -4.069083f  + x,   -32.9226f  + y);  //  45
+            drVertex( -3.040669f  + x,   -34.433f  + y);  //  46
+            drVertex( -3.737535f  + x,   -36.38759f  + y);  //  47
+            drVertex( -5.496558f  + x,   -36.97633f  + y);  //  48
+            drVertex( -5.295932f  + x,   -34.01951f  + y);  //  49
+
+            drEnd();
 
             break;
 
        case PB_SYMBOL_fClef: // The Base Clef
-            drColor(color);
-            glLineWidth (3.0f);
-            glBegin(GL_LINE_STRIP);
-                glVertex2f( -15.370325f  + x,   -17.42068f  + y);  //  1
-                glVertex2f( -7.171025f  + x,   -13.75432f  + y);  //  2
-                glVertex2f( -2.867225f  + x,   -10.66642f  + y);  //  3
-                glVertex2f( 0.925165f  + x,   -7.03249f  + y);  //  4
-                glVertex2f( 4.254425f  + x,   -0.65527f  + y);  //  5
-                glVertex2f( 4.762735f  + x,   7.77848f  + y);  //  6
-                glVertex2f( 2.693395f  + x,   13.92227f  + y);  //  7
-                glVertex2f( -1.207935f  + x,   16.80317f  + y);  //  8
-                glVertex2f( -5.526425f  + x,   17.42068f  + y);  //  9
-                glVertex2f( -10.228205f  + x,   15.65609f  + y);  //  10
-                glVertex2f( -13.453995f  + x,   10.7128f  + y);  //  11
-                glVertex2f( -13.133655f  + x,   5.43731f  + y);  //  12
-                glVertex2f( -9.475575f  + x,   3.00714f  + y);  //  13
-                glVertex2f( -5.846445f  + x,   4.72159f  + y);  //  14
-                glVertex2f( -5.395545f  + x,   9.72918f  + y);  //  15
-                glVertex2f( -8.850025f  + x,   11.64372f  + y);  //  16
-                glVertex2f( -11.519385f  + x,   10.35816f  + y);  //  17
-                glVertex2f( -11.706365f  + x,   6.8704f  + y);  //  18
-                glVertex2f( -9.463505f  + x,   5.01391f  + y);  //  19
-                glVertex2f( -7.172075f  + x,   5.81649f  + y);  //  20
-                glVertex2f( -7.189565f  + x,   8.62975f  + y);  //  21
-                glVertex2f( -9.175055f  + x,   9.82019f  + y);  //  22
-                glVertex2f( -10.696425f  + x,   8.08395f  + y);  //  23
-                glVertex2f( -8.843065f  + x,   6.66726f  + y);  //  24
-                glVertex2f( -8.995775f  + x,   8.71136f  + y);  //  25
-            glEnd();
-
-            glBegin(GL_POLYGON);
-                glVertex2f( 10.0f  + x,   14.0f  + y);  //  26
-                glVertex2f( 14.0f  + x,   14.0f + y);  //  27
-                glVertex2f( 14.0f + x,    10.0f  + y);  //  28
-                glVertex2f( 10.0f  + x,   10.0f  + y);  //  29
-                glVertex2f( 10.0f  + x,   14.0f  + y);  //  30
-            glEnd();
-
-            glBegin(GL_POLYGON);
-                glVertex2f( 10.0f + x,    4.0f  + y);  //  31
-                glVertex2f( 14.0f  + x,   4.0f  + y);  //  32
-                glVertex2f( 14.0f  + x,   0.0f  + y);  //  33
-                glVertex2f( 10.0f + x,    0.0f  + y);  //  34
-                glVertex2f( 10.0f + x,    4.0f  + y);  //  35
-           glEnd();
+            drawColor(color);
+            drLineWidth (3.0f);
+            drBegin(GL_LINE_STRIP);
+                drVertex( -15.370325f  + x,   -17.42068f  + y);  //  1
+                drVertex( -7.171025f  + x,   -13.75432f  + y);  //  2
+                drVertex( -2.867225f  + x,   -10.66642f  + y);  //  3
+                drVertex( 0.925165f  + x,   -7.03249f  + y);  //  4
+                drVertex( 4.254425f  + x,   -0.65527f  + y);  //  5
+                drVertex( 4.762735f  + x,   7.77848f  + y);  //  6
+                drVertex( 2.693395f  + x,   13.92227f  + y);  //  7
+                drVertex( -1.207935f  + x,   16.80317f  + y);  //  8
+                drVertex( -5.526425f  + x,   17.42068f  + y);  //  9
+                drVertex( -10.228205f  + x,   15.65609f  + y);  //  10
+                drVertex( -13.453995f  + x,   10.7128f  + y);  //  11
+                drVertex( -13.133655f  + x,   5.43731f  + y);  //  12
+                drVertex( -9.475575f  + x,   3.00714f  + y);  //  13
+                drVertex( -5.846445f  + x,   4.72159f  + y);  //  14
+                drVertex( -5.395545f  + x,   9.72918f  + y);  //  15
+                drVertex( -8.850025f  + x,   11.64372f  + y);  //  16
+                drVertex( -11.519385f  + x,   10.35816f  + y);  //  17
+                drVertex( -11.706365f  + x,   6.8704f  + y);  //  18
+                drVertex( -9.463505f  + x,   5.01391f  + y);  //  19
+                drVertex( -7.172075f  + x,   5.81649f  + y);  //  20
+                drVertex( -7.189565f  + x,   8.62975f  + y);  //  21
+                drVertex( -9.175055f  + x,   9.82019f  + y);  //  22
+                drVertex( -10.696425f  + x,   8.08395f  + y);  //  23
+                drVertex( -8.843065f  + x,   6.66726f  + y);  //  24
+                drVertex( -8.995775f  + x,   8.71136f  + y);  //  25
+            drEnd();
+
+            drBegin(GL_POLYGON);
+                drVertex( 10.0f  + x,   14.0f  + y);  //  26
+                drVertex( 14.0f  + x,   14.0f + y);  //  27
+                drVertex( 14.0f + x,    10.0f  + y);  //  28
+                drVertex( 10.0f  + x,   10.0f  + y);  //  29
+                drVertex( 10.0f  + x,   14.0f  + y);  //  30
+            drEnd();
+
+            drBegin(GL_POLYGON);
+                drVertex( 10.0f + x,    4.0f  + y);  //  31
+                drVertex( 14.0f  + x,   4.0f  + y);  //  32
+                drVertex( 14.0f  + x,   0.0f  + y);  //  33
+                drVertex( 10.0f + x,    0.0f  + y);  //  34
+                drVertex( 10.0f + x,    4.0f  + y);  //  35
+           drEnd();
 
           break;
 
         case PB_SYMBOL_noteHead:
             //ppLogTrace("PB_SYMBOL_noteHead x %f y %f", x, y);
             if (!CChord::isNotePlayable(symbol.getNote(), 0))
-            {
-                color = Cfg::noteColorDim();
                 playable = false;
-            }
             drawStaveExtentsion(symbol, x, 16, playable);
 
-            // See forum post at link below from PianoBooster forum user Kory.
-            // http://piano-booster.2625608.n2.nabble.com/Pianobooster-port-to-arm-linux-or-Android-td7572459.html
-            // http://piano-booster.2625608.n2.nabble.com/Pianobooster-port-to-arm-linux-or-Android-td7572459.html#a7572676
-            if (m_settings->coloredNotes() && color == Cfg::noteColor()) //KORY added
-            {
-                int note = symbol.getNote() % MIDI_OCTAVE;
-                switch (note)
-                {
-                    case 0: //note::PitchLabel::C:
-                        color = CColor(1.0, 0.0, 0.0); //Red
-                      break;
-                    case 1: //note::PitchLabel::C♯:
-                        color = CColor(1.0, 0.25, 0.0); //Red
-                      break;
-                    case 2: //note::PitchLabel::D:
-                        color = CColor(1.0, 0.5, 0.0); //Orange
-                      break;
-                    case 3: //note::PitchLabel::D♯:
-                        color = CColor(1.0, 0.75, 0.0); //Orange
-                      break;
-                    case 4: //note::PitchLabel::E:
-                        color = CColor(1.0, 1.0, 0.0); //Yellow
-                      break;
-                    case 5: //note::PitchLabel::F:
-                        color = CColor(0.0, 1.0, 0.0); //Green
-                      break;
-                    case 6: //note::PitchLabel::F♯:
-                        color = CColor(0.0, 0.5, 0.5); //Green
-                      break;
-                    case 7: //note::PitchLabel::G:
-                        color = CColor(0.0, 0.0, 1.0); //Blue
-                      break;
-                    case 8: //note::PitchLabel::G♯:
-                        color = CColor(0.290, 0.0, 0.903); //Blue
-                      break;
-                    case 9: //note::PitchLabel::A:
-                        color = CColor(0.580, 0.0, 0.827); //Dark Violet #9400D3
-                      break;
-                    case 10: //note::PitchLabel::A♯:
-                        color = CColor(0.790, 0.0, 0.903); //Dark Violet #9400D3
-                      break;
-                    case 11: //note::PitchLabel::B:
-                        color = CColor(1.0, 0.0, 1.0); //Magenta
-                      break;
-                }
-            }
-
-            drColor(color);
-            glBegin(GL_POLYGON);
-                glVertex2f(-7.0f + x,  2.0f + y); // 1
-                glVertex2f(-5.0f + x,  4.0f + y); // 2
-                glVertex2f(-1.0f + x,  6.0f + y); // 3
-                glVertex2f( 4.0f + x,  6.0f + y); // 4
-                glVertex2f( 7.0f + x,  4.0f + y); // 5
-                glVertex2f( 7.0f + x,  1.0f + y); // 6
-                glVertex2f( 6.0f + x, -2.0f + y); // 7
-                glVertex2f( 4.0f + x, -4.0f + y); // 8
-                glVertex2f( 0.0f + x, -6.0f + y); // 9
-                glVertex2f(-4.0f + x, -6.0f + y); // 10
-                glVertex2f(-8.0f + x, -3.0f + y); // 11
-                glVertex2f(-8.0f + x, -0.0f + y); // 12
-            glEnd();
+            drawNoteColor(color);
+            drBegin(GL_POLYGON);
+                drVertex(-7.0f + x,  2.0f + y); // 1
+                drVertex(-5.0f + x,  4.0f + y); // 2
+                drVertex(-1.0f + x,  6.0f + y); // 3
+                drVertex( 4.0f + x,  6.0f + y); // 4
+                drVertex( 7.0f + x,  4.0f + y); // 5
+                drVertex( 7.0f + x,  1.0f + y); // 6
+                drVertex( 6.0f + x, -2.0f + y); // 7
+                drVertex( 4.0f + x, -4.0f + y); // 8
+                drVertex( 0.0f + x, -6.0f + y); // 9
+                drVertex(-4.0f + x, -6.0f + y); // 10
+                drVertex(-8.0f + x, -3.0f + y); // 11
+                drVertex(-8.0f + x, -0.0f + y); // 12
+            drEnd();
 
             /*
             // shows the MIDI Duration (but not very useful)
-            glLineWidth(4.0f);
-            drColor(CColor(0.3, 0.4, 0.4));
-            glBegin(GL_LINE_STRIP);
-                glVertex2f(x,  y);
-                glVertex2f(x + CMidiFile::ppqnAdjust(symbol.getMidiDuration()) * HORIZONTAL_SPACING_FACTOR, y);
-            glEnd();
-            drColor(color);
+            drLineWidth(4.0f);
+            drawColor(CColor(0.3, 0.4, 0.4));
+            drBegin(GL_LINE_STRIP);
+                drVertex(x,  y);
+                drVertex(x + CMidiFile::ppqnAdjust(symbol.getMidiDuration()) * HORIZONTAL_SPACING_FACTOR, y);
+            drEnd();
+            drawColor(color);
             */
 
             checkAccidental(symbol, x, y);
             break;
 
         case PB_SYMBOL_drum:
-            if (!CChord::isNotePlayable(symbol.getNote(), 0))
-                color = Cfg::noteColorDim();
-            drColor(color);
-            glLineWidth (3.0f);
-            glBegin(GL_LINES);
-                glVertex2f( 5.0f + x,-5.0f + y);
-                glVertex2f(-5.0f + x, 5.0f + y);
-                glVertex2f(-5.0f + x,-5.0f + y);
-                glVertex2f( 5.0f + x, 5.0f + y);
-            glEnd();
+            drawNoteColor(color);
+            drLineWidth (3.0f);
+            drBegin(GL_LINES);
+                drVertex( 5.0f + x,-5.0f + y);
+                drVertex(-5.0f + x, 5.0f + y);
+                drVertex(-5.0f + x,-5.0f + y);
+                drVertex( 5.0f + x, 5.0f + y);
+            drEnd();
             checkAccidental(symbol, x, y);
             break;
 
         case PB_SYMBOL_sharp:
-            glLineWidth (2.0f);
-            glBegin(GL_LINES);
-                glVertex2f(-2.0f + x, -14.0f + y);
-                glVertex2f(-2.0f + x,  14.0f + y);
+            drLineWidth (2.0f);
+            drBegin(GL_LINES);
+                drVertex(-2.0f + x, -14.0f + y);
+                drVertex(-2.0f + x,  14.0f + y);
 
-                glVertex2f( 2.0f + x, -13.0f + y);
-                glVertex2f( 2.0f + x,  15.0f + y);
+                drVertex( 2.0f + x, -13.0f + y);
+                drVertex( 2.0f + x,  15.0f + y);
 
-                glVertex2f(-5.0f + x,   4.0f + y);
-                glVertex2f( 5.0f + x,   7.0f + y);
+                drVertex(-5.0f + x,   4.0f + y);
+                drVertex( 5.0f + x,   7.0f + y);
 
-                glVertex2f(-5.0f + x,  -6.0f + y);
-                glVertex2f( 5.0f + x,  -3.0f + y);
-            glEnd();
+                drVertex(-5.0f + x,  -6.0f + y);
+                drVertex( 5.0f + x,  -3.0f + y);
+            drEnd();
             break;
 
          case PB_SYMBOL_flat:
-            glLineWidth (2.0f);
-            glBegin(GL_LINE_STRIP);
-                glVertex2f(-4.0f + x, 17.0f + y);  // 1
-                glVertex2f(-4.0f + x, -6.0f + y);  // 2
-                glVertex2f( 2.0f + x, -2.0f + y);  // 3
-                glVertex2f( 5.0f + x,  2.0f + y);  // 4
-                glVertex2f( 5.0f + x,  4.0f + y);  // 5
-                glVertex2f( 3.0f + x,  5.0f + y);  // 6
-                glVertex2f( 0.0f + x,  5.0f + y);  // 7
-                glVertex2f(-4.0f + x,  2.0f + y);  // 8
-            glEnd();
+            drLineWidth (2.0f);
+            drBegin(GL_LINE_STRIP);
+                drVertex(-4.0f + x, 17.0f + y);  // 1
+                drVertex(-4.0f + x, -6.0f + y);  // 2
+                drVertex( 2.0f + x, -2.0f + y);  // 3
+                drVertex( 5.0f + x,  2.0f + y);  // 4
+                drVertex( 5.0f + x,  4.0f + y);  // 5
+                drVertex( 3.0f + x,  5.0f + y);  // 6
+                drVertex( 0.0f + x,  5.0f + y);  // 7
+                drVertex(-4.0f + x,  2.0f + y);  // 8
+            drEnd();
             break;
 
          case PB_SYMBOL_natural:
-            glLineWidth (2.0f);
-            glBegin(GL_LINES);
-                glVertex2f(  3.0f + x,   -15.0f  + y);  //  1
-                glVertex2f(  3.0f + x,   8.0f  + y);  //  2
+            drLineWidth (2.0f);
+            drBegin(GL_LINES);
+                drVertex(  3.0f + x,   -15.0f  + y);  //  1
+                drVertex(  3.0f + x,   8.0f  + y);  //  2
 
-                glVertex2f( -3.0f + x,   -8.0f  + y);  //  3
-                glVertex2f( -3.0f + x,   15.0f  + y);  //  4
+                drVertex( -3.0f + x,   -8.0f  + y);  //  3
+                drVertex( -3.0f + x,   15.0f  + y);  //  4
 
-                glVertex2f(  3.0f + x,   8.0f  + y);  //  5
-                glVertex2f( -3.0f + x,   2.0f  + y);  //  6
+                drVertex(  3.0f + x,   8.0f  + y);  //  5
+                drVertex( -3.0f + x,   2.0f  + y);  //  6
 
-                glVertex2f(  3.0f + x,   -2.0f  + y);  //  7
-                glVertex2f( -3.0f + x,   -8.0f  + y);  //  8
-            glEnd();
+                drVertex(  3.0f + x,   -2.0f  + y);  //  7
+                drVertex( -3.0f + x,   -8.0f  + y);  //  8
+            drEnd();
             break;
 
         case PB_SYMBOL_barLine:
             x += BEAT_MARKER_OFFSET * HORIZONTAL_SPACING_FACTOR; // the beat markers where entered early so now move them correctly
-            glLineWidth (4.0f);
-            drColor ((m_displayHand == PB_PART_left) ? Cfg::staveColorDim() : Cfg::staveColor());
+            drLayer(BATCH_LAYER_BACKGROUND); // under the notes
+            drLineWidth (4.0f);
+            drawColor((m_displayHand == PB_PART_left) ? Cfg::staveColorDim() : Cfg::staveColor());
             oneLine(x, CStavePos(PB_PART_right, 4).getPosYRelative(), x, CStavePos(PB_PART_right, -4).getPosYRelative());
-            drColor ((m_displayHand == PB_PART_right) ? Cfg::staveColorDim() : Cfg::staveColor());
+            drawColor((m_displayHand == PB_PART_right) ? Cfg::staveColorDim() : Cfg::staveColor());
             oneLine(x, CStavePos(PB_PART_left, 4).getPosYRelative(), x, CStavePos(PB_PART_left, -4).getPosYRelative());
+            drLayer(BATCH_LAYER_FOREGROUND);
             break;
 
         case PB_SYMBOL_barMarker:
             x += BEAT_MARKER_OFFSET * HORIZONTAL_SPACING_FACTOR; // the beat markers where entered early so now move them correctly
-            glLineWidth (5.0f);
-            drColor(Cfg::barMarkerColor());
+            drLayer(BATCH_LAYER_BACKGROUND); // under the notes
+            drLineWidth (5.0f);
+            drawColor(Cfg::barMarkerColor());
             oneLine(x, CStavePos(PB_PART_right, m_beatMarkerHeight).getPosYRelative(), x, CStavePos(PB_PART_left, -m_beatMarkerHeight).getPosYRelative());
             glDisable (GL_LINE_STIPPLE);
+            drLayer(BATCH_LAYER_FOREGROUND);
             break;
 
         case PB_SYMBOL_beatMarker:
             x += BEAT_MARKER_OFFSET * HORIZONTAL_SPACING_FACTOR; // the beat markers where entered early so now move them correctly
-            glLineWidth (4.0);
-            drColor(Cfg::beatMarkerColor());
+            drLayer(BATCH_LAYER_BACKGROUND); // under the notes
+            drLineWidth (4.0);
+            drawColor(Cfg::beatMarkerColor());
             oneLine(x, CStavePos(PB_PART_right, m_beatMarkerHeight).getPosYRelative(), x, CStavePos(PB_PART_left, -m_beatMarkerHeight).getPosYRelative());
             glDisable (GL_LINE_STIPPLE);
+            drLayer(BATCH_LAYER_FOREGROUND);
             break;
 
          case PB_SYMBOL_playingZone:
@@ -772,14 +950,14 @@ void CDraw::drawSymbol(CSymbol symbol, float x, float y, CSlot* slot)
                 float bottomY = CStavePos(PB_PART_left, -m_beatMarkerHeight).getPosY();
                 float early = static_cast<float>(Cfg::playZoneEarly()) * HORIZONTAL_SPACING_FACTOR;
                 float late = static_cast<float>(Cfg::playZoneLate()) * HORIZONTAL_SPACING_FACTOR;
-                //glColor3f (0.7f, 1.0f, 0.7f);
-                glColor3f (0.0f, 0.0f, 0.3f);
-                glRectf(x-late, topY, x + early, bottomY);
-                glLineWidth (2.0f);
-                glColor3f (0.0f, 0.0f, 0.8f);
+                //drawColor(CColor(0.7f, 1.0f, 0.7f));
+                drawColor(CColor(0.0f, 0.0f, 0.3f));
+                drRect(x-late, topY, x + early, bottomY);
+                drLineWidth (2.0f);
+                drawColor(CColor(0.0f, 0.0f, 0.8f));
                 oneLine(x, topY, x, bottomY );
-                glLineWidth (1.0f);
-                glColor3f (0.0f, 0.0f, 0.6f);
+                drLineWidth (1.0f);
+                drawColor(CColor(0.0f, 0.0f, 0.6f));
                 oneLine(x-late, topY, x-late, bottomY );
                 oneLine(x+early, topY, x+early, bottomY );
             }
@@ -794,24 +972,26 @@ void CDraw::drawSymbol(CSymbol symbol, float x, float y, CSlot* slot)
             break;
     }
 
-    if (symbol.getType() >= PB_SYMBOL_noteHead)
-    {
-        if ( symbol.getPianistTiming() != NOT_USED)
-        {
-            auto pianistX = static_cast<float>(symbol.getPianistTiming());
-            pianistX =  x + pianistX * HORIZONTAL_SPACING_FACTOR;
-            drColor(CColor(1.0, 1.0, 1.0));
-            glLineWidth (2.0f);
-            glBegin(GL_LINES);
-            glVertex2f( 4.0f + pianistX, 4.0f + y);
-            glVertex2f(-5.0f + pianistX,-5.0f + y);
-            glVertex2f( 4.0f + pianistX,-4.0f + y); // draw pianist note timing markers
-            glVertex2f(-5.0f + pianistX, 5.0f + y);
-            glEnd();
-        }
-        if ( playable )
-            drawStaveNoteName(symbol, x, y);
-    }
+    if (symbol.getType() >= PB_SYMBOL_noteHead && playable)
+        drawStaveNoteName(symbol, x, y);
+}
+
+// The timing markers change all the time so they are not part of the slot
+void CDraw::drawPianistTiming(CSymbol symbol, float x, float y)
+{
+    if (symbol.getType() < PB_SYMBOL_noteHead || symbol.getPianistTiming() == NOT_USED)
+        return;
+
+    auto pianistX = static_cast<float>(symbol.getPianistTiming());
+    pianistX =  x + pianistX * HORIZONTAL_SPACING_FACTOR;
+    drawColor(CColor(1.0, 1.0, 1.0));
+    drLineWidth (2.0f);
+    drBegin(GL_LINES);
+    drVertex( 4.0f + pianistX, 4.0f + y);
+    drVertex(-5.0f + pianistX,-5.0f + y);
+    drVertex( 4.0f + pianistX,-4.0f + y); // draw pianist note timing markers
+    drVertex(-5.0f + pianistX, 5.0f + y);
+    drEnd();
 }
 
 void CDraw::drawSymbol(CSymbol symbol, float x)
@@ -829,34 +1009,72 @@ void CDraw::drawSlot(CSlot* slot)
         //ppLogTrace ("compileSlot len %d id %2d next %2d time %2d type %2d note %2d", slot->length(), slot->m_displayListId,
         //slot->m_nextDisplayListId, slot->getDeltaTime(), slot->getSymbol(i).getType(), slot->getSymbol(i).getNote());
 
+        m_batchSymbol = i;
         drawSymbol(slot->getSymbol(i), 0.0, stavePos.getPosYRelative()); // we add this  back when drawing this symbol
     }
+    m_batchSymbol = -1;
+}
+
+void CDraw::drawSlotLayout(CSlot* slot)
+{
+    CStavePos stavePos;
+    m_drawNoteDecorations = false;
+    for (int i=0; i < slot->length(); i++)
+    {
+        CSymbol* symbol = slot->getSymbolPtr(i);
+        float y = 0.0f; // the notes are moved to the stave position when the slot is drawn
+        if (!isPitchedSymbol(*symbol))
+        {
+            stavePos.notePos(symbol->getHand(), symbol->getNote());
+            y = stavePos.getPosYRelative();
+        }
+        m_batchSymbol = i;
+        drawSymbol(*symbol, 0.0, y);
+    }
+    m_batchSymbol = -1;
+    m_drawNoteDecorations = true;
+}
+
+void CDraw::drawNoteDecorations(CSymbol symbol, float x, float y)
+{
+    bool playable = (m_displayHand == symbol.getHand() || m_displayHand == PB_PART_both);
+
+    if (symbol.getType() >= PB_SYMBOL_noteHead)
+    {
+        if (!CChord::isNotePlayable(symbol.getNote(), 0))
+            playable = false;
+        drawStaveExtentsion(symbol, x, 16, playable);
+    }
+    drawColor(getSymbolColor(symbol));
+    checkAccidental(symbol, x, y);
+    if (symbol.getType() >= PB_SYMBOL_noteHead && playable)
+        drawStaveNoteName(symbol, x, y);
 }
 
 void CDraw::drawStaves(float startX, float endX)
 {
     int i;
 
-    glLineWidth (Cfg::staveThickness());
+    drLineWidth (Cfg::staveThickness());
 
     /* select color for all lines  */
-    drColor ((m_displayHand != PB_PART_left) ? Cfg::staveColor() : Cfg::staveColorDim());
-    glBegin(GL_LINES);
+    drawColor((m_displayHand != PB_PART_left) ? Cfg::staveColor() : Cfg::staveColorDim());
+    drBegin(GL_LINES);
 
     for (i = -4; i <= 4; i+=2 )
     {
         CStavePos pos = CStavePos(PB_PART_right, i);
-        glVertex2f (startX, pos.getPosY());
-        glVertex2f (endX, pos.getPosY());
+        drVertex (startX, pos.getPosY());
+        drVertex (endX, pos.getPosY());
     }
-    drColor ((m_displayHand != PB_PART_right) ? Cfg::staveColor() : Cfg::staveColorDim());
+    drawColor((m_displayHand != PB_PART_right) ? Cfg::staveColor() : Cfg::staveColorDim());
     for (i = -4; i <= 4; i+=2 )
     {
         CStavePos pos = CStavePos(PB_PART_left, i);
-        glVertex2f (startX, pos.getPosY());
-        glVertex2f (endX,   pos.getPosY());
+        drVertex (startX, pos.getPosY());
+        drVertex (endX,   pos.getPosY());
     }
-    glEnd();
+    drEnd();
 }
 
 void CDraw::drawKeySignature(int key)
@@ -878,13 +1096,13 @@ void CDraw::drawKeySignature(int key)
         {
             if (i < arraySize(sharpLookUpRight))
             {
-                drColor ((m_displayHand != PB_PART_left) ? Cfg::noteColor() : Cfg::noteColorDim());
+                drawColor((m_displayHand != PB_PART_left) ? Cfg::noteColor() : Cfg::noteColorDim());
                 pos = CStavePos(PB_PART_right, sharpLookUpRight[i]);
                 drawSymbol( CSymbol(PB_SYMBOL_sharp, pos), Cfg::keySignatureX() + gapX * static_cast<float>(i) );
             }
             if (i < arraySize(sharpLookUpLeft))
             {
-                drColor ((m_displayHand != PB_PART_right) ? Cfg::noteColor() : Cfg::noteColorDim());
+                drawColor((m_displayHand != PB_PART_right) ? Cfg::noteColor() : Cfg::noteColorDim());
                 pos = CStavePos(PB_PART_left, sharpLookUpLeft[i]);
                 drawSymbol( CSymbol(PB_SYMBOL_sharp, pos), Cfg::keySignatureX() + gapX * static_cast<float>(i) );
             }
@@ -894,13 +1112,13 @@ void CDraw::drawKeySignature(int key)
         {
             if (i < arraySize(flatLookUpRight))
             {
-                drColor ((m_displayHand != PB_PART_left) ? Cfg::noteColor() : Cfg::noteColorDim());
+                drawColor((m_displayHand != PB_PART_left) ? Cfg::noteColor() : Cfg::noteColorDim());
                 pos = CStavePos(PB_PART_right, flatLookUpRight[i]);
                 drawSymbol( CSymbol(PB_SYMBOL_flat, pos), Cfg::keySignatureX() + gapX * static_cast<float>(i) );
             }
             if (i < arraySize(flatLookUpLeft))
             {
-                drColor ((m_displayHand != PB_PART_right) ? Cfg::noteColor() : Cfg::noteColorDim());
+                drawColor((m_displayHand != PB_PART_right) ? Cfg::noteColor() : Cfg::noteColorDim());
                 pos = CStavePos(PB_PART_left, flatLookUpLeft[i]);
                 drawSymbol( CSymbol(PB_SYMBOL_flat, pos), Cfg::keySignatureX() + gapX * static_cast<float>(i) );
             }
@@ -39,12 +39,10 @@
   #include <GL/gl.h>
   #include <GL/glu.h>
 #endif
-#ifndef NO_USE_FTGL
-#include <FTGL/ftgl.h>
-#endif
 #include <QObject>
 #include <QFile>
 #include <QApplication>
+#include <vector>
 
 #define HORIZONTAL_SPACING_FACTOR   (0.75f) // defines the speed of the scrolling
 #define FONT_SIZE 16
@@ -52,6 +50,8 @@
 #include "StavePosition.h"
 
 #include "Symbol.h"
+#include "DrawBatch.h"
+#include "GlyphAtlas.h"
 
 class CSettings;
 class CSlot;
@@ -75,18 +75,14 @@ public:
 
     CDraw(CSettings* settings);
 
-    ~CDraw(){
-#ifndef NO_USE_FTGL
-        if (font!=nullptr) delete font;
-#endif
-    }
+    ~CDraw(){}
 
     void scrollVertex(float x, float y)
     {
         if (m_scrollProperties->horizontal())
-            glVertex2f (x,y);
+            drVertex (x,y);
         else
-            glVertex2f (y,x);
+            drVertex (y,x);
     }
 
     void drawSymbol(CSymbol symbol, float x, float y, CSlot* slot = 0);
@@ -101,18 +97,84 @@ public:
     static whichPart_t getDisplayHand()    {return m_displayHand;}
     static void drColor(CColor color) { glColor3f(color.red, color.green, color.blue);}
     static void forceCompileRedraw(int value = 1) {    m_forceCompileRedraw = value; }
+    static int getCompileRedrawCount() {  return m_forceCompileRedraw; }
+    //! the note names are drawn with this (it is owned by the GL widget)
+    static void setTextAtlas(CGlyphAtlas* atlas);
 
 protected:
     static whichPart_t m_displayHand;
-    static int getCompileRedrawCount() {  return m_forceCompileRedraw; }
+
+    //! send the drawing into a batch (nullptr draws straight to OpenGL)
+    void setBatch(CDrawBatch* batch)
+    {
+        m_batch = batch;
+        m_batchLayer = BATCH_LAYER_FOREGROUND;
+    }
+    void drawBatch(const CDrawBatch &batch);
+
+    // These work like the OpenGL calls but go into the batch when there is one
+    void drBegin(GLenum mode)
+    {
+        if (m_batch == nullptr)
+            glBegin(mode);
+        m_batchMode = mode;
+    }
+    void drVertex(float x, float y)
+    {
+        if (m_batch == nullptr)
+        {
+            glVertex2f(x, y);
+            return;
+        }
+        batchVertex_t vertex = {x, y, m_batchColor.red, m_batchColor.green, m_batchColor.blue, m_batchSymbol};
+        m_batchPrimitive.push_back(vertex);
+    }
+    void drEnd();
+    void drLineWidth(float width)
+    {
+        if (m_batch == nullptr)
+            glLineWidth(width);
+        m_batchLineWidth = width;
+    }
+    void drawColor(CColor color)
+    {
+        if (m_batch == nullptr)
+            drColor(color);
+        m_batchColor = color;
+        m_batchNoteColor = false;
+    }
+    //! like drawColor() but the colour can be changed later with CDrawBatch::setAttributeColor()
+    void drawNoteColor(CColor color)
+    {
+        drawColor(color);
+        m_batchNoteColor = true;
+    }
+    void drRect(float x1, float y1, float x2, float y2);
+    void drLayer(int layer) { m_batchLayer = layer; }
+
+    //! the colour the symbol is drawn in on the screen
+    CColor getSymbolColor(CSymbol symbol);
+    //! notes and drums are the symbols that move up and down the stave with the pitch
+    static bool isPitchedSymbol(CSymbol &symbol)
+    {
+        return symbol.getType() == PB_SYMBOL_drum || symbol.getType() >= PB_SYMBOL_noteHead;
+    }
+    //! draw the slot with all the notes at y = 0 and without anything that depends on the pitch
+    void drawSlotLayout(CSlot* slot);
+    //! the ledger lines, accidental and note name left out by drawSlotLayout()
+    void drawNoteDecorations(CSymbol symbol, float x, float y);
+    void drawPianistTiming(CSymbol symbol, float x, float y);
 
     void oneLine(float x1, float y1, float x2, float y2);
     void drawStaves(float startX, float endX);
     void drawKeySignature(int key);
     void drawNoteName(int midiNote, float x, float y, int type);
 #ifndef NO_USE_FTGL
-    void renderText(float x, float y, const char* s);
+    void renderText(float x, float y, CColor color, const char* s);
+    void drText(float x, float y, const char* s);
 #endif
+    //! draw the text queued by renderText()
+    void flushText();
     CSettings* m_settings;
 
 private:
@@ -125,12 +187,21 @@ private:
     static int m_forceCompileRedraw;
     const static int m_beatMarkerHeight = 10; // The height of the beat markers in the stave positions
 
+    CDrawBatch* m_batch;
+    int m_batchLayer;
+    GLenum m_batchMode;
+    float m_batchLineWidth;
+    CColor m_batchColor;
+    bool m_batchNoteColor; // the current colour is the colour of the note being drawn
+    int m_batchSymbol; // the index of the symbol in the slot being drawn
+    bool m_drawNoteDecorations;
+    std::vector<batchVertex_t> m_batchPrimitive; // the vertices since drBegin()
+
     CScrollProperties *m_scrollProperties;
     CScrollProperties m_scrollPropertiesHorizontal;
     CScrollProperties m_scrollPropertiesVertical;
-#ifndef NO_USE_FTGL
-    FTFont *font;
-#endif
+    static CGlyphAtlas* m_textAtlas;
+    static int m_noteNameFontId;
 };
 
 #endif //__DRAW_H__
@@ -0,0 +1,187 @@
+/*********************************************************************************/
+/*!
+@file           DrawBatch.cpp
+
+@brief          Geometry collected into vertex arrays so it can be drawn in a few calls.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <cfloat>
+
+#include "DrawBatch.h"
+
+void CDrawBatch::clear()
+{
+    // keep the buckets and their memory for the next time
+    for (auto &bucket : m_buckets)
+        bucket.vertices.clear();
+    m_texts.clear();
+    m_ranges.clear();
+    m_attributeFirst.clear();
+    m_attribute = -1;
+    m_vertexCount = 0;
+    m_lastBucket = -1;
+    m_minX = FLT_MAX;
+    m_maxX = -FLT_MAX;
+}
+
+// triangles are drawn before lines and thin lines before thick ones
+static bool drawnBefore(int layer, GLenum mode, float width, const CDrawBatch::bucket_t &bucket)
+{
+    if (layer != bucket.layer)
+        return layer < bucket.layer;
+    if (mode != bucket.mode)
+        return mode == GL_TRIANGLES;
+    return width < bucket.width;
+}
+
+CDrawBatch::bucket_t* CDrawBatch::findBucket(int layer, GLenum mode, float width)
+{
+    if (mode == GL_TRIANGLES)
+        width = 0.0f;
+
+    // nearly always the same bucket as last time
+    if (m_lastBucket >= 0)
+    {
+        bucket_t &last = m_buckets[static_cast<size_t>(m_lastBucket)];
+        if (last.layer == layer && last.mode == mode && last.width == width)
+            return &last;
+    }
+
+    size_t i;
+    for (i = 0; i < m_buckets.size(); i++)
+    {
+        bucket_t &bucket = m_buckets[i];
+        if (bucket.layer == layer && bucket.mode == mode && bucket.width == width)
+        {
+            m_lastBucket = static_cast<int>(i);
+            return &bucket;
+        }
+        if (drawnBefore(layer, mode, width, bucket))
+            break;
+    }
+
+    bucket_t bucket;
+    bucket.layer = layer;
+    bucket.mode = mode;
+    bucket.width = width;
+    m_buckets.insert(m_buckets.begin() + static_cast<long>(i), bucket);
+    for (auto &range : m_ranges)
+    {
+        if (range.bucket >= static_cast<int>(i))
+            range.bucket++;
+    }
+    m_lastBucket = static_cast<int>(i);
+    return &m_buckets[i];
+}
+
+void CDrawBatch::addVertex(int layer, GLenum mode, float width, const batchVertex_t &vertex)
+{
+    std::vector<batchVertex_t> &vertices = findBucket(layer, mode, width)->vertices;
+    if (m_attribute >= 0)
+    {
+        const int first = static_cast<int>(vertices.size());
+        attributeRange_t* last = m_ranges.empty() ? nullptr : &m_ranges.back();
+        if (last != nullptr && last->attribute == m_attribute && last->bucket == m_lastBucket && last->first + last->count == first)
+            last->count++;
+        else
+            m_ranges.push_back({m_attribute, m_lastBucket, first, 1});
+    }
+    vertices.push_back(vertex);
+    m_vertexCount++;
+    addX(vertex.x);
+}
+
+void CDrawBatch::setAttribute(int attribute)
+{
+    m_attribute = attribute;
+    if (attribute < 0)
+        return;
+    if (attribute >= static_cast<int>(m_attributeFirst.size()))
+        m_attributeFirst.resize(static_cast<size_t>(attribute) + 1, -1);
+    if (m_attributeFirst[static_cast<size_t>(attribute)] < 0)
+        m_attributeFirst[static_cast<size_t>(attribute)] = static_cast<int>(m_ranges.size());
+}
+
+void CDrawBatch::setAttributeColor(int attribute, CColor color)
+{
+    if (attribute < 0 || attribute >= static_cast<int>(m_attributeFirst.size()))
+        return;
+    const int first = m_attributeFirst[static_cast<size_t>(attribute)];
+    if (first < 0)
+        return;
+
+    for (auto i = static_cast<size_t>(first); i < m_ranges.size() && m_ranges[i].attribute == attribute; i++)
+    {
+        const attributeRange_t &range = m_ranges[i];
+        std::vector<batchVertex_t> &vertices = m_buckets[static_cast<size_t>(range.bucket)].vertices;
+        for (int j = range.first; j < range.first + range.count; j++)
+        {
+            batchVertex_t &vertex = vertices[static_cast<size_t>(j)];
+            vertex.red = color.red;
+            vertex.green = color.green;
+            vertex.blue = color.blue;
+        }
+    }
+}
+
+void CDrawBatch::addText(float x, float y, CColor color, const char* text)
+{
+    batchText_t item;
+    item.x = x;
+    item.y = y;
+    item.color = color;
+    item.text = text;
+    m_texts.push_back(item);
+    // the text is centred on x and the note names are short
+    addX(x - 20.0f);
+    addX(x + 20.0f);
+}
+
+void CDrawBatch::append(const CDrawBatch &batch, float deltaX, const float* deltaY)
+{
+    for (const auto &from : batch.m_buckets)
+    {
+        if (from.vertices.empty())
+            continue;
+        std::vector<batchVertex_t> &vertices = findBucket(from.layer, from.mode, from.width)->vertices;
+        for (batchVertex_t vertex : from.vertices)
+        {
+            vertex.x += deltaX;
+            if (deltaY != nullptr && vertex.symbol >= 0)
+                vertex.y += deltaY[vertex.symbol];
+            vertices.push_back(vertex);
+        }
+        m_vertexCount += static_cast<int>(from.vertices.size());
+    }
+    for (const auto &text : batch.m_texts)
+    {
+        m_texts.push_back(text);
+        m_texts.back().x += deltaX;
+    }
+    if (!batch.isEmpty())
+    {
+        addX(batch.m_minX + deltaX);
+        addX(batch.m_maxX + deltaX);
+    }
+}
@@ -0,0 +1,139 @@
+/*********************************************************************************/
+/*!
+@file           DrawBatch.h
+
+@brief          Geometry collected into vertex arrays so it can be drawn in a few calls.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __DRAW_BATCH_H__
+#define __DRAW_BATCH_H__
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+#endif
+
+#ifdef __APPLE__
+  #include <OpenGL/gl.h>
+#else
+  #include <GL/gl.h>
+#endif
+
+#include "Cfg.h"
+
+// The layers are drawn in order so things like the ledger lines stay under the notes
+#define BATCH_LAYER_BACKGROUND  0
+#define BATCH_LAYER_FOREGROUND  1
+
+typedef struct
+{
+    GLfloat x, y;
+    GLfloat red, green, blue;
+    int symbol; // the symbol in the slot the vertex belongs to (-1 for none)
+} batchVertex_t;
+
+typedef struct
+{
+    GLfloat x, y;
+    CColor color;
+    std::string text;
+} batchText_t;
+
+/*!
+ * @brief   Lines and triangles kept in vertex arrays grouped by layer and line width.
+ *
+ * CDraw fills one of these instead of drawing straight to OpenGL (see CDraw::setBatch)
+ * and CDraw::drawBatch() then draws each group with a single glDrawArrays.
+ * Clearing keeps the memory so a batch that is refilled every frame stops allocating.
+ *
+ * Vertices can be tagged with an attribute (the symbol index in a slot) so the colour
+ * of one note can be changed in place without building the whole batch again.
+ */
+class CDrawBatch
+{
+public:
+    CDrawBatch() { clear(); }
+
+    void clear();
+    bool isEmpty() const {return m_vertexCount == 0 && m_texts.empty();}
+
+    //! mode is GL_LINES or GL_TRIANGLES, the width is only used for lines
+    void addVertex(int layer, GLenum mode, float width, const batchVertex_t &vertex);
+    void addText(float x, float y, CColor color, const char* text);
+
+    //! the vertices added from now on belong to this attribute (-1 for none)
+    void setAttribute(int attribute);
+    //! change the colour of all the vertices that belong to the attribute
+    void setAttributeColor(int attribute, CColor color);
+
+    //! add all of another batch moved along by deltaX, deltaY (if used) moves each symbol up or down
+    void append(const CDrawBatch &batch, float deltaX, const float* deltaY = nullptr);
+
+    // the horizontal extent of everything in the batch
+    float getMinX() const {return m_minX;}
+    float getMaxX() const {return m_maxX;}
+
+    typedef struct
+    {
+        int layer;
+        GLenum mode;
+        float width;
+        std::vector<batchVertex_t> vertices;
+    } bucket_t;
+
+    const std::vector<bucket_t> &getBuckets() const {return m_buckets;}
+    const std::vector<batchText_t> &getTexts() const {return m_texts;}
+
+private:
+    typedef struct
+    {
+        int attribute;
+        int bucket;
+        int first; // the vertex index in the bucket
+        int count;
+    } attributeRange_t;
+
+    bucket_t* findBucket(int layer, GLenum mode, float width);
+    void addX(float x)
+    {
+        if (x < m_minX)
+            m_minX = x;
+        if (x > m_maxX)
+            m_maxX = x;
+    }
+
+    std::vector<bucket_t> m_buckets; // kept in the order they are drawn
+    std::vector<batchText_t> m_texts;
+    std::vector<attributeRange_t> m_ranges; // all the ranges for one attribute are together
+    std::vector<int> m_attributeFirst; // the first range for each attribute
+    int m_attribute;
+    int m_vertexCount;
+    int m_lastBucket;
+    float m_minX;
+    float m_maxX;
+};
+
+#endif //__DRAW_BATCH_H__
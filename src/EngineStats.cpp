@@ -0,0 +1,208 @@
+/*********************************************************************************/
+/*!
+@file           EngineStats.cpp
+
+@brief          Histograms of how well the real time engine is keeping up.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <QFile>
+#include <QTextStream>
+
+#include "EngineStats.h"
+#include "Cfg.h"
+#include "Util.h"
+
+void CHistogram::reset()
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        m_buckets[i] = 0;
+    m_count = 0;
+    m_total = 0;
+    m_min = HISTOGRAM_MAX_VALUE;
+    m_max = 0;
+}
+
+int CHistogram::bucketIndex(qint64 value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return static_cast<int>(value);
+
+    // keep the top bits of the value, the exponent picks the group of buckets
+    int shift = 0;
+    while ((value >> shift) >= 2 * HISTOGRAM_SUB_BUCKETS)
+        shift++;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + static_cast<int>(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+qint64 CHistogram::bucketLowest(int index)
+{
+    if (index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+    const int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    return static_cast<qint64>(index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) << shift;
+}
+
+void CHistogram::record(qint64 value)
+{
+    if (value < 0)
+        value = 0;
+    if (value > HISTOGRAM_MAX_VALUE)
+        value = HISTOGRAM_MAX_VALUE;
+    m_buckets[bucketIndex(value)]++;
+    m_count++;
+    m_total += value;
+    if (value < m_min)
+        m_min = value;
+    if (value > m_max)
+        m_max = value;
+}
+
+qint64 CHistogram::percentile(double percent) const
+{
+    if (m_count == 0)
+        return 0;
+
+    const auto wanted = static_cast<qint64>(static_cast<double>(m_count) * percent / 100.0 + 0.5);
+    qint64 total = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        total += m_buckets[i];
+        if (total >= wanted && total > 0)
+            return qMin(bucketHighest(i), m_max);
+    }
+    return m_max;
+}
+
+QStringList CHistogram::dump() const
+{
+    QStringList lines;
+    lines.append(QString("count %1 min %2 mean %3 p50 %4 p90 %5 p99 %6 p99.9 %7 max %8")
+                 .arg(count()).arg(min()).arg(mean(), 0, 'f', 1).arg(percentile(50.0))
+                 .arg(percentile(90.0)).arg(percentile(99.0)).arg(percentile(99.9)).arg(max()));
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        if (m_buckets[i] != 0)
+            lines.append(QString("%1 - %2: %3").arg(bucketLowest(i)).arg(bucketHighest(i)).arg(m_buckets[i]));
+    }
+    return lines;
+}
+
+CEngineStats::CEngineStats()
+{
+    reset();
+}
+
+void CEngineStats::reset()
+{
+    m_clock.start();
+    m_taskStartTime = 0;
+    m_lastStartTime = -1;
+    m_expectedInterval = 1000 * static_cast<qint64>(Cfg::tickRate);
+    m_startEvents = 0;
+    m_deadlineMisses = 0;
+    m_interval.reset();
+    m_duration.reset();
+    m_events.reset();
+    m_songEventQueue.reset();
+    m_wantedChordQueue.reset();
+    m_savedNoteQueue.reset();
+}
+
+void CEngineStats::taskStarted(qint64 playedEvents)
+{
+    m_taskStartTime = m_clock.nsecsElapsed() / 1000;
+    m_startEvents = playedEvents;
+    if (m_lastStartTime >= 0)
+    {
+        const qint64 interval = m_taskStartTime - m_lastStartTime;
+        m_interval.record(interval);
+        // later than the wake up it asked for by more than a tick
+        if (interval > m_expectedInterval + 1000 * static_cast<qint64>(Cfg::tickRate))
+            m_deadlineMisses++;
+    }
+    m_lastStartTime = m_taskStartTime;
+}
+
+void CEngineStats::taskFinished(qint64 playedEvents, int songEventQueue, int wantedChordQueue, int savedNoteQueue)
+{
+    m_duration.record(m_clock.nsecsElapsed() / 1000 - m_taskStartTime);
+    m_events.record(playedEvents - m_startEvents);
+    m_songEventQueue.record(songEventQueue);
+    m_wantedChordQueue.record(wantedChordQueue);
+    m_savedNoteQueue.record(savedNoteQueue);
+}
+
+static QString summaryLine(const char* name, const CHistogram &histogram)
+{
+    return QString("%1 p50 %2 p99 %3 max %4").arg(name).arg(histogram.percentile(50.0))
+                .arg(histogram.percentile(99.0)).arg(histogram.max());
+}
+
+QStringList CEngineStats::summary() const
+{
+    QStringList lines;
+    lines.append(QString("Engine calls %1  missed deadlines %2 (over %3 ms late)")
+                 .arg(m_interval.count()).arg(m_deadlineMisses).arg(Cfg::tickRate));
+    lines.append(summaryLine("Interval (usec)", m_interval));
+    lines.append(summaryLine("Duration (usec)", m_duration));
+    lines.append(summaryLine("Events per call", m_events));
+    lines.append(summaryLine("Song event queue", m_songEventQueue));
+    lines.append(summaryLine("Wanted chord queue", m_wantedChordQueue));
+    lines.append(summaryLine("Saved note queue", m_savedNoteQueue));
+    return lines;
+}
+
+bool CEngineStats::dump(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        ppLogError("Cannot write the engine statistics \"%s\"", qPrintable(fileName));
+        return false;
+    }
+
+    QTextStream out(&file);
+    const struct
+    {
+        const char* name;
+        const CHistogram* histogram;
+    } histograms[] =
+    {
+        {"Interval between engine calls (usec)", &m_interval},
+        {"Engine call duration (usec)", &m_duration},
+        {"MIDI events sent per call", &m_events},
+        {"Song event queue length", &m_songEventQueue},
+        {"Wanted chord queue length", &m_wantedChordQueue},
+        {"Saved note queue length", &m_savedNoteQueue},
+    };
+
+    out << "Missed deadlines (over " << Cfg::tickRate << " ms late) " << m_deadlineMisses << "\n";
+    for (const auto &entry : histograms)
+    {
+        out << "\n" << entry.name << "\n";
+        for (const QString &line : entry.histogram->dump())
+            out << "    " << line << "\n";
+    }
+    return true;
+}
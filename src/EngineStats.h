@@ -0,0 +1,111 @@
+/*********************************************************************************/
+/*!
+@file           EngineStats.h
+
+@brief          Histograms of how well the real time engine is keeping up.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __ENGINE_STATS_H__
+#define __ENGINE_STATS_H__
+
+#include <QElapsedTimer>
+#include <QStringList>
+
+#define HISTOGRAM_SUB_BUCKET_BITS   4   // 16 buckets for each power of two (about 6% resolution)
+#define HISTOGRAM_SUB_BUCKETS       (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_VALUE         0x7fffffff
+#define HISTOGRAM_BUCKETS           ((32 - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_SUB_BUCKETS)
+
+// A fixed size log-linear (HDR style) histogram, recording a value never allocates
+class CHistogram
+{
+public:
+    CHistogram() { reset(); }
+
+    void reset();
+    void record(qint64 value);
+
+    qint64 count() const {return m_count;}
+    qint64 min() const {return m_count ? m_min : 0;}
+    qint64 max() const {return m_max;}
+    double mean() const {return m_count ? static_cast<double>(m_total) / static_cast<double>(m_count) : 0.0;}
+    //! the value that percent of the values are at or below
+    qint64 percentile(double percent) const;
+
+    //! the summary plus each bucket that is not empty
+    QStringList dump() const;
+
+private:
+    static int bucketIndex(qint64 value);
+    static qint64 bucketLowest(int index);
+    static qint64 bucketHighest(int index) {return bucketLowest(index + 1) - 1;}
+
+    qint64 m_buckets[HISTOGRAM_BUCKETS];
+    qint64 m_count;
+    qint64 m_total;
+    qint64 m_min;
+    qint64 m_max;
+};
+
+/*!
+ * @brief   Records how often the real time engine runs and how much it does.
+ *
+ * The interval shows the timer jitter and the duration shows what the engine costs,
+ * a deadline is missed when the engine runs more than a whole tick late.
+ */
+class CEngineStats
+{
+public:
+    CEngineStats();
+
+    void reset();
+    //! playedEvents is the running count of MIDI events sent to the output
+    void taskStarted(qint64 playedEvents);
+    void taskFinished(qint64 playedEvents, int songEventQueue, int wantedChordQueue, int savedNoteQueue);
+    //! the engine is not being run for a while, the gap is not a missed deadline
+    void taskPaused() {m_lastStartTime = -1;}
+    //! the engine is next due to run in msec
+    void taskScheduled(qint64 msec) {m_expectedInterval = msec * 1000;}
+
+    //! a few lines for the on screen display
+    QStringList summary() const;
+    bool dump(const QString &fileName) const;
+
+private:
+    QElapsedTimer m_clock;
+    qint64 m_taskStartTime;  // usec
+    qint64 m_lastStartTime;  // usec
+    qint64 m_expectedInterval; // usec until the engine was due to run again
+    qint64 m_startEvents;
+    qint64 m_deadlineMisses;
+
+    CHistogram m_interval;   // usec between the start of each call
+    CHistogram m_duration;   // usec each call takes
+    CHistogram m_events;     // MIDI events sent on each call
+    CHistogram m_songEventQueue;
+    CHistogram m_wantedChordQueue;
+    CHistogram m_savedNoteQueue;
+};
+
+#endif //__ENGINE_STATS_H__
@@ -28,9 +28,6 @@
 
 #include <QtWidgets>
 #include <QtOpenGL>
-#include <QOpenGLFunctions>
-#include <QOpenGLFunctions_1_1>
-#include <QPaintEngine>
 
 #include <cmath>
 
@@ -38,14 +35,20 @@
 #include "GlView.h"
 #include "Cfg.h"
 #include "Draw.h"
+#include "GlyphAtlas.h"
+#include "Trace.h"
 
-// This defines the PB Open GL frame per seconds.
-// Try to make sure this runs a bit faster than the screen refresh rate of 60z (or 16.6 msec)
+// The frames are paced by the display refresh (see scheduleFrame()), this is only used
+// when the swap interval is zero and for how often the song events are passed on to the GUI
 #define SCREEN_FRAME_RATE 12 // That 12 msec or 83.3 frames per second
 
-#define REDRAW_COUNT ((m_cfg_openGlOptimise >= 2) ? 1 : 2) // there are two gl buffers but redrawing once is best (set 2 with buggy gl drivers)
+#define DAMAGE_ALL ((1 << REGION_COUNT) - 1)
+
+#define IDLE_TIMEOUT 1000 // msec with the music stopped before the timer is stopped
+#define ENGINE_MAX_SLEEP 20 // msec, the engine still runs this often to read the song and update the bar number
 
 #define TEXT_LEFT_MARGIN 30
+#define TEXT_BASELINE_DROP 4 // the labels sit this much below the y position given
 
 CGLView::CGLView(QtWindow* parent, CSettings* settings)
     : QOpenGLWidget(parent)
@@ -53,26 +56,47 @@ CGLView::CGLView(QtWindow* parent, CSettings* settings)
     m_qtWindow = parent;
     m_settings = settings;
     m_rating = nullptr;
-    m_fullRedrawFlag = true;
-    m_forcefullRedraw = 0;
-    m_forceRatingRedraw = 0;
-    m_forceBarRedraw = 0;
+    m_damage = DAMAGE_ALL;
+    m_showKeyboard = false;
+    m_shownPlayMode = PB_PLAY_MODE_listen;
     m_allowedTimerEvent = true;
+    m_idle = false;
+    m_idleTime = 0;
+    m_soundLoading = false;
+    m_showEngineStats = false;
+    m_textAtlas = nullptr;
+    m_noteNameAtlas = nullptr;
+    m_timeSigFontId = m_timeRatingFontId = -1;
 
     m_backgroundColor = QColor(0, 0, 0);
 
     m_song = new CSong();
     m_score = new CScore(m_settings);
     m_displayUpdateTicks = 0;
-    m_cfg_openGlOptimise = 0; // zero is no GlOptimise
     m_eventBits = 0;
-    BENCHMARK_INIT();
+
+    // keep the last frame so only the damaged regions have to be painted again
+    setUpdateBehavior(QOpenGLWidget::PartialUpdate);
+    connect(this, &QOpenGLWidget::frameSwapped, this, &CGLView::scheduleFrame);
+
+    // The engine sleeps until it is next needed, the MIDI input wakes it up early
+    m_song->setInputNotify([this]() {
+        QMetaObject::invokeMethod(this, "midiInputArrived", Qt::QueuedConnection);
+    });
+    qApp->installEventFilter(this);
 }
 
 CGLView::~CGLView()
 {
     delete m_song;
     delete m_score;
+
+    // the textures can only be freed with the GL context
+    makeCurrent();
+    CDraw::setTextAtlas(nullptr);
+    delete m_textAtlas;
+    delete m_noteNameAtlas;
+    doneCurrent();
     m_titleHeight = 0;
 }
 
@@ -94,51 +118,162 @@ void CGLView::stopTimerEvent()
 void CGLView::startTimerEvent()
 {
     m_allowedTimerEvent=true;
+    wakeUp();
+    update(); // start the frames again
+}
+
+// A new frame is asked for as soon as the last one has been shown, with a swap interval
+// the swap waits for the vertical retrace so the scrolling moves at the display refresh rate
+void CGLView::scheduleFrame()
+{
+    if (!m_allowedTimerEvent || m_idle.load())
+        return;
+    if (format().swapInterval() > 0)
+        update();
+    else
+        QTimer::singleShot(SCREEN_FRAME_RATE, this, [this]() { update(); });
 }
 
 void CGLView::paintGL()
 {
-    BENCHMARK(2, "enter");
+    TRACE_SPAN("paintGL");
 
-    m_displayUpdateTicks = 0;
+    const bool firstFrame = (m_rating == nullptr);
 
-    if (m_fullRedrawFlag)
-        m_forcefullRedraw = m_forceRatingRedraw = m_forceBarRedraw = REDRAW_COUNT;
+    if (displayStateChanged() || CDraw::getCompileRedrawCount())
+        m_damage = DAMAGE_ALL;
+    damage(REGION_SCROLL); // the notes are always moving
+    if (m_showKeyboard)
+        damage(REGION_KEYBOARD);
+    if (m_showEngineStats)
+        damage(REGION_STATS);
 
-    if (m_forcefullRedraw) // clear the screen only if we are doing a full redraw
+    if (m_damage == DAMAGE_ALL)
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    else
+        clearDamage();
     glPixelStorei(GL_UNPACK_ALIGNMENT,4);
     glLoadIdentity();
-    //BENCHMARK(3, "glLoadIdentity");
+    m_textAtlas->setPixelRatio(devicePixelRatioF());
+    m_noteNameAtlas->setPixelRatio(devicePixelRatioF());
 
     drawDisplayText();
-    BENCHMARK(4, "drawDisplayText");
-
     drawAccurracyBar();
-    BENCHMARK(5, "drawAccurracyBar");
-
     drawBarNumber();
-    BENCHMARK(6, "drawBarNumber");
 
-    if (m_forcefullRedraw)
+    if (isDamaged(REGION_SCORE))
+    {
         m_score->drawScore();
+        drawTimeSignature();
+    }
 
-    drawTimeSignature();
+    if (m_showKeyboard && isDamaged(REGION_KEYBOARD))
+        m_score->drawPianoKeyboard();
 
-    updateMidiTask();
-    m_score->drawScroll(m_forcefullRedraw);
-    BENCHMARK(10, "drawScroll");
+    // the engine runs on its own timer, so move the notes on by the time since it last ran
+    m_score->setScrollAhead(m_song->predictScrollTicks(m_realtime.elapsed()));
+    m_score->drawScroll(true);
 
-    if (m_forcefullRedraw) m_forcefullRedraw--;
-    BENCHMARK(11, "exit");
-    BENCHMARK_RESULTS();
+    if (m_showEngineStats && isDamaged(REGION_STATS))
+        drawEngineStats();
+
+    m_textAtlas->draw(); // all the labels in one go
+    // the text is missing from the first frame so it is all drawn again
+    m_damage = firstFrame ? DAMAGE_ALL : 0;
 }
 
-void CGLView::drawTimeSignature()
+// Anything that changes the layout of the screen needs everything to be redrawn
+bool CGLView::displayStateChanged()
 {
-    if (m_forcefullRedraw == 0)
-        return;
+    const bool showKeyboard = (m_settings->value("View/PianoKeyboard").toString() == "on");
+    const QString warning = m_settings->getWarningMessage();
+    const playMode_t playMode = m_song->getPlayMode();
+
+    if (showKeyboard == m_showKeyboard && warning == m_shownWarning && playMode == m_shownPlayMode)
+        return false;
+    m_showKeyboard = showKeyboard;
+    m_shownWarning = warning;
+    m_shownPlayMode = playMode;
+    return true;
+}
+
+// The area each region draws in using the OpenGL coordinates (y goes up)
+void CGLView::getRegions(QRectF regions[REGION_COUNT])
+{
+    const auto width = static_cast<qreal>(Cfg::getAppWidth());
+    const auto height = static_cast<qreal>(Cfg::getAppHeight());
+    const QFontMetrics fm(m_timeRatingFont);
+    const qreal above = fm.ascent() + 2;
+    const qreal below = fm.descent() + TEXT_BASELINE_DROP + 2;
+    auto textLine = [above, below](qreal left, qreal right, qreal y) {
+        return QRectF(left, y - below, right - left, above + below);
+    };
+    const qreal topY = CStavePos(PB_PART_right, MAX_STAVE_INDEX).getPosY();
+    const qreal bottomY = CStavePos(PB_PART_left, MIN_STAVE_INDEX).getPosY();
+    const qreal barY = height - 14;
+    const qreal statusEnd = (accuracyBarStart == 0 || !m_shownWarning.isEmpty()) ? width : accuracyBarStart;
+
+    regions[REGION_TITLE] = textLine(0, width, height - m_titleHeight + 6);
+    regions[REGION_STATUS] = textLine(0, statusEnd, barY - 4);
+    regions[REGION_ACCURACY] = QRectF(accuracyBarStart - 2, barY - 6, 364, 12);
+    regions[REGION_BAR_NUMBER] = textLine(TEXT_LEFT_MARGIN - 2,
+                                          TEXT_LEFT_MARGIN + fm.boundingRect(tr("Bar:") + " 00000").right(),
+                                          height - m_titleHeight - 34);
+    regions[REGION_SCORE] = QRectF(0, bottomY, Cfg::scrollStartX(), topY - bottomY);
+    regions[REGION_SCROLL] = QRectF(Cfg::scrollStartX(), bottomY, width - Cfg::scrollStartX(), topY - bottomY);
+    regions[REGION_KEYBOARD] = QRectF(Cfg::staveStartX(), 0, Cfg::staveEndX() - Cfg::staveStartX(), PIANO_KEYBOARD_HEIGHT);
+    regions[REGION_STATS] = QRectF(0, 0, width, 10 + fm.height() * m_song->getEngineStats()->summary().size());
+}
+
+// Clears the damaged regions, anything that overlaps them has to be redrawn as well
+void CGLView::clearDamage()
+{
+    QRectF regions[REGION_COUNT];
+    getRegions(regions);
 
+    bool grown = true;
+    while (grown)
+    {
+        grown = false;
+        for (int i = 0; i < REGION_COUNT; i++)
+        {
+            if (!isDamaged(i))
+                continue;
+            for (int j = 0; j < REGION_COUNT; j++)
+            {
+                if (!isDamaged(j) && regions[i].intersects(regions[j]))
+                {
+                    damage(j);
+                    grown = true;
+                }
+            }
+        }
+    }
+
+    // the projection maps the app size onto the whole viewport
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const qreal scaleX = static_cast<qreal>(viewport[2]) / Cfg::getAppWidth();
+    const qreal scaleY = static_cast<qreal>(viewport[3]) / Cfg::getAppHeight();
+
+    glEnable(GL_SCISSOR_TEST);
+    for (int i = 0; i < REGION_COUNT; i++)
+    {
+        if (!isDamaged(i))
+            continue;
+        const QRectF &rect = regions[i];
+        const auto left = static_cast<GLint>(std::floor(viewport[0] + rect.left() * scaleX));
+        const auto right = static_cast<GLint>(std::ceil(viewport[0] + rect.right() * scaleX));
+        const auto bottom = static_cast<GLint>(std::floor(viewport[1] + rect.top() * scaleY));
+        const auto top = static_cast<GLint>(std::ceil(viewport[1] + rect.bottom() * scaleY));
+        glScissor(left, bottom, right - left, top - bottom);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void CGLView::drawTimeSignature()
+{
     float x,y;
     int topNumber, bottomNumber;
 
@@ -153,19 +288,19 @@ void CGLView::drawTimeSignature()
 
     x = Cfg::timeSignatureX();
 
-    CDraw::drColor ((CDraw::getDisplayHand() != PB_PART_left) ? Cfg::noteColor() : Cfg::noteColorDim());
+    CColor color = (CDraw::getDisplayHand() != PB_PART_left) ? Cfg::noteColor() : Cfg::noteColorDim();
 
     y = CStavePos(PB_PART_right,  0).getPosY() + 5;
-    renderText(x,y, 0, bufferTop, m_timeSigFont);
+    drawText(x, y, color, bufferTop, m_timeSigFontId);
     y = CStavePos(PB_PART_right, -3).getPosY() - 2;
-    renderText(x,y, 0, bufferBottom, m_timeSigFont);
+    drawText(x, y, color, bufferBottom, m_timeSigFontId);
 
-    CDraw::drColor ((CDraw::getDisplayHand() != PB_PART_right) ? Cfg::noteColor() : Cfg::noteColorDim());
+    color = (CDraw::getDisplayHand() != PB_PART_right) ? Cfg::noteColor() : Cfg::noteColorDim();
 
     y = CStavePos(PB_PART_left,   0).getPosY() + 5;
-    renderText(x,y, 0, bufferTop, m_timeSigFont);
+    drawText(x, y, color, bufferTop, m_timeSigFontId);
     y = CStavePos(PB_PART_left,  -3).getPosY() - 2;
-    renderText(x,y, 0, bufferBottom, m_timeSigFont);
+    drawText(x, y, color, bufferBottom, m_timeSigFontId);
 }
 
 void CGLView::drawAccurracyBar()
@@ -173,9 +308,8 @@ void CGLView::drawAccurracyBar()
     if (m_song->getPlayMode() == PB_PLAY_MODE_listen || !m_settings->getWarningMessage().isEmpty())
         return;
 
-    if (m_forceRatingRedraw == 0)
+    if (!isDamaged(REGION_ACCURACY))
         return;
-    m_forceRatingRedraw--;
 
     float accuracy;
     CColor color;
@@ -212,36 +346,33 @@ void CGLView::drawDisplayText()
         return; // don't run this func the first time it is called
     }
 
-    if (m_forcefullRedraw == 0)
-        return;
-
     int y = Cfg::getAppHeight() - 14;
 
     if (!m_settings->getWarningMessage().isEmpty())
     {
-        glColor3f(1.0f,0.2f,0.0f);
-        renderText(TEXT_LEFT_MARGIN, y-4, 0, m_settings->getWarningMessage(), m_timeRatingFont);
+        if (isDamaged(REGION_STATUS))
+            drawText(TEXT_LEFT_MARGIN, y-4, CColor(1.0, 0.2, 0.0), m_settings->getWarningMessage(), m_timeRatingFontId);
         return;
     }
 
-    glColor3f(1.0f,1.0f,1.0f);
+    const CColor white(1.0, 1.0, 1.0);
 
-    if (m_song->getPlayMode() != PB_PLAY_MODE_listen) {
+    if (m_song->getPlayMode() != PB_PLAY_MODE_listen && isDamaged(REGION_STATUS)) {
         if (accuracyBarStart == 0) {
             QFontMetrics fm(m_timeRatingFont);
             accuracyText = tr("Accuracy:");
             accuracyBarStart=fm.boundingRect(accuracyText + "  ").right() + TEXT_LEFT_MARGIN;
        }
 
-        renderText(TEXT_LEFT_MARGIN, y-4,0 ,accuracyText, m_timeRatingFont);
+        drawText(TEXT_LEFT_MARGIN, y-4, white, accuracyText, m_timeRatingFontId);
     }
 
-    if (m_titleHeight < 45 )
+    if (m_titleHeight < 45 || !isDamaged(REGION_TITLE))
         return;
 
     y = Cfg::getAppHeight() - m_titleHeight;
 
-    renderText(TEXT_LEFT_MARGIN, y+6, 0,tr("Song:") + " " + m_song->getSongTitle(), m_timeRatingFont);
+    drawText(TEXT_LEFT_MARGIN, y+6, white, tr("Song:") + " " + m_song->getSongTitle(), m_timeRatingFontId);
     /*
     char buffer[100];
     sprintf(buffer, "Notes %d wrong %d Late %d Score %4.1f%%",
@@ -251,11 +382,24 @@ void CGLView::drawDisplayText()
     */
 }
 
+// The engine timing histograms shown in the bottom left corner
+void CGLView::drawEngineStats()
+{
+    const QStringList lines = m_song->getEngineStats()->summary();
+    const int lineHeight = QFontMetrics(m_timeRatingFont).height();
+    int y = 10 + lineHeight * (lines.size() - 1);
+
+    for (const QString &line : lines)
+    {
+        drawText(TEXT_LEFT_MARGIN, y, CColor(1.0, 1.0, 0.0), line, m_timeRatingFontId);
+        y -= lineHeight;
+    }
+}
+
 void CGLView::drawBarNumber()
 {
-    if (m_forceBarRedraw == 0)
+    if (!isDamaged(REGION_BAR_NUMBER))
         return;
-    m_forceBarRedraw--;
 
     const auto y = static_cast<float>(Cfg::getAppHeight() - m_titleHeight - 34);
     const auto x = static_cast<float>(TEXT_LEFT_MARGIN);
@@ -263,8 +407,13 @@ void CGLView::drawBarNumber()
     //CDraw::drColor (Cfg::backgroundColor());
     //CDraw::drColor (Cfg::noteColorDim());
     //glRectf(x+30+10, y-2, x + 80, y + 16);
-    glColor3f(1.0f,1.0f,1.0f);
-    renderText(x, y, 0, tr("Bar:") + " " + QString::number(m_song->getBarNumber()), m_timeRatingFont);
+    drawText(x, y, CColor(1.0, 1.0, 1.0), tr("Bar:") + " " + QString::number(m_song->getBarNumber()), m_timeRatingFontId);
+}
+
+// The text is only queued here, it is all drawn at the end of paintGL()
+void CGLView::drawText(float x, float y, CColor color, const QString &text, int fontId)
+{
+    m_textAtlas->addText(fontId, x, y - TEXT_BASELINE_DROP, color, text);
 }
 
 void CGLView::resizeGL(int width, int height)
@@ -311,6 +460,7 @@ void CGLView::resizeGL(int width, int height)
     Cfg::setStaveEndX(static_cast<float>(sizeX - staveEndGap));
     CStavePos::setStaveCentralOffset(static_cast<float>(staveGap)/2.0f);
     CDraw::forceCompileRedraw();
+    m_damage = DAMAGE_ALL;
 }
 
 void CGLView::mousePressEvent(QMouseEvent *event)
@@ -355,6 +505,14 @@ void CGLView::initializeGL()
     m_timeSigFont =  QFont("Arial", widgetPointSize*2 );
     m_timeRatingFont =  QFont("Arial", static_cast<int>(widgetPointSize * 1.2) );
 
+    m_textAtlas = new CGlyphAtlas();
+    m_textAtlas->setPixelRatio(devicePixelRatioF());
+    m_timeSigFontId = m_textAtlas->addFont(m_timeSigFont);
+    m_timeRatingFontId = m_textAtlas->addFont(m_timeRatingFont);
+    m_noteNameAtlas = new CGlyphAtlas();
+    m_noteNameAtlas->setPixelRatio(devicePixelRatioF());
+    CDraw::setTextAtlas(m_noteNameAtlas);
+
     Cfg::setStaveEndX(400);        //This value get changed by the resizeGL func
 
     m_song->setActiveHand(PB_PART_both);
@@ -386,7 +544,7 @@ void CGLView::timerEvent(QTimerEvent *event)
 {
     if (!m_allowedTimerEvent) return;
 
-    BENCHMARK(0, "timer enter");
+    TRACE_SPAN("timerEvent");
     if (event->timerId() != m_timer.timerId())
     {
          QWidget::timerEvent(event);
@@ -394,234 +552,116 @@ void CGLView::timerEvent(QTimerEvent *event)
     }
 
     updateMidiTask();
-    BENCHMARK(1, "m_song task");
+    scheduleEngine();
 
     if (m_displayUpdateTicks < SCREEN_FRAME_RATE)
         return;
 
+    checkIdle(m_displayUpdateTicks);
     m_displayUpdateTicks = 0;
 
+    // show how far the sound font has got with loading
+    const bool soundLoading = m_song->loadProgress() >= 0;
+    if (soundLoading || m_soundLoading)
+        m_settings->updateWarningMessages();
+    m_soundLoading = soundLoading;
+
     if (m_eventBits != 0)
     {
         if ((m_eventBits & EVENT_BITS_UptoBarReached) != 0)
             m_song->playFromStartBar();
         if ((m_eventBits & EVENT_BITS_forceFullRedraw) != 0)
-            m_forcefullRedraw = m_forceRatingRedraw = m_forceBarRedraw = REDRAW_COUNT;
+            m_damage = DAMAGE_ALL;
         if ((m_eventBits & EVENT_BITS_forceRatingRedraw) != 0)
-            m_forceRatingRedraw = REDRAW_COUNT;
+            damage(REGION_ACCURACY);
         if ((m_eventBits & EVENT_BITS_newBarNumber) != 0)
-            m_forcefullRedraw = m_forceRatingRedraw = m_forceBarRedraw = REDRAW_COUNT; // fixme this did not work so redraw everything
+            damage(REGION_BAR_NUMBER);
 
         m_qtWindow->songEventUpdated(m_eventBits);
         m_eventBits = 0;
     }
-
-    if( m_cfg_openGlOptimise == 0 ) // zero is no GlOptimise
-        m_fullRedrawFlag = true;
-    else
-        m_fullRedrawFlag = false;
-
-    //glDraw();
-    update();
-    m_fullRedrawFlag = true;
-    BENCHMARK(19, "timer exit");
 }
 
-void CGLView::mediaTimerEvent(int ticks)
+// Sleep until the next song event or timeout is due instead of polling at a fixed rate
+void CGLView::scheduleEngine()
 {
-    Q_UNUSED(ticks)
+    qint64 mSec = m_song->mSecToNextEvent();
+    if (mSec < 0 || mSec > ENGINE_MAX_SLEEP)
+        mSec = ENGINE_MAX_SLEEP;
+    if (mSec < 1)
+        mSec = 1;
+    m_timer.start(static_cast<int>(mSec), Qt::PreciseTimer, this);
+    m_song->engineStatsScheduled(mSec);
 }
 
-#ifndef QT_OPENGL_ES
-
-static void qt_save_gl_state(QOpenGLFunctions_1_1 *functions1_1)
+void CGLView::midiInputArrived()
 {
-    functions1_1->glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
-    functions1_1->glPushAttrib(GL_ALL_ATTRIB_BITS);
-    functions1_1->glMatrixMode(GL_TEXTURE);
-    functions1_1->glPushMatrix();
-    functions1_1->glLoadIdentity();
-    functions1_1->glMatrixMode(GL_PROJECTION);
-    functions1_1->glPushMatrix();
-    functions1_1->glMatrixMode(GL_MODELVIEW);
-    functions1_1->glPushMatrix();
-
-    functions1_1->glShadeModel(GL_FLAT);
-    functions1_1->glDisable(GL_CULL_FACE);
-    functions1_1->glDisable(GL_LIGHTING);
-    functions1_1->glDisable(GL_STENCIL_TEST);
-    functions1_1->glDisable(GL_DEPTH_TEST);
-    functions1_1->glEnable(GL_BLEND);
-    functions1_1->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-}
-
-static void qt_restore_gl_state(QOpenGLFunctions_1_1 *functions1_1)
-{
-    functions1_1->glMatrixMode(GL_TEXTURE);
-    functions1_1->glPopMatrix();
-    functions1_1->glMatrixMode(GL_PROJECTION);
-    functions1_1->glPopMatrix();
-    functions1_1->glMatrixMode(GL_MODELVIEW);
-    functions1_1->glPopMatrix();
-    functions1_1->glPopAttrib();
-    functions1_1->glPopClientAttrib();
+    if (!m_allowedTimerEvent)
+        return;
+    if (m_idle.load())
+    {
+        wakeUp();
+        return;
+    }
+    updateMidiTask();
+    scheduleEngine();
 }
 
-static void qt_gl_draw_text(QOpenGLFunctions *functions, QPainter *p, int x, int y, const QString &str,
-                            const QFont &font)
+// Once the music has been stopped for a while the timer is stopped as well
+void CGLView::checkIdle(qint64 ticks)
 {
-    GLfloat color[4];
-    functions->glGetFloatv(GL_CURRENT_COLOR, &color[0]);
-
-    const auto col = QColor::fromRgbF(color[0], color[1], color[2],color[3]);
-    QPen old_pen = p->pen();
-    QFont old_font = p->font();
-
-    p->setPen(col);
-    p->setFont(font);
-    p->drawText(x, y, str);
+    if (!m_song->isEngineIdle() || m_eventBits != 0)
+    {
+        m_idleTime = 0;
+        return;
+    }
+    m_idleTime += ticks;
+    if (m_idleTime < IDLE_TIMEOUT)
+        return;
 
-    p->setPen(old_pen);
-    p->setFont(old_font);
+    // anything that arrives from now on wakes us up, so pick up what came in before
+    m_idle = true;
+    updateMidiTask();
+    if (!m_song->isEngineIdle())
+    {
+        wakeUp();
+        return;
+    }
+    m_timer.stop();
+    m_song->engineStatsPaused();
+    update(); // show the last of the input
 }
 
-static inline void transform_point(GLdouble out[4], const GLdouble m[16], const GLdouble in[4])
+void CGLView::wakeUp()
 {
-#define M(row,col)  m[col*4+row]
-    out[0] =
-        M(0, 0) * in[0] + M(0, 1) * in[1] + M(0, 2) * in[2] + M(0, 3) * in[3];
-    out[1] =
-        M(1, 0) * in[0] + M(1, 1) * in[1] + M(1, 2) * in[2] + M(1, 3) * in[3];
-    out[2] =
-        M(2, 0) * in[0] + M(2, 1) * in[1] + M(2, 2) * in[2] + M(2, 3) * in[3];
-    out[3] =
-        M(3, 0) * in[0] + M(3, 1) * in[1] + M(3, 2) * in[2] + M(3, 3) * in[3];
-#undef M
+    if (!m_idle.load())
+        return;
+    m_idle = false;
+    m_idleTime = 0;
+    m_realtime.restart(); // the time asleep is not given to the engine
+    updateMidiTask(); // deal with the input straight away
+    scheduleEngine();
+    update();
 }
 
-static inline GLint qgluProject(GLdouble objx, GLdouble objy, GLdouble objz,
-           const GLdouble model[16], const GLdouble proj[16],
-           const GLint viewport[4],
-           GLdouble * winx, GLdouble * winy, GLdouble * winz)
+bool CGLView::eventFilter(QObject *watched, QEvent *event)
 {
-   GLdouble in[4], out[4];
-
-   in[0] = objx;
-   in[1] = objy;
-   in[2] = objz;
-   in[3] = 1.0;
-   transform_point(out, model, in);
-   transform_point(in, proj, out);
-
-   if (in[3] == 0.0)
-      return GL_FALSE;
-
-   in[0] /= in[3];
-   in[1] /= in[3];
-   in[2] /= in[3];
-
-   *winx = viewport[0] + (1 + in[0]) * viewport[2] / 2;
-   *winy = viewport[1] + (1 + in[1]) * viewport[3] / 2;
-
-   *winz = (1 + in[2]) / 2;
-   return GL_TRUE;
+    switch (event->type())
+    {
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::Wheel:
+        wakeUp();
+        break;
+    default:
+        break;
+    }
+    return QOpenGLWidget::eventFilter(watched, event);
 }
 
-#endif // !QT_OPENGL_ES
-
-/*!
- * \brief Renders the string \a str into the GL context of this widget.
- *
- * \a x, \a y and \a z are specified in scene or object coordinates
- * relative to the currently set projection and model matrices. This
- * can be useful if you want to annotate models with text labels and
- * have the labels move with the model as it is rotated etc.
- *
- * \remarks
- * - Taken from Qt 5's QGLWidget implementation (found in
- *   `qtbase/src/opengl/qgl.cpp`). The same counts for the static helper
- *   functions defined above.
- * - Handling the translation for the \a z coordinate has been removed
- *   as it is not used here anyways.
- */
-void CGLView::renderText(double x, double y, double z, const QString &str, const QFont & font = QFont()) {
-#ifndef QT_OPENGL_ES
-    auto *const ctx = context();
-    auto *const gl1funcs =
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
-QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_1_1>(ctx);
-#else
-ctx->versionFunctions<QOpenGLFunctions_1_1>();
-#endif
-    if (!ctx->isOpenGLES() && gl1funcs) {
-        if (str.isEmpty() || !isValid())
-            return;
-
-        QOpenGLFunctions *const funcs = ctx->functions();
-
-        QPaintEngine *engine = paintEngine();
-
-        QPainter *p;
-        bool reuse_painter = false;
-        bool use_depth_testing = funcs->glIsEnabled(GL_DEPTH_TEST);
-        bool use_scissor_testing = funcs->glIsEnabled(GL_SCISSOR_TEST);
-
-        qt_save_gl_state(gl1funcs);
-
-        if (engine->isActive()) {
-            reuse_painter = true;
-            p = engine->painter();
-        } else {
-            p = new QPainter(this);
-        }
-
-        const auto *const dev = p->device();
-        const auto width = dev ? dev->width() : this->width();
-        const auto height = dev ? dev->height() : this->height();
-        const auto dpr = dev ? dev->devicePixelRatioF() : 1.0;
-        GLdouble model[4 * 4], proj[4 * 4];
-        GLint view[4];
-        gl1funcs->glGetDoublev(GL_MODELVIEW_MATRIX, &model[0]);
-        gl1funcs->glGetDoublev(GL_PROJECTION_MATRIX, &proj[0]);
-        funcs->glGetIntegerv(GL_VIEWPORT, &view[0]);
-        GLdouble win_x = 0, win_y = 0, win_z = 0;
-        qgluProject(x, y, z, &model[0], &proj[0], &view[0],
-                    &win_x, &win_y, &win_z);
-        win_x /= dpr;
-        win_y /= dpr;
-        win_y = height + 4 - win_y; // y is inverted
-        // note: Not sure why this is rendered 4 pixels to high, just putting "+ 4" there for now.
-
-        QRect viewport(view[0], view[1], view[2], view[3]);
-        if (!use_scissor_testing && viewport != rect()) {
-            funcs->glScissor(view[0], view[1], view[2], view[3]);
-            funcs->glEnable(GL_SCISSOR_TEST);
-        } else if (use_scissor_testing) {
-            funcs->glEnable(GL_SCISSOR_TEST);
-        }
-        funcs->glViewport(0, 0, static_cast<GLsizei>(width * dpr), static_cast<GLsizei>(height * dpr));
-        gl1funcs->glAlphaFunc(GL_GREATER, 0.0);
-        funcs->glEnable(GL_ALPHA_TEST);
-        if (use_depth_testing)
-            funcs->glEnable(GL_DEPTH_TEST);
-
-        qt_gl_draw_text(funcs, p, qRound(win_x), qRound(win_y), str, font);
-
-        if (!reuse_painter) {
-            p->end();
-            delete p;
-        }
-
-        qt_restore_gl_state(gl1funcs);
-
-        return;
-    }
-#else // QT_OPENGL_ES
-    Q_UNUSED(x);
-    Q_UNUSED(y);
-    Q_UNUSED(z);
-    Q_UNUSED(str);
-    Q_UNUSED(font);
-#endif
-    qWarning("QGLWidget::renderText is not supported under OpenGL/ES");
+void CGLView::mediaTimerEvent(int ticks)
+{
+    Q_UNUSED(ticks)
 }
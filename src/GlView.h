@@ -27,6 +27,8 @@
 /*********************************************************************************/
 #ifndef __GLVIEW_H__
 #define __GLVIEW_H__
+#include <atomic>
+
 #include <QTime>
 #include <QBasicTimer>
 #include <QElapsedTimer>
@@ -34,6 +36,8 @@
 #include "Song.h"
 #include "Score.h"
 #include "Settings.h"
+
+class CGlyphAtlas;
 //#include "rtmidi/RtTimer.h"
 
 class Window;
@@ -50,13 +54,21 @@ public:
     QSize sizeHint() const;
     CSong* getSongObject() {return m_song;}
     CScore* getScoreObject() {return m_score;}
-    int m_cfg_openGlOptimise;
 
     void stopTimerEvent();
     void startTimerEvent();
+    void showEngineStats(bool show)
+    {
+        if (show == m_showEngineStats)
+            return;
+        m_showEngineStats = show;
+        damage(REGION_STATS); // clear the stats away when they are turned off
+        update();
+    }
 
 protected:
     void timerEvent(QTimerEvent *event);
+    bool eventFilter(QObject *watched, QEvent *event);
     void mediaTimerEvent(int ticks);
 
     void initializeGL();
@@ -64,14 +76,42 @@ protected:
     void resizeGL(int width, int height);
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
-    void renderText(double x, double y, double z, const QString &str, const QFont & font);
 
 private:
+    // The parts of the screen that are only repainted when they change
+    enum {
+        REGION_TITLE,       // the song title
+        REGION_STATUS,      // the accuracy label or the warning message
+        REGION_ACCURACY,    // the accuracy bar
+        REGION_BAR_NUMBER,
+        REGION_SCORE,       // the clefs, key and time signature
+        REGION_SCROLL,      // the scrolling notes and the piano input
+        REGION_KEYBOARD,
+        REGION_STATS,
+        REGION_COUNT
+    };
+
+    bool isDamaged(int region) const { return (m_damage & (1 << region)) != 0; }
+    void damage(int region) { m_damage |= 1 << region; }
+    bool displayStateChanged();
+    void getRegions(QRectF regions[REGION_COUNT]);
+    void clearDamage();
     void drawDisplayText();
     void drawTimeSignature();
     void drawAccurracyBar();
     void drawBarNumber();
+    void drawEngineStats();
+    void drawText(float x, float y, CColor color, const QString &text, int fontId);
     void updateMidiTask();
+    void scheduleFrame();
+    void scheduleEngine();
+    void checkIdle(qint64 ticks);
+
+private slots:
+    void wakeUp();
+    void midiInputArrived();
+
+private:
 
     QString accuracyText;
     int accuracyBarStart = 0;
@@ -87,14 +127,21 @@ private:
     CRating* m_rating;
     QFont m_timeSigFont;
     QFont m_timeRatingFont;
-    // TODO remove these as no longer required
-    bool m_fullRedrawFlag;
-    int m_forcefullRedraw;
-    int m_forceRatingRedraw;
-    int m_forceBarRedraw;
+    CGlyphAtlas* m_textAtlas;      // the labels round the score
+    CGlyphAtlas* m_noteNameAtlas;  // the note names drawn by CDraw
+    int m_timeSigFontId;
+    int m_timeRatingFontId;
+    int m_damage; // a bit for each region that has to be repainted
+    bool m_showKeyboard;
+    QString m_shownWarning;
+    playMode_t m_shownPlayMode;
     int m_titleHeight;
     eventBits_t m_eventBits;
     bool m_allowedTimerEvent;
+    std::atomic<bool> m_idle; // the timer is stopped until there is some input
+    qint64 m_idleTime;        // msec the engine has had nothing to do
+    bool m_soundLoading;
+    bool m_showEngineStats;
 };
 
 #endif // __GLVIEW_H__
@@ -0,0 +1,257 @@
+/*********************************************************************************/
+/*!
+@file           GlyphAtlas.cpp
+
+@brief          Draws text from a texture of pre-rendered glyphs.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <QFontMetricsF>
+#include <QPainter>
+#include <QtMath>
+
+#include "GlyphAtlas.h"
+
+#define GLYPH_PADDING   2 // empty pixels round each glyph so they don't bleed into each other
+
+#if (QT_VERSION < QT_VERSION_CHECK(5, 11, 0)) // keep compat with Qt < 5.11
+#define horizontalAdvance width
+#endif
+
+CGlyphAtlas::CGlyphAtlas() : m_image(GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, QImage::Format_ARGB32_Premultiplied)
+{
+    m_textureId = 0;
+    m_pixelRatio = 1.0;
+    clearGlyphs();
+}
+
+CGlyphAtlas::~CGlyphAtlas()
+{
+    if (m_textureId != 0)
+        glDeleteTextures(1, &m_textureId);
+}
+
+static QFont scaleFont(const QFont &font, qreal ratio)
+{
+    QFont scaled = font;
+    if (font.pointSizeF() > 0)
+        scaled.setPointSizeF(font.pointSizeF() * ratio);
+    else
+        scaled.setPixelSize(qRound(font.pixelSize() * ratio));
+    return scaled;
+}
+
+void CGlyphAtlas::setPixelRatio(qreal ratio)
+{
+    if (ratio <= 0.0 || ratio == m_pixelRatio)
+        return;
+
+    draw(); // anything waiting uses the old glyphs
+    m_pixelRatio = ratio;
+    m_scaledFonts.clear();
+    for (const QFont &font : m_fonts)
+        m_scaledFonts.push_back(scaleFont(font, m_pixelRatio));
+    clearGlyphs();
+}
+
+int CGlyphAtlas::addFont(const QFont &font)
+{
+    m_fonts.push_back(font);
+    m_scaledFonts.push_back(scaleFont(font, m_pixelRatio));
+    return static_cast<int>(m_fonts.size()) - 1;
+}
+
+void CGlyphAtlas::clearGlyphs()
+{
+    m_glyphs.clear();
+    m_image.fill(Qt::transparent);
+    m_imageChanged = true;
+    m_shelfX = 0;
+    m_shelfY = 0;
+    m_shelfHeight = 0;
+}
+
+// Returns the glyph, rendering it into the atlas the first time
+const CGlyphAtlas::glyph_t* CGlyphAtlas::findGlyph(int fontId, QChar ch)
+{
+    const quint32 key = (static_cast<quint32>(fontId) << 16) | ch.unicode();
+    auto found = m_glyphs.constFind(key);
+    if (found != m_glyphs.constEnd())
+        return &found.value();
+
+    const QFont &font = m_scaledFonts[static_cast<size_t>(fontId)];
+    QFontMetricsF metrics(font, &m_image);
+    const QRectF bounds = metrics.boundingRect(ch); // from the pen position, y is down
+    glyph_t glyph;
+    glyph.advance = static_cast<float>(metrics.horizontalAdvance(ch) / m_pixelRatio);
+
+    if (bounds.isEmpty()) // a space
+    {
+        glyph.width = glyph.height = 0.0f;
+        glyph.left = glyph.bottom = 0.0f;
+        glyph.u0 = glyph.v0 = glyph.u1 = glyph.v1 = 0.0f;
+        return &m_glyphs.insert(key, glyph).value();
+    }
+
+    const int width = qCeil(bounds.width()) + GLYPH_PADDING * 2;
+    const int height = qCeil(bounds.height()) + GLYPH_PADDING * 2;
+    if (width > GLYPH_ATLAS_SIZE || height > GLYPH_ATLAS_SIZE)
+        return nullptr;
+
+    if (m_shelfX + width > GLYPH_ATLAS_SIZE)
+    {
+        m_shelfX = 0;
+        m_shelfY += m_shelfHeight;
+        m_shelfHeight = 0;
+    }
+    if (m_shelfY + height > GLYPH_ATLAS_SIZE)
+    {
+        // Full, so draw what is waiting and start again with only the glyphs still in use
+        draw();
+        clearGlyphs();
+    }
+
+    const int cellX = m_shelfX;
+    const int cellY = m_shelfY;
+    m_shelfX += width;
+    m_shelfHeight = qMax(m_shelfHeight, height);
+
+    QPainter painter(&m_image);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    painter.drawText(QPointF(cellX + GLYPH_PADDING - bounds.left(), cellY + GLYPH_PADDING - bounds.top()), QString(ch));
+    painter.end();
+    m_imageChanged = true;
+
+    const auto ratio = static_cast<float>(m_pixelRatio);
+    glyph.left = static_cast<float>(bounds.left() - GLYPH_PADDING) / ratio;
+    glyph.bottom = static_cast<float>(-bounds.bottom() - GLYPH_PADDING) / ratio;
+    glyph.width = static_cast<float>(width) / ratio;
+    glyph.height = static_cast<float>(height) / ratio;
+    glyph.u0 = static_cast<float>(cellX) / GLYPH_ATLAS_SIZE;
+    glyph.u1 = static_cast<float>(cellX + width) / GLYPH_ATLAS_SIZE;
+    glyph.v0 = static_cast<float>(cellY) / GLYPH_ATLAS_SIZE;
+    glyph.v1 = static_cast<float>(cellY + height) / GLYPH_ATLAS_SIZE;
+    return &m_glyphs.insert(key, glyph).value();
+}
+
+float CGlyphAtlas::textWidth(int fontId, const QString &text)
+{
+    if (fontId < 0 || fontId >= static_cast<int>(m_fonts.size()))
+        return 0.0f;
+
+    float width = 0.0f;
+    for (const QChar ch : text)
+    {
+        const glyph_t* glyph = findGlyph(fontId, ch);
+        if (glyph != nullptr)
+            width += glyph->advance;
+    }
+    return width;
+}
+
+float CGlyphAtlas::descent(int fontId)
+{
+    if (fontId < 0 || fontId >= static_cast<int>(m_fonts.size()))
+        return 0.0f;
+    return static_cast<float>(QFontMetricsF(m_fonts[static_cast<size_t>(fontId)], &m_image).descent());
+}
+
+void CGlyphAtlas::addText(int fontId, float x, float y, CColor color, const QString &text, bool centred)
+{
+    if (fontId < 0 || fontId >= static_cast<int>(m_fonts.size()))
+        return;
+
+    if (centred)
+        x -= textWidth(fontId, text) / 2;
+
+    for (const QChar ch : text)
+    {
+        const glyph_t* glyph = findGlyph(fontId, ch);
+        if (glyph == nullptr)
+            continue;
+        if (glyph->width > 0.0f)
+        {
+            const float left = x + glyph->left;
+            const float bottom = y + glyph->bottom;
+            const float right = left + glyph->width;
+            const float top = bottom + glyph->height;
+            m_vertices.push_back({left,  bottom, glyph->u0, glyph->v1, color.red, color.green, color.blue});
+            m_vertices.push_back({right, bottom, glyph->u1, glyph->v1, color.red, color.green, color.blue});
+            m_vertices.push_back({right, top,    glyph->u1, glyph->v0, color.red, color.green, color.blue});
+            m_vertices.push_back({left,  top,    glyph->u0, glyph->v0, color.red, color.green, color.blue});
+        }
+        x += glyph->advance;
+    }
+}
+
+void CGlyphAtlas::updateTexture()
+{
+    if (m_textureId == 0)
+    {
+        glGenTextures(1, &m_textureId);
+        glBindTexture(GL_TEXTURE_2D, m_textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    else
+    {
+        glBindTexture(GL_TEXTURE_2D, m_textureId);
+    }
+
+    if (!m_imageChanged)
+        return;
+
+    // only happens when new glyphs have been added
+    const QImage image = m_image.convertToFormat(QImage::Format_RGBA8888);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+    m_imageChanged = false;
+}
+
+// Draws all the waiting text with one draw call
+void CGlyphAtlas::draw()
+{
+    if (m_vertices.empty())
+        return;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+    glEnable(GL_TEXTURE_2D);
+    updateTexture();
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(textVertex_t), &m_vertices[0].x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(textVertex_t), &m_vertices[0].u);
+    glColorPointer(3, GL_FLOAT, sizeof(textVertex_t), &m_vertices[0].red);
+    glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(m_vertices.size()));
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPopAttrib();
+
+    m_vertices.clear();
+}
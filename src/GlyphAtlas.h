@@ -0,0 +1,116 @@
+/*********************************************************************************/
+/*!
+@file           GlyphAtlas.h
+
+@brief          Draws text from a texture of pre-rendered glyphs.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __GLYPH_ATLAS_H__
+#define __GLYPH_ATLAS_H__
+
+#include <vector>
+
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QString>
+
+#ifdef _WIN32
+  #include <windows.h>
+#endif
+
+#ifdef __APPLE__
+  #include <OpenGL/gl.h>
+#else
+  #include <GL/gl.h>
+#endif
+
+#include "Cfg.h"
+
+#define GLYPH_ATLAS_SIZE    512 // the width and height of the texture
+
+/*!
+ * @brief   Text drawn as textured quads from one texture holding all the glyphs.
+ *
+ * Each glyph is rendered with QPainter the first time it is used. The strings added
+ * with addText() are kept until draw(), which draws them all with a single glDrawArrays.
+ * This replaces drawing each string on its own (with FTGL or a QPainter on the GL widget).
+ * All the calls must be made with the GL context current.
+ */
+class CGlyphAtlas
+{
+public:
+    CGlyphAtlas();
+    ~CGlyphAtlas();
+
+    //! render the glyphs at this many device pixels per unit (the widget's device pixel ratio)
+    void setPixelRatio(qreal ratio);
+    //! returns the font id to use with addText()
+    int addFont(const QFont &font);
+    float textWidth(int fontId, const QString &text);
+    //! how far the font goes below the base line
+    float descent(int fontId);
+
+    //! y is the base line, when centred x is the middle of the text
+    void addText(int fontId, float x, float y, CColor color, const QString &text, bool centred = false);
+    //! draw all the text added since the last draw
+    void draw();
+
+private:
+    typedef struct
+    {
+        GLfloat x, y;
+        GLfloat u, v;
+        GLfloat red, green, blue;
+    } textVertex_t;
+
+    typedef struct
+    {
+        float u0, v0, u1, v1;   // in the texture
+        float left, bottom;     // from the pen position on the base line
+        float width, height;
+        float advance;
+    } glyph_t;
+
+    const glyph_t* findGlyph(int fontId, QChar ch);
+    void clearGlyphs();
+    void updateTexture();
+
+    std::vector<QFont> m_fonts;         // as given
+    std::vector<QFont> m_scaledFonts;   // scaled by the pixel ratio for rendering the glyphs
+    QHash<quint32, glyph_t> m_glyphs;   // the key is the font id and the character
+    QImage m_image;
+    bool m_imageChanged;
+    GLuint m_textureId;
+    qreal m_pixelRatio;
+
+    // the glyphs are packed into rows (or shelves)
+    int m_shelfX;
+    int m_shelfY;
+    int m_shelfHeight;
+
+    std::vector<textVertex_t> m_vertices; // four for each glyph waiting to be drawn
+};
+
+#endif //__GLYPH_ATLAS_H__
@@ -31,6 +31,7 @@
 
 #if WITH_INTERNAL_FLUIDSYNTH
 #include "MidiDeviceFluidSynth.h"
+#include "AudioTuner.h"
 #endif
 
 GuiMidiSetupDialog::GuiMidiSetupDialog(QWidget *parent)
@@ -62,11 +63,16 @@ void GuiMidiSetupDialog::init(CSong* song, CSettings* settings)
 
     refreshMidiInputCombo();
     refreshMidiOutputCombo();
+    dinLinkCheck->setChecked(m_settings->value("Midi/DinLink", false).toBool());
 #if WITH_INTERNAL_FLUIDSYNTH
     masterGainSpin->setValue(FLUID_DEFAULT_GAIN);
 #endif
     reverbCheck->setChecked(false);
     chorusCheck->setChecked(false);
+    dynamicSampleCheck->setChecked(true);
+#if !WITH_INTERNAL_FLUIDSYNTH || !FLUID_MAPPED_SOUNDFONT
+    dynamicSampleCheck->hide(); // the older FluidSynth always loads all the samples
+#endif
 
     sampleRateCombo->addItems({"22050", "44100","48000", "88200","96000"});
     sampleRateCombo->setValidator(new QIntValidator(22050, 96000, this));
@@ -88,11 +94,15 @@ void GuiMidiSetupDialog::init(CSong* song, CSettings* settings)
 #elif defined (Q_OS_UNIX)
     audioDriverCombo->addItems({"pulseaudio"});
 #endif
+#if USE_JACK && !defined (Q_OS_WINDOWS)
+    audioDriverCombo->addItem("jack");
+#endif
 
     if (m_settings->getFluidSoundFontNames().size()>0){
         masterGainSpin->setValue(m_settings->value("FluidSynth/masterGainSpin","40").toInt());
         reverbCheck->setChecked(m_settings->value("FluidSynth/reverbCheck","false").toBool());
         chorusCheck->setChecked(m_settings->value("FluidSynth/chorusCheck","false").toBool());
+        dynamicSampleCheck->setChecked(m_settings->value("FluidSynth/dynamicSampleLoading",true).toBool());
         setComboFromSetting(audioDriverCombo, "FluidSynth/audioDriverCombo","pulseaudio");
         setComboFromSetting(sampleRateCombo, "FluidSynth/sampleRateCombo","22050");
         setComboFromSetting(bufferSizeCombo, "FluidSynth/bufferSizeCombo","128");
@@ -172,25 +182,126 @@ void GuiMidiSetupDialog::on_midiInputCombo_activated (int index)
 void GuiMidiSetupDialog::on_midiOutputCombo_activated (int index)
 {
     Q_UNUSED(index)
+    // each output has its own latency
+    const int latencyFix = m_settings->getLatencyFix(getOutputPortName());
+    if (latencyFix != m_latencyFix)
+    {
+        m_latencyFix = latencyFix;
+        m_latencyChanged = true;
+    }
     updateMidiInfoText();
 }
 
+QString GuiMidiSetupDialog::getOutputPortName()
+{
+    if (midiOutputCombo->currentIndex() == 0)
+        return QString();
+    return midiOutputCombo->currentText();
+}
+
 void GuiMidiSetupDialog::on_latencyFixButton_clicked ( bool checked )
 {
     Q_UNUSED(checked)
-    bool ok;
-    int latencyFix = QInputDialog::getInt(this, tr("Enter a value for the latency fix in milliseconds"),
-            tr(
+
+    QMessageBox msgBox(this);
+    msgBox.setWindowTitle(tr("Latency Fix"));
+    msgBox.setText(tr(
             "The latency fix works by running the music ahead of what you<br>"
             "are playing to counteract the delay within the sound generator.<br><br>"
-            "You will need a piano <b>with speakers</b> that are <b>turned up</b>.<br><br>"
-            "Enter the time in milliseconds for the delay (1000 mSec = 1 sec)<br>"
-            "(For the Microsoft GS Wavetable SW Synth try a value of 150)<br>"
-            "If you are not sure enter a value of zero."),
-                                      m_latencyFix, 0, 1000, 50, &ok);
-    if (ok)
+            "The delay can be measured by connecting the MIDI output straight<br>"
+            "back to the MIDI input with a cable, or by playing along with the clicks.<br>"
+            "To play along you will need a piano <b>with speakers</b> that are <b>turned up</b>."));
+    QPushButton *loopbackButton = msgBox.addButton(tr("Loopback Cable"), QMessageBox::ActionRole);
+    QPushButton *tapAlongButton = msgBox.addButton(tr("Play Along"), QMessageBox::ActionRole);
+    QPushButton *manualButton = msgBox.addButton(tr("Enter a Value"), QMessageBox::ActionRole);
+    msgBox.addButton(QMessageBox::Cancel);
+    msgBox.exec();
+
+    if (msgBox.clickedButton() == loopbackButton)
+        calibrateLatency(CALIBRATE_loopback);
+    else if (msgBox.clickedButton() == tapAlongButton)
+        calibrateLatency(CALIBRATE_tapAlong);
+    else if (msgBox.clickedButton() == manualButton)
     {
-        m_latencyFix = latencyFix;
+        bool ok;
+        int latencyFix = QInputDialog::getInt(this, tr("Enter a value for the latency fix in milliseconds"),
+                tr(
+                "Enter the time in milliseconds for the delay (1000 mSec = 1 sec)<br>"
+                "(For the Microsoft GS Wavetable SW Synth try a value of 150)<br>"
+                "If you are not sure enter a value of zero."),
+                                          m_latencyFix, 0, 1000, 50, &ok);
+        if (ok)
+        {
+            m_latencyFix = latencyFix;
+            m_latencyChanged = true;
+            updateMidiInfoText();
+        }
+    }
+}
+
+// Go back to the ports in the settings, which are the ones in use until the dialog is accepted
+void GuiMidiSetupDialog::reopenSavedMidiPorts()
+{
+    m_song->openMidiPort(CMidiDevice::MIDI_INPUT, m_settings->value("Midi/Input").toString());
+    m_song->openMidiPort(CMidiDevice::MIDI_OUTPUT, m_settings->value("Midi/Output").toString());
+}
+
+void GuiMidiSetupDialog::calibrateLatency(calibrationMode_t mode)
+{
+    if (midiInputCombo->currentIndex() == 0 || getOutputPortName().isEmpty())
+    {
+        QMessageBox::warning(this, tr("Latency Fix"), tr("Choose a MIDI Input Device and a MIDI Output Device first."));
+        return;
+    }
+
+    // measure the ports that are selected in this dialog
+    m_song->openMidiPort(CMidiDevice::MIDI_INPUT, midiInputCombo->currentText());
+    m_song->openMidiPort(CMidiDevice::MIDI_OUTPUT, getOutputPortName());
+    m_song->flushMidiInput();
+
+    QProgressDialog progress((mode == CALIBRATE_loopback) ? tr("Measuring the latency ...")
+                                    : tr("Play any note in time with the clicks ..."),
+                             tr("Cancel"), 0, 100, this);
+    progress.setWindowTitle(tr("Latency Fix"));
+    progress.setMinimumDuration(0);
+
+    // The main timer is stopped while this dialog is open so drive the test from here
+    CLatencyCalibration* calibration = m_song->getLatencyCalibration();
+    QTimer timer;
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, &progress, [&]() {
+        m_song->latencyCalibrationTask();
+        progress.setValue(calibration->progress()); // closes the progress dialog when finished
+    });
+    m_song->startLatencyCalibration(mode);
+    timer.start(1);
+    progress.exec();
+    timer.stop();
+    const bool finished = calibration->isFinished();
+    m_song->stopLatencyCalibration();
+    reopenSavedMidiPorts(); // the ports chosen here are only used once the dialog is accepted
+
+    if (!finished)
+        return;
+
+    int latency;
+    int jitter;
+    if (!calibration->getResult(&latency, &jitter))
+    {
+        QMessageBox::warning(this, tr("Latency Fix"),
+                tr("Not enough of the clicks came back to measure the latency (%1 missed or out of time).")
+                .arg(calibration->getRejectedClicks()));
+        return;
+    }
+
+    // a loopback cable only measures the MIDI path, playing along also includes the sound generator
+    int ret = QMessageBox::question(this, tr("Latency Fix"),
+                tr("The measured latency is %1 mSec with a jitter of %2 mSec (%3 clicks ignored).<br><br>"
+                   "Use this for the latency fix?").arg(latency).arg(jitter).arg(calibration->getRejectedClicks()),
+                QMessageBox::Yes | QMessageBox::No);
+    if (ret == QMessageBox::Yes)
+    {
+        m_latencyFix = latency;
         m_latencyChanged = true;
         updateMidiInfoText();
     }
@@ -207,6 +318,7 @@ void GuiMidiSetupDialog::accept()
         m_settings->setValue("FluidSynth/bufferCountCombo", bufferCountCombo->currentText());
         m_settings->setValue("FluidSynth/reverbCheck",reverbCheck->isChecked());
         m_settings->setValue("FluidSynth/chorusCheck",chorusCheck->isChecked());
+        m_settings->setValue("FluidSynth/dynamicSampleLoading",dynamicSampleCheck->isChecked());
         m_settings->setValue("FluidSynth/audioDriverCombo",audioDriverCombo->currentText());
         m_settings->setValue("FluidSynth/sampleRateCombo",sampleRateCombo->currentText());
     }
@@ -221,6 +333,7 @@ void GuiMidiSetupDialog::accept()
         CChord::setPianoRange(m_settings->value("Keyboard/LowestNote", 0).toInt(),
                           m_settings->value("Keyboard/HighestNote", 127).toInt());
 
+    m_settings->setValue("Midi/DinLink", dinLinkCheck->isChecked());
     if (midiOutputCombo->currentIndex()==0){
         m_settings->setValue("Midi/Output", "");
         m_song->openMidiPort(CMidiDevice::MIDI_OUTPUT,"");
@@ -230,7 +343,7 @@ void GuiMidiSetupDialog::accept()
     }
     m_settings->updateWarningMessages();
 
-    m_settings->setValue("Midi/Latency", m_latencyFix);
+    m_settings->setLatencyFix(getOutputPortName(), m_latencyFix);
     m_song->setLatencyFix(m_latencyFix);
     m_song->regenerateChordQueue();
     if (m_latencyChanged)
@@ -334,3 +447,61 @@ void GuiMidiSetupDialog::on_fluidClearButton_clicked( bool checked ){
     updateFluidInfoStatus();
 #endif
 }
+
+void GuiMidiSetupDialog::on_fluidTuneButton_clicked( bool checked ){
+    Q_UNUSED(checked)
+#if WITH_INTERNAL_FLUIDSYNTH
+    const QStringList fontList = m_settings->getFluidSoundFontNames();
+    if (fontList.isEmpty())
+        return;
+
+    // the internal sound has to let go of the sound card for the test (an exclusive driver only opens once)
+    const QString outputName = m_settings->value("Midi/Output").toString();
+    m_song->openMidiPort(CMidiDevice::MIDI_OUTPUT, "");
+    auto restoreOutput = [&]() { m_song->openMidiPort(CMidiDevice::MIDI_OUTPUT, outputName); };
+
+    CAudioTuner tuner;
+    if (!tuner.start(fontList.at(0), audioDriverCombo->currentText(), sampleRateCombo->currentText().toInt(),
+                     bufferCountCombo->currentText().toInt()))
+    {
+        restoreOutput();
+        QMessageBox::warning(this, tr("Tune Buffers"), tr("Cannot start the sound with these settings."));
+        return;
+    }
+
+    QProgressDialog progress(tr("Testing the audio buffer sizes ..."), tr("Cancel"), 0, 100, this);
+    progress.setWindowTitle(tr("Tune Buffers"));
+    progress.setMinimumDuration(0);
+    QTimer timer;
+    connect(&timer, &QTimer::timeout, &progress, [&]() {
+        tuner.task();
+        progress.setValue(tuner.progress()); // closes the progress dialog when finished
+    });
+    timer.start(50);
+    progress.exec();
+    timer.stop();
+    const bool finished = tuner.isFinished();
+    tuner.stop();
+    restoreOutput();
+
+    if (!finished)
+        return;
+
+    int bufferSize;
+    int latency;
+    if (!tuner.getResult(&bufferSize, &latency))
+    {
+        QMessageBox::warning(this, tr("Tune Buffers"),
+                tr("The sound glitched with every buffer size, try a lower sample rate or more buffers.<br><br>%1")
+                .arg(tuner.getReport().toHtmlEscaped().replace("\n", "<br>")));
+        return;
+    }
+
+    int ret = QMessageBox::question(this, tr("Tune Buffers"),
+                tr("The smallest buffer size that played without any glitches is %1 (%2 mSec of latency).<br><br>%3<br>"
+                   "Use this buffer size?").arg(bufferSize).arg(latency).arg(tuner.getReport().toHtmlEscaped().replace("\n", "<br>")),
+                QMessageBox::Yes | QMessageBox::No);
+    if (ret == QMessageBox::Yes)
+        bufferSizeCombo->setCurrentText(QString::number(bufferSize));
+#endif
+}
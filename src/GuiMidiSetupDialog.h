@@ -52,6 +52,7 @@ private slots:
     void on_latencyFixButton_clicked ( bool checked );
     void on_fluidLoadButton_clicked ( bool checked );
     void on_fluidClearButton_clicked ( bool checked );
+    void on_fluidTuneButton_clicked ( bool checked );
 
 private:
     void setComboFromSetting(QComboBox *combo, const QString &key, const QVariant &defaultValue = QVariant());
@@ -59,6 +60,9 @@ private:
     void refreshMidiInputCombo();
     void refreshMidiOutputCombo();
     void updateFluidInfoStatus();
+    void calibrateLatency(calibrationMode_t mode);
+    void reopenSavedMidiPorts();
+    QString getOutputPortName();
     CSettings* m_settings;
     CSong* m_song;
     int m_latencyFix;
@@ -0,0 +1,223 @@
+/*********************************************************************************/
+/*!
+@file           LatencyCalibration.cpp
+
+@brief          Measures the delay between sending a note and hearing it.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "LatencyCalibration.h"
+#include "MidiDevice.h"
+
+#define CLICK_INTERVAL_LOOPBACK 250000  // usec between the clicks
+#define CLICK_INTERVAL_TAP      600000
+#define CLICK_LENGTH            100000  // usec the click note is held down for
+#define CLICK_NOTE              76      // Hi Wood Block
+#define CLICK_VELOCITY          100
+#define TAP_ALONG_COUNT_IN      4       // the pianist needs a few clicks to get into time
+#define MIN_GOOD_CLICKS         8
+#define OUTLIER_LIMIT           3.0     // how many (robust) standard deviations away is an outlier
+
+CLatencyCalibration::CLatencyCalibration()
+{
+    m_mode = CALIBRATE_loopback;
+    m_active = false;
+    m_finished = false;
+    m_noteOnPending = false;
+    m_clickCount = 0;
+    m_rejected = 0;
+    m_nextClickTime = 0;
+    m_deviceTimeOffset = 0;
+    m_deviceTimeSynced = false;
+    for (int i = 0; i < CALIBRATION_CLICKS; i++)
+    {
+        m_clickTime[i] = 0;
+        m_replyTime[i] = -1;
+    }
+}
+
+static qint64 clickInterval(calibrationMode_t mode)
+{
+    return (mode == CALIBRATE_loopback) ? CLICK_INTERVAL_LOOPBACK : CLICK_INTERVAL_TAP;
+}
+
+void CLatencyCalibration::start(calibrationMode_t mode)
+{
+    m_mode = mode;
+    m_clickCount = 0;
+    m_rejected = 0;
+    for (int i = 0; i < CALIBRATION_CLICKS; i++)
+        m_replyTime[i] = -1;
+    m_deviceTimeOffset = 0;
+    m_deviceTimeSynced = false;
+    m_clock.start();
+    m_nextClickTime = clickInterval(m_mode); // give the pianist a moment to get ready
+    m_noteOnPending = false;
+    m_finished = false;
+    m_active = true;
+}
+
+void CLatencyCalibration::stop()
+{
+    m_active = false;
+}
+
+int CLatencyCalibration::progress()
+{
+    if (m_finished)
+        return 100;
+    return (m_clickCount * 100) / (CALIBRATION_CLICKS + 1);
+}
+
+void CLatencyCalibration::sendClick(CMidiDevice* output, bool noteOn)
+{
+    CMidiEvent event;
+    if (noteOn)
+        event.noteOnEvent(0, MIDI_DRUM_CHANNEL, CLICK_NOTE, CLICK_VELOCITY);
+    else
+        event.noteOffEvent(0, MIDI_DRUM_CHANNEL, CLICK_NOTE, 0);
+    output->playMidiEvent(event);
+}
+
+void CLatencyCalibration::task(CMidiDevice* output)
+{
+    if (!m_active || m_finished)
+        return;
+
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+
+    if (m_noteOnPending && now >= m_clickTime[m_clickCount - 1] + CLICK_LENGTH)
+    {
+        sendClick(output, false);
+        m_noteOnPending = false;
+    }
+
+    if (now < m_nextClickTime)
+        return;
+
+    if (m_clickCount >= CALIBRATION_CLICKS)
+    {
+        // the last reply is in (or never will be)
+        m_finished = true;
+        return;
+    }
+
+    sendClick(output, true);
+    m_clickTime[m_clickCount] = m_clock.nsecsElapsed() / 1000;
+    m_clickCount++;
+    m_noteOnPending = true;
+    m_nextClickTime += clickInterval(m_mode);
+}
+
+void CLatencyCalibration::midiInput(const CMidiEvent &event, qint64 deviceTime)
+{
+    if (!m_active || event.type() != MIDI_NOTE_ON || event.velocity() == 0)
+        return;
+    if (m_mode == CALIBRATE_loopback && event.note() != CLICK_NOTE)
+        return;
+
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    qint64 time = now;
+    if (deviceTime >= 0)
+    {
+        // The reads are late by a varying amount (up to a whole engine tick)
+        // so the smallest offset is the closest to the real one
+        if (!m_deviceTimeSynced || now - deviceTime < m_deviceTimeOffset)
+        {
+            m_deviceTimeOffset = now - deviceTime;
+            m_deviceTimeSynced = true;
+        }
+        time = deviceTime + m_deviceTimeOffset;
+    }
+
+    // find the click this note belongs to
+    const qint64 window = clickInterval(m_mode) / 2;
+    for (int i = 0; i < m_clickCount; i++)
+    {
+        const qint64 delta = time - m_clickTime[i];
+        const bool inWindow = (m_mode == CALIBRATE_loopback) ? (delta >= 0 && delta < 2 * window)
+                                                              : (delta > -window && delta <= window);
+        if (inWindow)
+        {
+            if (m_replyTime[i] < 0) // only the first note counts (it might be a chord)
+                m_replyTime[i] = time;
+            return;
+        }
+    }
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    const size_t middle = values.size() / 2;
+    if (values.size() % 2 == 0)
+        return (values[middle - 1] + values[middle]) / 2.0;
+    return values[middle];
+}
+
+bool CLatencyCalibration::getResult(int* latency, int* jitter)
+{
+    std::vector<double> delays;
+    const int firstClick = (m_mode == CALIBRATE_tapAlong) ? TAP_ALONG_COUNT_IN : 0;
+    for (int i = firstClick; i < m_clickCount; i++)
+    {
+        if (m_replyTime[i] >= 0)
+            delays.push_back(static_cast<double>(m_replyTime[i] - m_clickTime[i]) / 1000.0);
+    }
+    m_rejected = (m_clickCount - firstClick) - static_cast<int>(delays.size());
+    if (delays.size() < MIN_GOOD_CLICKS)
+        return false;
+
+    // Use the median absolute deviation so a few bad clicks cannot drag the limits out
+    const double middle = median(delays);
+    std::vector<double> deviations;
+    for (double delay : delays)
+        deviations.push_back(std::fabs(delay - middle));
+    const double limit = std::max(OUTLIER_LIMIT * 1.4826 * median(deviations), 2.0);
+
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    int count = 0;
+    for (double delay : delays)
+    {
+        if (std::fabs(delay - middle) > limit)
+        {
+            m_rejected++;
+            continue;
+        }
+        sum += delay;
+        sumSquares += delay * delay;
+        count++;
+    }
+    if (count < MIN_GOOD_CLICKS)
+        return false;
+
+    const double mean = sum / count;
+    *latency = static_cast<int>(std::lround(std::max(mean, 0.0)));
+    *jitter = static_cast<int>(std::lround(std::sqrt(std::max(sumSquares / count - mean * mean, 0.0))));
+    return true;
+}
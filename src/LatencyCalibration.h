@@ -0,0 +1,93 @@
+/*********************************************************************************/
+/*!
+@file           LatencyCalibration.h
+
+@brief          Measures the delay between sending a note and hearing it.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __LATENCY_CALIBRATION_H__
+#define __LATENCY_CALIBRATION_H__
+
+#include <QElapsedTimer>
+
+#include "MidiEvent.h"
+
+class CMidiDevice;
+
+#define CALIBRATION_CLICKS      24
+
+typedef enum
+{
+    CALIBRATE_loopback, // the MIDI output is connected straight back to the MIDI input
+    CALIBRATE_tapAlong  // the pianist plays along with the clicks they hear
+} calibrationMode_t;
+
+/*!
+ * @brief   Measures the round trip latency and the jitter of the MIDI output.
+ *
+ * A steady click is sent to the MIDI output and each click is matched with the note
+ * that comes back on the MIDI input. Clicks that are too far away from the others
+ * (a missed beat or a stray note) are thrown out before the average is taken.
+ * The conductor drives it from the real time engine while it is active.
+ */
+class CLatencyCalibration
+{
+public:
+    CLatencyCalibration();
+
+    void start(calibrationMode_t mode);
+    void stop();
+    bool isActive() {return m_active;}
+    //! all the clicks have been sent and all the replies are in
+    bool isFinished() {return m_finished;}
+    //! the percentage of the test done
+    int progress();
+
+    //! called by the real time engine to send the next click
+    void task(CMidiDevice* output);
+    //! deviceTime is in usec from the MIDI input device (-1 if not known)
+    void midiInput(const CMidiEvent &event, qint64 deviceTime);
+
+    //! returns false if there were not enough good clicks, the values are in msec
+    bool getResult(int* latency, int* jitter);
+    int getRejectedClicks() {return m_rejected;}
+
+private:
+    void sendClick(CMidiDevice* output, bool noteOn);
+
+    calibrationMode_t m_mode;
+    bool m_active;
+    bool m_finished;
+    bool m_noteOnPending;
+    int m_clickCount;
+    int m_rejected;
+    QElapsedTimer m_clock;
+    qint64 m_nextClickTime;
+    qint64 m_deviceTimeOffset; // maps the MIDI input device clock onto m_clock
+    bool m_deviceTimeSynced;   // the offset can be negative so it needs its own flag
+    qint64 m_clickTime[CALIBRATION_CLICKS];  // usec when the click was sent
+    qint64 m_replyTime[CALIBRATION_CLICKS];  // usec when the click came back (-1 if it did not)
+};
+
+#endif //__LATENCY_CALIBRATION_H__
@@ -28,19 +28,35 @@
 
 #include "MidiDevice.h"
 #include "MidiDeviceRt.h"
+#if USE_ALSA_SEQ
+    #include "MidiDeviceAlsa.h"
+#endif
+#include "Trace.h"
 #if WITH_INTERNAL_FLUIDSYNTH
     #include "MidiDeviceFluidSynth.h"
 #endif
+#if USE_JACK
+    #include "MidiDeviceJack.h"
+#endif
 
 CMidiDevice::CMidiDevice()
 {
+#if USE_ALSA_SEQ
+    m_rtMidiDevice = new CMidiDeviceAlsa(); // takes the place of RtMidi for the external ports
+#else
     m_rtMidiDevice = new CMidiDeviceRt();
+#endif
 #if WITH_INTERNAL_FLUIDSYNTH
     m_fluidSynthMidiDevice = new CMidiDeviceFluidSynth();
+#endif
+#if USE_JACK
+    m_jackMidiDevice = new CMidiDeviceJack();
 #endif
     m_selectedMidiInputDevice = m_rtMidiDevice;
     m_selectedMidiOutputDevice = m_rtMidiDevice;
     m_validOutput = false;
+    m_playedEventCount = 0;
+    m_batchDepth = 0;
 }
 
 CMidiDevice::~CMidiDevice()
@@ -49,10 +65,14 @@ CMidiDevice::~CMidiDevice()
 #if WITH_INTERNAL_FLUIDSYNTH
     delete m_fluidSynthMidiDevice;
 #endif
+#if USE_JACK
+    delete m_jackMidiDevice;
+#endif
 }
 
 void CMidiDevice::init()
 {
+    m_rtMidiDevice->setQSettings(qsettings);
 #if WITH_INTERNAL_FLUIDSYNTH
     m_fluidSynthMidiDevice->setQSettings(qsettings);
 #endif
@@ -66,6 +86,9 @@ QStringList CMidiDevice::getMidiPortList(midiType_t type)
     list <<  m_fluidSynthMidiDevice->getMidiPortList(type);
 #endif
     list <<  m_rtMidiDevice->getMidiPortList(type);
+#if USE_JACK
+    list <<  m_jackMidiDevice->getMidiPortList(type);
+#endif
 
     return list;
 }
@@ -81,6 +104,13 @@ bool CMidiDevice::openMidiPort(midiType_t type, const QString &portName)
             m_selectedMidiOutputDevice = m_rtMidiDevice;
             return true;
         }
+#if USE_JACK
+        if (m_jackMidiDevice->openMidiPort(type, portName))
+        {
+            m_selectedMidiInputDevice = m_jackMidiDevice;
+            return true;
+        }
+#endif
     }
     else
     {
@@ -93,6 +123,14 @@ bool CMidiDevice::openMidiPort(midiType_t type, const QString &portName)
             m_validOutput = true;
             return true;
         }
+#if USE_JACK
+        if ( m_jackMidiDevice->openMidiPort(type, portName) )
+        {
+            m_selectedMidiOutputDevice = m_jackMidiDevice;
+            m_validOutput = true;
+            return true;
+        }
+#endif
 #if WITH_INTERNAL_FLUIDSYNTH
         if ( m_fluidSynthMidiDevice->openMidiPort(type, portName) )
         {
@@ -107,26 +145,76 @@ bool CMidiDevice::openMidiPort(midiType_t type, const QString &portName)
 
 void CMidiDevice::closeMidiPort(midiType_t type, int index)
 {
+#if USE_JACK
+    if (type == MIDI_INPUT && m_selectedMidiInputDevice == m_jackMidiDevice)
+    {
+        m_jackMidiDevice->closeMidiPort(type, index);
+        m_selectedMidiInputDevice = m_rtMidiDevice;
+    }
+#endif
     if (m_selectedMidiOutputDevice == nullptr)
         return;
 
+    if (m_batchDepth > 0)
+        m_selectedMidiOutputDevice->flushMidiOutput(); // the rest of the batch goes straight out
     m_selectedMidiOutputDevice->closeMidiPort(type, index);
     m_selectedMidiOutputDevice = nullptr;
 }
 
+int CMidiDevice::loadProgress()
+{
+    if (m_selectedMidiOutputDevice == nullptr)
+        return -1;
+    return m_selectedMidiOutputDevice->loadProgress();
+}
+
+qint64 CMidiDevice::mSecToPendingOutput()
+{
+    if (m_selectedMidiOutputDevice == nullptr)
+        return -1;
+    return m_selectedMidiOutputDevice->mSecToPendingOutput();
+}
+
 //! add a midi event to be played immediately
 void CMidiDevice::playMidiEvent(const CMidiEvent & event)
 {
+    TRACE_SPAN("playMidiEvent");
     if (m_selectedMidiOutputDevice == nullptr)
         return;
 
     m_selectedMidiOutputDevice->playMidiEvent(event);
+    m_playedEventCount++;
     //event.printDetails(); // useful for debugging
 }
 
+void CMidiDevice::startMidiBatch()
+{
+    if (m_batchDepth++ == 0 && m_selectedMidiOutputDevice != nullptr)
+        m_selectedMidiOutputDevice->holdMidiOutput();
+}
+
+void CMidiDevice::flushMidiBatch()
+{
+    if (--m_batchDepth == 0 && m_selectedMidiOutputDevice != nullptr)
+        m_selectedMidiOutputDevice->flushMidiOutput();
+}
+
+void CMidiDevice::setOutputPriority(midiPriority_t priority)
+{
+    if (m_selectedMidiOutputDevice != nullptr)
+        m_selectedMidiOutputDevice->setOutputPriority(priority);
+}
+
+void CMidiDevice::setEventLateness(qint64 usec)
+{
+    if (m_selectedMidiOutputDevice != nullptr)
+        m_selectedMidiOutputDevice->setEventLateness(usec);
+}
+
 // Return the number of events waiting to be read from the midi device
 int CMidiDevice::checkMidiInput()
 {
+    TRACE_SPAN("checkMidiInput");
     if (m_selectedMidiInputDevice == nullptr)
         return 0;
 
@@ -136,9 +224,46 @@ int CMidiDevice::checkMidiInput()
 // reads the real midi event
 CMidiEvent CMidiDevice::readMidiInput()
 {
+    TRACE_SPAN("readMidiInput");
     return m_selectedMidiInputDevice->readMidiInput();
 }
 
+qint64 CMidiDevice::midiInputTimeStamp()
+{
+    if (m_selectedMidiInputDevice == nullptr)
+        return -1;
+
+    return m_selectedMidiInputDevice->midiInputTimeStamp();
+}
+
+void CMidiDevice::setInputNotify(const std::function<void()> &notify)
+{
+    CMidiDeviceBase::setInputNotify(notify);
+    m_rtMidiDevice->setInputNotify(notify);
+#if USE_JACK
+    m_jackMidiDevice->setInputNotify(notify);
+#endif
+}
+
+void CMidiDevice::setReplayDevice(CMidiDeviceBase* device)
+{
+    if (m_batchDepth > 0 && m_selectedMidiOutputDevice != nullptr)
+        m_selectedMidiOutputDevice->flushMidiOutput();
+    if (device != nullptr)
+    {
+        m_selectedMidiInputDevice = device;
+        m_selectedMidiOutputDevice = device;
+        m_validOutput = true;
+    }
+    else
+    {
+        // reconnectMidi() will then open the real devices again
+        m_selectedMidiInputDevice = m_rtMidiDevice;
+        m_selectedMidiOutputDevice = m_rtMidiDevice;
+        m_validOutput = false;
+    }
+}
+
 bool CMidiDevice::validMidiOutput()
 {
     if (m_validOutput) {
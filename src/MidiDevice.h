@@ -49,12 +49,15 @@ public:
     void playMidiEvent(const CMidiEvent & event);
     int checkMidiInput();
     CMidiEvent readMidiInput();
+    qint64 midiInputTimeStamp();
     bool validMidiOutput();
     virtual bool validMidiConnection() {return validMidiOutput();}
 
     QStringList getMidiPortList(midiType_t type);
     bool openMidiPort(midiType_t type, const QString &portName);
     void closeMidiPort(midiType_t type, int index);
+    int loadProgress();
+    qint64 mSecToPendingOutput();
     // based on the fluid synth settings
     virtual int     midiSettingsSetStr(const QString &name, const QString &str);
     virtual int     midiSettingsSetNum(const QString &name, double val);
@@ -63,6 +66,20 @@ public:
     virtual double  midiSettingsGetNum(const QString &name);
     virtual int     midiSettingsGetInt(const QString &name);
 
+    void setInputNotify(const std::function<void()> &notify);
+    void setEventLateness(qint64 usec);
+    void setOutputPriority(midiPriority_t priority);
+
+    //! the output is held back until the outer flushMidiBatch() (see CMidiBatch)
+    void startMidiBatch();
+    void flushMidiBatch();
+
+    //! send all the MIDI input and output through this device (nullptr goes back to the normal devices)
+    void setReplayDevice(CMidiDeviceBase* device);
+
+    //! the number of MIDI events sent to the output so far
+    qint64 getPlayedEventCount() {return m_playedEventCount;}
+
     void flushMidiInput()
     {
         while (checkMidiInput() > 0) {
@@ -72,12 +89,31 @@ public:
 
 private:
     CMidiDeviceBase* m_rtMidiDevice;
+    qint64 m_playedEventCount;
 #if WITH_INTERNAL_FLUIDSYNTH
     CMidiDeviceBase* m_fluidSynthMidiDevice;
+#endif
+#if USE_JACK
+    CMidiDeviceBase* m_jackMidiDevice;
 #endif
     CMidiDeviceBase* m_selectedMidiInputDevice;
     CMidiDeviceBase* m_selectedMidiOutputDevice;
     bool m_validOutput;
+    int m_batchDepth;
+};
+
+// Batches all the MIDI output sent while it is in scope
+class CMidiBatch
+{
+public:
+    explicit CMidiBatch(CMidiDevice* device) : m_device(device) {m_device->startMidiBatch();}
+    ~CMidiBatch() {m_device->flushMidiBatch();}
+
+    CMidiBatch(const CMidiBatch&) = delete;
+    CMidiBatch& operator=(const CMidiBatch&) = delete;
+
+private:
+    CMidiDevice* m_device;
 };
 
 #endif //__MIDI_DEVICE_H__
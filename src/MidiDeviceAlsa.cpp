@@ -0,0 +1,499 @@
+/*********************************************************************************/
+/*!
+@file           MidiDeviceAlsa.cpp
+
+@brief          Plays and records MIDI through the ALSA sequencer with queue scheduled output.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <poll.h>
+
+#include <vector>
+
+#include "MidiDeviceAlsa.h"
+
+CMidiDeviceAlsa::CMidiDeviceAlsa() : m_inputEvents(ALSA_INPUT_QUEUE_SIZE)
+{
+    m_outputSeq = nullptr;
+    m_inputSeq = nullptr;
+    m_outputClient = -1;
+    m_inputClient = -1;
+    m_outputPort = -1;
+    m_inputPort = -1;
+    m_outputQueue = -1;
+    m_inputQueue = -1;
+    m_rawEncoder = nullptr;
+    m_outputDest = {0, 0};
+    m_inputSource = {0, 0};
+    m_portsChanged = false;
+    m_holdOutput = false;
+    m_outputPriority = MIDI_PRIORITY_normal;
+    m_eventLateness = 0;
+    m_rawDataIndex = 0;
+    m_stopInput = false;
+    m_inputTimeStamp = -1;
+    m_validConnection = false;
+    init();
+}
+
+CMidiDeviceAlsa::~CMidiDeviceAlsa()
+{
+    close();
+}
+
+void CMidiDeviceAlsa::init()
+{
+    if (m_outputSeq != nullptr && m_inputSeq != nullptr)
+        return;
+    close();
+
+    // The output and the input each get their own client as a sequencer handle is not thread safe
+    if (snd_seq_open(&m_outputSeq, "default", SND_SEQ_OPEN_OUTPUT, SND_SEQ_NONBLOCK) < 0)
+    {
+        ppLogError("Cannot open the ALSA sequencer");
+        m_outputSeq = nullptr;
+        return;
+    }
+    if (snd_seq_open(&m_inputSeq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK) < 0)
+    {
+        ppLogError("Cannot open the ALSA sequencer");
+        m_inputSeq = nullptr;
+        close();
+        return;
+    }
+    snd_seq_set_client_name(m_outputSeq, "PianoBooster");
+    snd_seq_set_client_name(m_inputSeq, "PianoBooster Input");
+    m_outputClient = snd_seq_client_id(m_outputSeq);
+    m_inputClient = snd_seq_client_id(m_inputSeq);
+
+    const unsigned int portType = SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION;
+    m_outputPort = snd_seq_create_simple_port(m_outputSeq, "Output",
+                        SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ, portType);
+    m_outputQueue = snd_seq_alloc_named_queue(m_outputSeq, "PianoBooster Output");
+    m_inputQueue = snd_seq_alloc_named_queue(m_inputSeq, "PianoBooster Input");
+    if (m_outputPort < 0 || m_outputQueue < 0 || m_inputQueue < 0 ||
+        snd_midi_event_new(ALSA_OUTPUT_MAX_BYTES, &m_rawEncoder) < 0)
+    {
+        ppLogError("Cannot set up the ALSA sequencer");
+        m_rawEncoder = nullptr;
+        close();
+        return;
+    }
+
+    // the kernel stamps the input with the real time on the input queue as it arrives
+    snd_seq_port_info_t* portInfo;
+    snd_seq_port_info_alloca(&portInfo);
+    snd_seq_port_info_set_name(portInfo, "Input");
+    snd_seq_port_info_set_capability(portInfo, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+    snd_seq_port_info_set_type(portInfo, portType);
+    snd_seq_port_info_set_timestamping(portInfo, 1);
+    snd_seq_port_info_set_timestamp_real(portInfo, 1);
+    snd_seq_port_info_set_timestamp_queue(portInfo, m_inputQueue);
+    if (snd_seq_create_port(m_inputSeq, portInfo) < 0)
+    {
+        ppLogError("Cannot create the ALSA sequencer input port");
+        close();
+        return;
+    }
+    m_inputPort = snd_seq_port_info_get_port(portInfo);
+
+    // the system announcements tell us when a port comes and goes
+    if (snd_seq_connect_from(m_inputSeq, m_inputPort, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE) < 0)
+        ppLogWarn("Cannot subscribe to the ALSA port announcements");
+
+    snd_seq_start_queue(m_outputSeq, m_outputQueue, nullptr);
+    snd_seq_drain_output(m_outputSeq);
+    snd_seq_start_queue(m_inputSeq, m_inputQueue, nullptr);
+    snd_seq_drain_output(m_inputSeq);
+
+    m_stopInput = false;
+    m_inputThread = std::thread(&CMidiDeviceAlsa::inputThread, this);
+}
+
+void CMidiDeviceAlsa::close()
+{
+    if (m_inputThread.joinable())
+    {
+        m_stopInput = true;
+        m_inputThread.join();
+    }
+    if (m_rawEncoder != nullptr)
+        snd_midi_event_free(m_rawEncoder);
+    m_rawEncoder = nullptr;
+    if (m_outputSeq != nullptr)
+    {
+        snd_seq_drain_output(m_outputSeq);
+        snd_seq_close(m_outputSeq); // this also frees the queue and the port
+    }
+    if (m_inputSeq != nullptr)
+        snd_seq_close(m_inputSeq);
+    m_outputSeq = nullptr;
+    m_inputSeq = nullptr;
+    m_outputPortId.clear();
+    m_inputPortId.clear();
+    m_validConnection = false;
+}
+
+bool CMidiDeviceAlsa::ownClient(int client) const
+{
+    return client == m_outputClient || client == m_inputClient;
+}
+
+// Lists the ports in the same order and with the same names that RtMidi uses
+QList<CMidiDeviceAlsa::alsaPort_t> CMidiDeviceAlsa::findPorts(snd_seq_t* seq, midiType_t type)
+{
+    QList<alsaPort_t> ports;
+    const unsigned int caps = (type == MIDI_INPUT) ? SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ
+                                                   : SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE;
+    snd_seq_client_info_t* clientInfo;
+    snd_seq_port_info_t* portInfo;
+    snd_seq_client_info_alloca(&clientInfo);
+    snd_seq_port_info_alloca(&portInfo);
+
+    snd_seq_client_info_set_client(clientInfo, -1);
+    while (snd_seq_query_next_client(seq, clientInfo) >= 0)
+    {
+        const int client = snd_seq_client_info_get_client(clientInfo);
+        if (client == SND_SEQ_CLIENT_SYSTEM || ownClient(client))
+            continue;
+        snd_seq_port_info_set_client(portInfo, client);
+        snd_seq_port_info_set_port(portInfo, -1);
+        while (snd_seq_query_next_port(seq, portInfo) >= 0)
+        {
+            const unsigned int portType = snd_seq_port_info_get_type(portInfo);
+            if ((portType & (SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_SYNTH | SND_SEQ_PORT_TYPE_APPLICATION)) == 0)
+                continue;
+            if ((snd_seq_port_info_get_capability(portInfo) & caps) != caps)
+                continue;
+
+            alsaPort_t port;
+            port.addr = *snd_seq_port_info_get_addr(portInfo);
+            port.name = QString("%1 - %2:%3 %4:%5").arg(static_cast<int>(ports.size()))
+                            .arg(snd_seq_client_info_get_name(clientInfo))
+                            .arg(snd_seq_port_info_get_name(portInfo))
+                            .arg(port.addr.client).arg(port.addr.port);
+            ports.append(port);
+        }
+    }
+    return ports;
+}
+
+// The port name without the index in front or the client and port numbers after it, these change on a hot plug
+QString CMidiDeviceAlsa::portId(const QString &portName)
+{
+    QString name = portName;
+    const int index = name.indexOf(" - ");
+    if (index >= 0)
+        name = name.mid(index + 3);
+    const int numbers = name.lastIndexOf(' ');
+    if (numbers >= 0)
+        name = name.left(numbers);
+    return name;
+}
+
+bool CMidiDeviceAlsa::findPort(snd_seq_t* seq, midiType_t type, const QString &id, snd_seq_addr_t* addr)
+{
+    for (const alsaPort_t &port : findPorts(seq, type))
+    {
+        if (portId(port.name) == id)
+        {
+            *addr = port.addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+QStringList CMidiDeviceAlsa::getMidiPortList(midiType_t type)
+{
+    init();
+    QStringList portNameList;
+    if (m_outputSeq == nullptr)
+        return portNameList;
+
+    for (const alsaPort_t &port : findPorts(m_outputSeq, type))
+        portNameList << port.name;
+    return portNameList;
+}
+
+bool CMidiDeviceAlsa::openMidiPort(midiType_t type, const QString &portName)
+{
+    init();
+    if (m_outputSeq == nullptr || portName.isEmpty())
+        return false;
+
+    const QString id = portId(portName);
+    snd_seq_addr_t addr;
+    if (!findPort(m_outputSeq, type, id, &addr))
+        return false;
+
+    if (type == MIDI_INPUT)
+    {
+        std::lock_guard<std::mutex> lock(m_inputLock);
+        if (!m_inputPortId.isEmpty())
+            snd_seq_disconnect_from(m_inputSeq, m_inputPort, m_inputSource.client, m_inputSource.port);
+        m_inputPortId.clear();
+        if (snd_seq_connect_from(m_inputSeq, m_inputPort, addr.client, addr.port) < 0)
+            return false;
+        m_inputPortId = id;
+        m_inputSource = addr;
+    }
+    else
+    {
+        if (!m_outputPortId.isEmpty())
+            snd_seq_disconnect_to(m_outputSeq, m_outputPort, m_outputDest.client, m_outputDest.port);
+        m_outputPortId.clear();
+        if (snd_seq_connect_to(m_outputSeq, m_outputPort, addr.client, addr.port) < 0)
+            return false;
+        m_outputPortId = id;
+        m_outputDest = addr;
+        m_rawDataIndex = 0;
+    }
+    m_validConnection = true;
+    return true;
+}
+
+void CMidiDeviceAlsa::closeMidiPort(midiType_t type, int index)
+{
+    Q_UNUSED(index)
+    m_validConnection = false;
+    if (m_outputSeq == nullptr)
+        return;
+
+    if (type == MIDI_INPUT)
+    {
+        std::lock_guard<std::mutex> lock(m_inputLock);
+        if (!m_inputPortId.isEmpty())
+            snd_seq_disconnect_from(m_inputSeq, m_inputPort, m_inputSource.client, m_inputSource.port);
+        m_inputPortId.clear();
+    }
+    else
+    {
+        m_holdOutput = false;
+        // let the queue play out (eg the all notes off) before the port goes
+        snd_seq_drain_output(m_outputSeq);
+        snd_seq_sync_output_queue(m_outputSeq);
+        if (!m_outputPortId.isEmpty())
+            snd_seq_disconnect_to(m_outputSeq, m_outputPort, m_outputDest.client, m_outputDest.port);
+        m_outputPortId.clear();
+    }
+}
+
+// A port has come back after a hot plug, this is a no-op if it is still connected
+void CMidiDeviceAlsa::reconnectOutput()
+{
+    snd_seq_addr_t addr;
+    if (m_outputPortId.isEmpty() || !findPort(m_outputSeq, MIDI_OUTPUT, m_outputPortId, &addr))
+        return;
+    if (snd_seq_connect_to(m_outputSeq, m_outputPort, addr.client, addr.port) >= 0)
+        ppLogInfo("Reconnected the MIDI output \"%s\"", qPrintable(m_outputPortId));
+    m_outputDest = addr;
+}
+
+//! add a midi event to be played immediately
+void CMidiDeviceAlsa::playMidiEvent(const CMidiEvent & event)
+{
+    if (m_outputPortId.isEmpty())
+        return;
+
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    const int channel = event.channel() & 0x0f;
+
+    switch(event.type())
+    {
+        case MIDI_NOTE_OFF:
+            snd_seq_ev_set_noteoff(&ev, channel, event.note(), event.velocity());
+            break;
+        case MIDI_NOTE_ON:
+            snd_seq_ev_set_noteon(&ev, channel, event.note(), event.velocity());
+            break;
+        case MIDI_NOTE_PRESSURE:
+            snd_seq_ev_set_keypress(&ev, channel, event.data1(), event.data2());
+            break;
+        case MIDI_CONTROL_CHANGE:
+            snd_seq_ev_set_controller(&ev, channel, event.data1(), event.data2());
+            break;
+        case MIDI_PROGRAM_CHANGE:
+            snd_seq_ev_set_pgmchange(&ev, channel, event.programme());
+            break;
+        case MIDI_CHANNEL_PRESSURE:
+            snd_seq_ev_set_chanpress(&ev, channel, event.data1());
+            break;
+        case MIDI_PITCH_BEND:
+            snd_seq_ev_set_pitchbend(&ev, channel, ((event.data2() << 7) | event.data1()) - 0x2000);
+            break;
+
+        case MIDI_PB_collateRawMidiData: //used for a SYSTEM_EVENT
+            if (m_rawDataIndex < arraySizeAs<unsigned int>(m_savedRawBytes))
+                m_savedRawBytes[m_rawDataIndex++] = static_cast<unsigned char>(event.data1());
+            return; // Don't output any thing yet so just return
+
+        case MIDI_PB_outputRawMidiData: //used for a SYSTEM_EVENT
+            snd_midi_event_reset_encode(m_rawEncoder);
+            snd_midi_event_encode(m_rawEncoder, m_savedRawBytes, m_rawDataIndex, &ev);
+            m_rawDataIndex = 0;
+            if (ev.type == SND_SEQ_EVENT_NONE)
+                return; // not a complete message
+            break;
+
+        default:
+            return;
+    }
+
+    snd_seq_ev_set_source(&ev, m_outputPort);
+    snd_seq_ev_set_subs(&ev);
+    if (m_outputPriority == MIDI_PRIORITY_pianist)
+        snd_seq_ev_set_direct(&ev); // the pianist must hear their own notes straight away
+    else
+    {
+        // The late events go on the queue sooner, so everything is played the same time after it was due
+        const qint64 delay = qMax<qint64>(0, ALSA_SCHEDULE_AHEAD_USEC - m_eventLateness);
+        snd_seq_real_time_t time;
+        time.tv_sec = static_cast<unsigned int>(delay / 1000000);
+        time.tv_nsec = static_cast<unsigned int>((delay % 1000000) * 1000);
+        snd_seq_ev_schedule_real(&ev, m_outputQueue, 1, &time);
+    }
+
+    const int result = snd_seq_event_output(m_outputSeq, &ev);
+    if (result < 0 && result != -EAGAIN)
+        m_validConnection = false;
+    if (!m_holdOutput)
+        snd_seq_drain_output(m_outputSeq);
+}
+
+// the whole tick goes to the kernel in one write
+void CMidiDeviceAlsa::flushMidiOutput()
+{
+    m_holdOutput = false;
+    if (m_outputSeq != nullptr)
+        snd_seq_drain_output(m_outputSeq);
+}
+
+void CMidiDeviceAlsa::inputThread()
+{
+    const int count = snd_seq_poll_descriptors_count(m_inputSeq, POLLIN);
+    std::vector<struct pollfd> fds(static_cast<size_t>(count));
+    snd_seq_poll_descriptors(m_inputSeq, fds.data(), static_cast<unsigned int>(count), POLLIN);
+
+    while (!m_stopInput.load())
+    {
+        if (poll(fds.data(), static_cast<nfds_t>(count), ALSA_POLL_MSEC) <= 0)
+            continue;
+
+        std::lock_guard<std::mutex> lock(m_inputLock);
+        snd_seq_event_t* ev;
+        int result;
+        while ((result = snd_seq_event_input(m_inputSeq, &ev)) >= 0 || result == -ENOSPC)
+        {
+            if (result >= 0)
+                decodeInput(ev);
+            else
+                ppLogWarn("The ALSA sequencer input overflowed");
+        }
+    }
+}
+
+// Called on the input thread with m_inputLock held
+void CMidiDeviceAlsa::decodeInput(const snd_seq_event_t* ev)
+{
+    alsaInput_t input;
+    const int channel = ev->data.note.channel & 0x0f;
+
+    switch (ev->type)
+    {
+    case SND_SEQ_EVENT_PORT_START:
+        // a port has been plugged in, see if it is one that we were using
+        m_portsChanged = true;
+        if (!m_inputPortId.isEmpty() && findPort(m_inputSeq, MIDI_INPUT, m_inputPortId, &m_inputSource) &&
+            snd_seq_connect_from(m_inputSeq, m_inputPort, m_inputSource.client, m_inputSource.port) >= 0)
+            ppLogInfo("Reconnected the MIDI input \"%s\"", qPrintable(m_inputPortId));
+        return;
+
+    case SND_SEQ_EVENT_NOTEON:
+        if (ev->data.note.velocity != 0)
+            input.event.noteOnEvent(0, channel, ev->data.note.note, ev->data.note.velocity);
+        else
+            input.event.noteOffEvent(0, channel, ev->data.note.note, 0);
+        break;
+
+    case SND_SEQ_EVENT_NOTEOFF:
+        input.event.noteOffEvent(0, channel, ev->data.note.note, ev->data.note.velocity);
+        break;
+
+    case SND_SEQ_EVENT_KEYPRESS:
+        input.event.notePressure(0, channel, ev->data.note.note, ev->data.note.velocity);
+        break;
+
+    case SND_SEQ_EVENT_CONTROLLER:
+        input.event.controlChangeEvent(0, ev->data.control.channel & 0x0f, static_cast<int>(ev->data.control.param), ev->data.control.value);
+        break;
+
+    case SND_SEQ_EVENT_PGMCHANGE:
+        input.event.programChangeEvent(0, ev->data.control.channel & 0x0f, ev->data.control.value);
+        break;
+
+    case SND_SEQ_EVENT_CHANPRESS:
+        input.event.channelPressure(0, ev->data.control.channel & 0x0f, ev->data.control.value);
+        break;
+
+    case SND_SEQ_EVENT_PITCHBEND:
+    {
+        const int value = ev->data.control.value + 0x2000;
+        input.event.pitchBendEvent(0, ev->data.control.channel & 0x0f, value & 0x7f, (value >> 7) & 0x7f);
+        break;
+    }
+
+    default:
+        return; // the other announcements, sysex and the timing messages are ignored
+    }
+
+    if (snd_seq_ev_is_real(ev))
+        input.time = static_cast<qint64>(ev->time.time.tv_sec) * 1000000 + ev->time.time.tv_nsec / 1000;
+    else
+        input.time = -1;
+    m_inputEvents.push(input);
+    notifyInput();
+}
+
+// Return the number of events waiting to be read from the midi device
+int CMidiDeviceAlsa::checkMidiInput()
+{
+    if (m_portsChanged.exchange(false))
+        reconnectOutput();
+
+    alsaInput_t input;
+    if (!m_inputEvents.pop(&input))
+        return 0;
+    m_inputEvent = input.event;
+    m_inputTimeStamp = input.time;
+    return 1;
+}
+
+CMidiEvent CMidiDeviceAlsa::readMidiInput()
+{
+    if (Cfg::midiInputDump)
+        ppLogInfo("midi input %lld : type 0x%x chan %d data %d %d", m_inputTimeStamp, m_inputEvent.type(),
+                  m_inputEvent.channel(), m_inputEvent.data1(), m_inputEvent.data2());
+    return m_inputEvent;
+}
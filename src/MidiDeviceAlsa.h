@@ -0,0 +1,141 @@
+/*********************************************************************************/
+/*!
+@file           MidiDeviceAlsa.h
+
+@brief          Plays and records MIDI through the ALSA sequencer with queue scheduled output.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __MIDI_DEVICE_ALSA_H__
+#define __MIDI_DEVICE_ALSA_H__
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <alsa/asoundlib.h>
+
+#include "MidiDeviceBase.h"
+#include "RingBuffer.h"
+
+#define ALSA_INPUT_QUEUE_SIZE       256
+#define ALSA_OUTPUT_MAX_BYTES       40      // the longest raw message (see m_savedRawBytes)
+#define ALSA_SCHEDULE_AHEAD_USEC    10000   // how far ahead of time the music is put on the queue
+#define ALSA_POLL_MSEC              100     // how often the input thread checks if it should stop
+
+/*!
+ * @brief   A MIDI device that talks to the ALSA sequencer directly (Linux only).
+ *
+ * The music is put on a kernel queue a little ahead of time with the lateness of each event
+ * taken off (see setEventLateness()), so the kernel plays it at an even pace even when the
+ * GUI thread stalls. The pianist's own notes are sent direct. The input is time stamped by
+ * the kernel when it arrives and the ports are reconnected by name when a keyboard is plugged back in.
+ */
+class CMidiDeviceAlsa : public CMidiDeviceBase
+{
+public:
+    CMidiDeviceAlsa();
+    ~CMidiDeviceAlsa();
+
+    virtual void init();
+    //! add a midi event to be played immediately
+    virtual void playMidiEvent(const CMidiEvent & event);
+    virtual void holdMidiOutput() {m_holdOutput = true;}
+    virtual void flushMidiOutput();
+    virtual void setOutputPriority(midiPriority_t priority) {m_outputPriority = priority;}
+    virtual void setEventLateness(qint64 usec) {m_eventLateness = usec;}
+    virtual int checkMidiInput();
+    virtual CMidiEvent readMidiInput();
+    virtual qint64 midiInputTimeStamp() {return m_inputTimeStamp;}
+
+    virtual QStringList getMidiPortList(midiType_t type);
+
+    virtual bool openMidiPort(midiType_t type, const QString &portName);
+    virtual void closeMidiPort(midiType_t type, int index);
+
+    virtual bool validMidiConnection() {return m_validConnection;}
+
+    virtual int     midiSettingsSetStr(const QString &name, const QString &str) { Q_UNUSED(name) Q_UNUSED(str) return 0; }
+    virtual int     midiSettingsSetNum(const QString &name, double val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual int     midiSettingsSetInt(const QString &name, int val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual QString midiSettingsGetStr(const QString &name) { Q_UNUSED(name) return QString(); }
+    virtual double  midiSettingsGetNum(const QString &name) { Q_UNUSED(name) return 0.0; }
+    virtual int     midiSettingsGetInt(const QString &name) { Q_UNUSED(name) return 0; }
+
+private:
+    typedef struct
+    {
+        QString name;       // as shown in the settings, eg "1 - USB Keyboard:USB Keyboard MIDI 1 24:0"
+        snd_seq_addr_t addr;
+    } alsaPort_t;
+
+    typedef struct
+    {
+        qint64 time;        // in usec on the input queue
+        CMidiEvent event;
+    } alsaInput_t;
+
+    QList<alsaPort_t> findPorts(snd_seq_t* seq, midiType_t type);
+    bool findPort(snd_seq_t* seq, midiType_t type, const QString &portId, snd_seq_addr_t* addr);
+    static QString portId(const QString &portName);
+    bool ownClient(int client) const;
+    void close();
+    void inputThread();
+    void decodeInput(const snd_seq_event_t* ev);
+    void reconnectOutput();
+
+    // the output is only used by the GUI thread and the input by the input thread
+    snd_seq_t* m_outputSeq;
+    snd_seq_t* m_inputSeq;
+    int m_outputClient;
+    int m_inputClient;
+    int m_outputPort;
+    int m_inputPort;
+    int m_outputQueue;
+    int m_inputQueue;
+    snd_midi_event_t* m_rawEncoder;
+
+    // the connections are remembered by their name (without the numbers) so they survive a hot plug
+    QString m_outputPortId;
+    snd_seq_addr_t m_outputDest;
+    std::mutex m_inputLock;     // guards m_inputSeq and the input connection below
+    QString m_inputPortId;
+    snd_seq_addr_t m_inputSource;
+    std::atomic<bool> m_portsChanged;
+
+    bool m_holdOutput;
+    midiPriority_t m_outputPriority;
+    qint64 m_eventLateness;
+    unsigned char m_savedRawBytes[ALSA_OUTPUT_MAX_BYTES]; // Raw data is used for used for a SYSTEM_EVENT
+    unsigned int m_rawDataIndex;
+
+    std::thread m_inputThread;
+    std::atomic<bool> m_stopInput;
+    CRingBuffer<alsaInput_t> m_inputEvents;
+    CMidiEvent m_inputEvent;
+    qint64 m_inputTimeStamp;
+
+    bool m_validConnection;
+};
+
+#endif //__MIDI_DEVICE_ALSA_H__
@@ -28,6 +28,8 @@
 
 #ifndef __MIDI_DEVICE_BASE_H__
 #define __MIDI_DEVICE_BASE_H__
+#include <functional>
+
 #include <QObject>
 #include <QStringList>
 #include <qsettings.h>
@@ -43,16 +45,32 @@ public:
     virtual void init() = 0;
     //! add a midi event to be played immediately
     virtual void playMidiEvent(const CMidiEvent & event) = 0;
+    //! hold back the output until flushMidiOutput() so a whole tick of events goes out in one go
+    virtual void holdMidiOutput() {}
+    virtual void flushMidiOutput() {}
     virtual int checkMidiInput() = 0;
     virtual CMidiEvent readMidiInput() = 0;
+    //! the input device time (in usec) of the event found by checkMidiInput(), -1 if not known
+    virtual qint64 midiInputTimeStamp() = 0;
 
     typedef enum {MIDI_INPUT, MIDI_OUTPUT} midiType_t;
+    typedef enum {
+        MIDI_PRIORITY_pianist,      // the sound of the pianist's own notes
+        MIDI_PRIORITY_normal,       // the music (devices can tell the notes from the controllers)
+        MIDI_PRIORITY_background    // can wait for a quiet moment, eg the keyboard lights
+    } midiPriority_t;
+    //! how urgent the events played from now on are, used by devices with a slow link
+    virtual void setOutputPriority(midiPriority_t priority) { Q_UNUSED(priority) }
     virtual QStringList getMidiPortList(midiType_t type) = 0;
 
     virtual bool openMidiPort(midiType_t type, const QString &portName) = 0;
     virtual bool validMidiConnection() = 0;
 
     virtual void closeMidiPort(midiType_t type, int index) = 0;
+    //! how far the sound has got with loading (in percent), -1 when nothing is being loaded
+    virtual int loadProgress() {return -1;}
+    //! msec until the output held back for a quiet link can be sent (by the next flushMidiOutput()), -1 if there is none
+    virtual qint64 mSecToPendingOutput() {return -1;}
 
     // based on the fluid synth settings
     virtual int     midiSettingsSetStr(const QString &name, const QString &str) = 0;
@@ -63,11 +81,24 @@ public:
     virtual int     midiSettingsGetInt(const QString &name) = 0;
     void setQSettings(QSettings* settings) {qsettings = settings;}
 
+    //! called from the MIDI input thread when input arrives, set it before any port is opened
+    virtual void setInputNotify(const std::function<void()> &notify) {m_inputNotify = notify;}
+
+    //! the events played from now on were due this many usec ago, only used by devices that can time stamp events
+    virtual void setEventLateness(qint64 usec) { Q_UNUSED(usec) }
+
     //you should always have a virtual destructor when using virtual functions
     virtual ~CMidiDeviceBase() {};
 
 protected:
+    void notifyInput()
+    {
+        if (m_inputNotify)
+            m_inputNotify();
+    }
+
     QSettings* qsettings = nullptr;
+    std::function<void()> m_inputNotify;
 private:
 
 };
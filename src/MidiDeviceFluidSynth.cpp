@@ -26,10 +26,80 @@
 */
 /*********************************************************************************/
 
+#include <cstring>
+
+#include <QFile>
+
 #include "MidiDeviceFluidSynth.h"
 
+#define FLUID_EVENT_QUEUE_SIZE  1024
+#define SAMPLE_CLOCK_SMOOTHING  16      // the audio callbacks jitter so the sample clock is averaged
+
 static fluid_settings_t* s_debug_fluid_settings;
 
+#if FLUID_MAPPED_SOUNDFONT
+// The SoundFont is read from a read-only shared memory map instead of through stdio, so the file
+// pages come straight from the page cache and are shared with any other instance using the same file
+typedef struct
+{
+    QFile file;
+    const uchar* data;
+    qint64 size;
+    qint64 pos;
+} mappedSoundFont_t;
+
+static void* mappedSoundFontOpen(const char* filename)
+{
+    auto handle = new mappedSoundFont_t;
+    handle->file.setFileName(QString::fromUtf8(filename));
+    if (handle->file.open(QIODevice::ReadOnly))
+    {
+        handle->size = handle->file.size();
+        handle->data = handle->file.map(0, handle->size);
+        handle->pos = 0;
+        if (handle->data != nullptr)
+            return handle;
+    }
+    delete handle;
+    return nullptr; // FluidSynth then tries its own loader
+}
+
+static int mappedSoundFontRead(void* buf, fluid_long_long_t count, void* handle)
+{
+    auto font = static_cast<mappedSoundFont_t*>(handle);
+    if (count < 0 || count > font->size - font->pos)
+        return FLUID_FAILED;
+    memcpy(buf, font->data + font->pos, static_cast<size_t>(count));
+    font->pos += count;
+    return FLUID_OK;
+}
+
+static int mappedSoundFontSeek(void* handle, fluid_long_long_t offset, int origin)
+{
+    auto font = static_cast<mappedSoundFont_t*>(handle);
+    qint64 pos = offset;
+    if (origin == SEEK_CUR)
+        pos += font->pos;
+    else if (origin == SEEK_END)
+        pos += font->size;
+    if (pos < 0 || pos > font->size)
+        return FLUID_FAILED;
+    font->pos = pos;
+    return FLUID_OK;
+}
+
+static fluid_long_long_t mappedSoundFontTell(void* handle)
+{
+    return static_cast<mappedSoundFont_t*>(handle)->pos;
+}
+
+static int mappedSoundFontClose(void* handle)
+{
+    delete static_cast<mappedSoundFont_t*>(handle); // the QFile unmaps and closes the file
+    return FLUID_OK;
+}
+#endif
+
 static void debug_settings_foreach_func (void *data,
 #if FLUIDSYNTH_VERSION_MAJOR >= 2
     const char *name,
@@ -45,18 +115,32 @@ static void debug_settings_foreach_func (void *data,
     ppLogDebug("settings_foreach_func %s : %s", name , buffer );
 }
 
-CMidiDeviceFluidSynth::CMidiDeviceFluidSynth()
+CMidiDeviceFluidSynth::CMidiDeviceFluidSynth() : m_eventQueue(FLUID_EVENT_QUEUE_SIZE)
 {
     m_synth = nullptr;
     m_fluidSettings = nullptr;
     m_audioDriver = nullptr;
     m_rawDataIndex = 0;
     m_validConnection = false;
+    m_audioClock = false;
+    m_sampleClockOrigin = -1;
+    m_eventLateness = 0;
+    m_sampleRate = 0.0;
+    m_latencySamples = 0;
+    m_renderedSamples = 0;
+    m_havePendingEvent = false;
+    m_loadProgress = -1;
+    m_stopLoading = false;
+    m_soundFontFailed = false;
+    std::fill(m_channelProgram, m_channelProgram + arraySize(m_channelProgram), GM_PIANO_PATCH);
+    m_synthGain = FLUID_DEFAULT_GAIN / 100.0f;
+    m_synthSetupPending = false;
+    m_clock.start();
 }
 
 CMidiDeviceFluidSynth::~CMidiDeviceFluidSynth()
 {
-    CMidiDeviceFluidSynth::closeMidiPort(MIDI_OUTPUT, -1); // not possible to make virtual call in d'tor
+    deleteSynth();
 }
 
 void CMidiDeviceFluidSynth::init()
@@ -79,6 +163,19 @@ QStringList CMidiDeviceFluidSynth::getMidiPortList(midiType_t type)
     return fontList;
 }
 
+// Everything that needs the synth to be created again if it is changed
+QString CMidiDeviceFluidSynth::synthConfig()
+{
+    QStringList config = qsettings->value("FluidSynth/SoundFont").toStringList();
+    config << qsettings->value("FluidSynth/sampleRateCombo", 22050).toString();
+    config << qsettings->value("FluidSynth/bufferSizeCombo", 128).toString();
+    config << qsettings->value("FluidSynth/bufferCountCombo", 4).toString();
+    config << qsettings->value("FluidSynth/audioDriverCombo", "pulseaudio").toString();
+    config << qsettings->value("FluidSynth/dynamicSampleLoading", true).toString();
+    config << QString::number(Cfg::experimentalAudioClock);
+    return config.join("\n");
+}
+
 bool CMidiDeviceFluidSynth::openMidiPort(midiType_t type, const QString &portName)
 {
     closeMidiPort(MIDI_OUTPUT, -1);
@@ -97,6 +194,48 @@ bool CMidiDeviceFluidSynth::openMidiPort(midiType_t type, const QString &portNam
     QStringList fontList = qsettings->value("FluidSynth/SoundFont").toStringList();
     if (fontList.size() == 0) {return false;}
 
+    // The synth is kept when reconnecting so the SoundFont is only loaded again if something has changed
+    const QString config = synthConfig();
+    if (m_synth == nullptr || config != m_synthConfig || m_soundFontFailed.load())
+    {
+        deleteSynth();
+        createSynth();
+        m_synthConfig = config;
+
+        // The SoundFont can take many seconds to load so it is done in the background.
+        // Until it has loaded the synth just stays silent.
+        m_soundFontFailed = false;
+        m_stopLoading = false;
+        m_loadProgress = 0;
+        m_loaderThread = std::thread(&CMidiDeviceFluidSynth::loadSoundFont, this, fontList.at(0));
+    }
+    startAudio();
+
+    std::fill(m_channelProgram, m_channelProgram + arraySize(m_channelProgram), GM_PIANO_PATCH);
+    m_synthGain = qsettings->value("FluidSynth/masterGainSpin", FLUID_DEFAULT_GAIN).toFloat()/100.0f;
+    m_synthSetupPending = true;
+    synthReady();
+    m_validConnection = true;
+    return true;
+}
+
+// The synth is locked while the SoundFont loads, so the GUI only uses it once that has finished
+bool CMidiDeviceFluidSynth::synthReady()
+{
+    if (m_synth == nullptr || m_loadProgress.load() >= 0)
+        return false;
+    if (m_synthSetupPending)
+    {
+        m_synthSetupPending = false;
+        for (int channel = 0; channel < MAX_MIDI_CHANNELS ; channel++)
+            fluid_synth_program_change(m_synth, channel, m_channelProgram[channel]);
+        fluid_synth_set_gain(m_synth, m_synthGain);
+    }
+    return true;
+}
+
+void CMidiDeviceFluidSynth::createSynth()
+{
     // Create the settings.
     m_fluidSettings = new_fluid_settings();
 
@@ -108,9 +247,29 @@ bool CMidiDeviceFluidSynth::openMidiPort(midiType_t type, const QString &portNam
 #if !defined (Q_OS_WINDOWS)
     fluid_settings_setstr(m_fluidSettings, "audio.driver", qsettings->value("FluidSynth/audioDriverCombo", "pulseaudio").toString().toStdString().c_str());
 #endif
+#if USE_JACK
+    // with the jack driver the sound joins the same graph as the JACK MIDI ports
+    fluid_settings_setstr(m_fluidSettings, "audio.jack.id", "PianoBooster Synth");
+    fluid_settings_setint(m_fluidSettings, "audio.jack.autoconnect", 1);
+#endif
+
+#if FLUID_MAPPED_SOUNDFONT
+    // Only load the samples of the presets that are actually used
+    fluid_settings_setint(m_fluidSettings, "synth.dynamic-sample-loading",
+                          qsettings->value("FluidSynth/dynamicSampleLoading", true).toBool() ? 1 : 0);
+#endif
 
     // Create the synthesizer.
     m_synth = new_fluid_synth(m_fluidSettings);
+#if FLUID_MAPPED_SOUNDFONT
+    fluid_sfloader_t* loader = new_fluid_defsfloader(m_fluidSettings);
+    if (loader != nullptr)
+    {
+        fluid_sfloader_set_callbacks(loader, mappedSoundFontOpen, mappedSoundFontRead, mappedSoundFontSeek,
+                                     mappedSoundFontTell, mappedSoundFontClose);
+        fluid_synth_add_sfloader(m_synth, loader); // owned by the synth and tried before the default loader
+    }
+#endif
 #if (FLUIDSYNTH_VERSION_MAJOR >= 2) && (FLUIDSYNTH_VERSION_MINOR >= 2)
     fluid_synth_reverb_on(m_synth, -1, 0);
     fluid_synth_chorus_on(m_synth, -1, 0);
@@ -119,54 +278,136 @@ bool CMidiDeviceFluidSynth::openMidiPort(midiType_t type, const QString &portNam
     fluid_synth_set_chorus_on(m_synth, 0);
 #endif
 
-    // Create the audio driver.
-    m_audioDriver = new_fluid_audio_driver(m_fluidSettings, m_synth);
-
-    QString pathName = fontList.at(0);
-    ppLogDebug("Sound font %s", qPrintable(pathName));
-    m_soundFontId = fluid_synth_sfload(m_synth, qPrintable(pathName), 0);
-    if (m_soundFontId == -1)
-        return false;
-
-    for (int channel = 0; channel < MAX_MIDI_CHANNELS ; channel++)
-    {
-         fluid_synth_program_change(m_synth, channel, GM_PIANO_PATCH);
-    }
-    fluid_synth_set_gain(m_synth, qsettings->value("FluidSynth/masterGainSpin", FLUID_DEFAULT_GAIN).toFloat()/100.0f );
-    m_validConnection = true;
     if (Cfg::logLevel >= LOG_LEVEL_DEBUG) {
         s_debug_fluid_settings = m_fluidSettings;
         fluid_settings_foreach(m_fluidSettings, 0, debug_settings_foreach_func);
     }
-    return true;
 }
 
-void CMidiDeviceFluidSynth::closeMidiPort(midiType_t type, int index)
+// The audio driver only runs while the port is open, so it does not hold the sound card for nothing
+void CMidiDeviceFluidSynth::startAudio()
 {
-    Q_UNUSED(index)
-    m_validConnection = false;
+    if (m_audioDriver != nullptr)
+        return;
 
-    if (type != MIDI_OUTPUT)
+    m_audioClock = Cfg::experimentalAudioClock;
+    if (m_audioClock)
+    {
+        fluid_settings_getnum(m_fluidSettings, "synth.sample-rate", &m_sampleRate);
+        fluid_settings_getint(m_fluidSettings, "audio.period-size", &m_latencySamples);
+        m_renderedSamples = 0;
+        m_havePendingEvent = false;
+        m_sampleClockOrigin = -1;
+        m_eventQueue.clearDropped(); // only count the events lost on this connection
+        m_audioDriver = new_fluid_audio_driver2(m_fluidSettings, audioCallback, this);
+    }
+    else
+        m_audioDriver = new_fluid_audio_driver(m_fluidSettings, m_synth);
+}
+
+void CMidiDeviceFluidSynth::stopAudio()
+{
+    if (m_audioDriver == nullptr)
         return;
 
+    delete_fluid_audio_driver(m_audioDriver);
+    m_audioDriver = nullptr;
+    m_sampleClockOrigin = -1;
+
+    // the audio thread has stopped so anything left in the queue can be thrown away
+    timedEvent_t timed;
+    while (m_eventQueue.pop(&timed))
+        ;
+    m_havePendingEvent = false;
+    if (m_eventQueue.dropped() > 0)
+        ppLogWarn("The audio callback could not keep up, %u events were lost", m_eventQueue.dropped());
+    m_eventQueue.clearDropped();
+}
+
+void CMidiDeviceFluidSynth::deleteSynth()
+{
     if (m_fluidSettings == nullptr)
         return;
 
+    // sfload() cannot be interrupted, so this waits if it has already started
+    m_stopLoading = true;
+    if (m_loaderThread.joinable())
+        m_loaderThread.join();
+    m_loadProgress = -1;
+
     /* Clean up */
-    delete_fluid_audio_driver(m_audioDriver);
+    stopAudio();
     delete_fluid_synth(m_synth);
     delete_fluid_settings(m_fluidSettings);
+    m_synth = nullptr;
     m_fluidSettings = nullptr;
+    m_synthConfig.clear();
     m_rawDataIndex = 0;
+}
+
+// Runs on the loader thread
+void CMidiDeviceFluidSynth::loadSoundFont(const QString &pathName)
+{
+    ppLogDebug("Sound font %s", qPrintable(pathName));
+
+    if (m_stopLoading.load())
+        return;
+    // reset the presets so the programs already chosen on each channel now get their sound
+    if (fluid_synth_sfload(m_synth, qPrintable(pathName), 1) == -1)
+    {
+        ppLogError("Cannot load the sound font \"%s\"", qPrintable(pathName));
+        m_soundFontFailed = true;
+        m_validConnection = false;
+    }
+    m_loadProgress = -1;
+}
+
+void CMidiDeviceFluidSynth::closeMidiPort(midiType_t type, int index)
+{
+    Q_UNUSED(index)
+    m_validConnection = false;
+
+    if (type != MIDI_OUTPUT)
+        return;
 
+    if (m_synth == nullptr)
+        return;
+
+    // The synth and its SoundFont are kept for when the port is opened again,
+    // but the audio driver is stopped so another output (or the tuner) can have the sound card
+    stopAudio();
+    if (!synthReady())
+        return; // nothing can be sounding while it is loading
+    for (int channel = 0; channel < MAX_MIDI_CHANNELS ; channel++)
+        fluid_synth_cc(m_synth, channel, MIDI_ALL_SOUND_OFF, 0);
 }
 
 //! add a midi event to be played immediately
 void CMidiDeviceFluidSynth::playMidiEvent(const CMidiEvent & event)
 {
-    if (m_synth == nullptr)
+    if (m_synth == nullptr || m_audioDriver == nullptr)
+        return;
+    if (!synthReady())
+    {
+        // only the sound chosen for each channel is kept until the SoundFont has loaded
+        if (event.type() == MIDI_PROGRAM_CHANGE)
+            m_channelProgram[event.channel() & 0x0f] = event.programme();
         return;
+    }
 
+    if (m_audioClock)
+    {
+        timedEvent_t timed;
+        timed.sample = eventSample();
+        timed.event = event;
+        m_eventQueue.push(timed);
+        return;
+    }
+    sendToSynth(event);
+}
+
+void CMidiDeviceFluidSynth::sendToSynth(const CMidiEvent & event)
+{
     int channel = event.channel() & 0x0f;
     switch(event.type())
     {
@@ -214,6 +455,65 @@ void CMidiDeviceFluidSynth::playMidiEvent(const CMidiEvent & event)
     //event.printDetails(); // useful for debugging
 }
 
+// The sample when an event played now (less its lateness) should sound.
+// One audio period is added so the event never lands in a block that is already being rendered.
+qint64 CMidiDeviceFluidSynth::eventSample()
+{
+    const qint64 origin = m_sampleClockOrigin.load(std::memory_order_relaxed);
+    if (origin < 0)
+        return 0; // the audio has not started yet, so play it in the first block
+    const qint64 usec = m_clock.nsecsElapsed() / 1000 - m_eventLateness - origin;
+    return static_cast<qint64>(static_cast<double>(usec) * m_sampleRate / 1000000.0) + m_latencySamples;
+}
+
+int CMidiDeviceFluidSynth::audioCallback(void* data, int len, int nfx, float* fx[], int nout, float* out[])
+{
+    Q_UNUSED(nfx)
+    Q_UNUSED(fx) // the reverb and chorus are turned off
+    return static_cast<CMidiDeviceFluidSynth*>(data)->renderAudio(len, nout, out);
+}
+
+// Called from the audio thread, renders the block in pieces so each event starts on its own sample
+int CMidiDeviceFluidSynth::renderAudio(int len, int nout, float* out[])
+{
+    if (nout < 2)
+        return FLUID_FAILED;
+
+    // track where the audio clock is compared to our clock
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    const qint64 origin = now - static_cast<qint64>(static_cast<double>(m_renderedSamples) * 1000000.0 / m_sampleRate);
+    const qint64 lastOrigin = m_sampleClockOrigin.load(std::memory_order_relaxed);
+    m_sampleClockOrigin.store(lastOrigin < 0 ? origin : lastOrigin + (origin - lastOrigin) / SAMPLE_CLOCK_SMOOTHING,
+                              std::memory_order_relaxed);
+
+    int done = 0;
+    while (done < len)
+    {
+        int end = len;
+        while (true)
+        {
+            if (!m_havePendingEvent)
+            {
+                if (!m_eventQueue.pop(&m_pendingEvent))
+                    break;
+                m_havePendingEvent = true;
+            }
+            const qint64 offset = m_pendingEvent.sample - m_renderedSamples;
+            if (offset > done)
+            {
+                end = static_cast<int>(qMin(offset, static_cast<qint64>(len)));
+                break;
+            }
+            sendToSynth(m_pendingEvent.event); // late events are played at the start of this piece
+            m_havePendingEvent = false;
+        }
+        fluid_synth_write_float(m_synth, end - done, out[0], done, 1, out[1], done, 1);
+        done = end;
+    }
+    m_renderedSamples += len;
+    return FLUID_OK;
+}
+
 // Return the number of events waiting to be read from the midi device
 int CMidiDeviceFluidSynth::checkMidiInput()
 {
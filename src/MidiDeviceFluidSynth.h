@@ -29,25 +29,37 @@
 #ifndef __MIDI_DEVICE_FLUIDSYNTH_H__
 #define __MIDI_DEVICE_FLUIDSYNTH_H__
 
+#include <atomic>
+#include <thread>
+
+#include <QElapsedTimer>
+
 #include "MidiDeviceBase.h"
+#include "RingBuffer.h"
 
 #include <fluidsynth.h>
 
 #define FLUID_DEFAULT_GAIN 80
 
+// The file callbacks for the SoundFont loader and the dynamic sample loading are only in the newer versions of FluidSynth
+#define FLUID_MAPPED_SOUNDFONT  (FLUIDSYNTH_VERSION_MAJOR > 2 || (FLUIDSYNTH_VERSION_MAJOR == 2 && FLUIDSYNTH_VERSION_MINOR >= 2))
+
 class CMidiDeviceFluidSynth : public CMidiDeviceBase
 {
     virtual void init();
     //! add a midi event to be played immediately
     virtual void playMidiEvent(const CMidiEvent & event);
+    virtual void setEventLateness(qint64 usec) {m_eventLateness = usec;}
     virtual int checkMidiInput();
     virtual CMidiEvent readMidiInput();
+    virtual qint64 midiInputTimeStamp() {return -1;}
     virtual QStringList getMidiPortList(midiType_t type);
 
     virtual bool openMidiPort(midiType_t type, const QString &portName);
     virtual void closeMidiPort(midiType_t type, int index);
 
-    virtual bool validMidiConnection() {return m_validConnection;}
+    virtual bool validMidiConnection() {return m_validConnection.load();}
+    virtual int loadProgress() {return m_loadProgress.load();}
 
     // based on the fluid synth settings
     virtual int     midiSettingsSetStr(const QString &name, const QString &str);
@@ -67,6 +79,24 @@ public:
     }
 
 private:
+    typedef struct
+    {
+        qint64 sample; // when the event is to be played on the audio clock
+        CMidiEvent event;
+    } timedEvent_t;
+
+    QString synthConfig();
+    void createSynth();
+    void deleteSynth();
+    void startAudio();
+    void stopAudio();
+    void loadSoundFont(const QString &pathName);
+    bool synthReady();
+    void sendToSynth(const CMidiEvent & event);
+    qint64 eventSample();
+    static int audioCallback(void* data, int len, int nfx, float* fx[], int nout, float* out[]);
+    int renderAudio(int len, int nout, float* out[]);
+
     static constexpr const char* FLUID_NAME = "(FluidSynth)";
     unsigned char m_savedRawBytes[40]; // Raw data is used for used for a SYSTEM_EVENT
     unsigned int m_rawDataIndex;
@@ -74,8 +104,32 @@ private:
     fluid_settings_t* m_fluidSettings;
     fluid_synth_t* m_synth;
     fluid_audio_driver_t* m_audioDriver;
-    int m_soundFontId;
-    bool m_validConnection;
+    std::atomic<bool> m_validConnection;
+    QString m_synthConfig; // the settings the synth was created with
+
+    // The SoundFont is loaded in the background
+    std::thread m_loaderThread;
+    std::atomic<int> m_loadProgress;
+    std::atomic<bool> m_stopLoading;
+    std::atomic<bool> m_soundFontFailed;
+    // the synth is locked while loading, so the sound of each channel is set afterwards
+    int m_channelProgram[MAX_MIDI_CHANNELS];
+    float m_synthGain;
+    bool m_synthSetupPending;
+
+    // Used with the audio clock, the events are queued and then placed at their sample offset
+    // by our own audio callback (see Cfg::experimentalAudioClock)
+    bool m_audioClock;
+    CRingBuffer<timedEvent_t> m_eventQueue;
+    QElapsedTimer m_clock;
+    std::atomic<qint64> m_sampleClockOrigin; // the m_clock time (usec) of sample zero, -1 when not running
+    qint64 m_eventLateness;
+    double m_sampleRate;
+    int m_latencySamples;
+    // only used by the audio thread
+    qint64 m_renderedSamples;
+    timedEvent_t m_pendingEvent;
+    bool m_havePendingEvent;
 };
 
 #endif //__MIDI_DEVICE_FLUIDSYNTH_H__
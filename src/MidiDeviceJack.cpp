@@ -0,0 +1,433 @@
+/*********************************************************************************/
+/*!
+@file           MidiDeviceJack.cpp
+
+@brief          Plays and records MIDI through JACK with frame accurate timing.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "MidiDeviceJack.h"
+
+CMidiDeviceJack::CMidiDeviceJack() : m_outputEvents(JACK_QUEUE_SIZE), m_pianistEvents(JACK_QUEUE_SIZE),
+    m_inputEvents(JACK_QUEUE_SIZE)
+{
+    m_client = nullptr;
+    m_ports[0] = nullptr;
+    m_ports[1] = nullptr;
+    m_bufferSize = 0;
+    m_serverGone = false;
+    m_sampleRate = 0.0;
+    m_outputPriority = MIDI_PRIORITY_normal;
+    m_eventLateness = 0;
+    m_rawDataIndex = 0;
+    m_havePendingOutput = false;
+    m_notifyPipe[0] = -1;
+    m_notifyPipe[1] = -1;
+    m_inputPending = false;
+    m_stopNotify = false;
+    m_inputTimeStamp = -1;
+    m_validConnection = false;
+}
+
+CMidiDeviceJack::~CMidiDeviceJack()
+{
+    close();
+}
+
+// Only starts the client when there is a JACK server running, a server is never started
+void CMidiDeviceJack::init()
+{
+    if (m_serverGone.load())
+        close();
+    if (m_client != nullptr)
+        return;
+
+    jack_status_t status;
+    m_client = jack_client_open("PianoBooster", JackNoStartServer, &status);
+    if (m_client == nullptr)
+        return;
+
+    m_ports[0] = jack_port_register(m_client, "midi_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+    m_ports[1] = jack_port_register(m_client, "midi_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+    if (m_ports[0] == nullptr || m_ports[1] == nullptr)
+    {
+        ppLogError("Cannot register the JACK MIDI ports");
+        close();
+        return;
+    }
+    m_sampleRate = jack_get_sample_rate(m_client);
+    m_bufferSize = jack_get_buffer_size(m_client);
+    m_havePendingOutput = false;
+    jack_set_process_callback(m_client, processCallback, this);
+    jack_set_buffer_size_callback(m_client, bufferSizeCallback, this);
+    jack_on_shutdown(m_client, shutdownCallback, this);
+
+    if (pipe(m_notifyPipe) != 0)
+    {
+        ppLogError("Cannot create the JACK notify pipe");
+        m_notifyPipe[0] = -1;
+        m_notifyPipe[1] = -1;
+        close();
+        return;
+    }
+    fcntl(m_notifyPipe[1], F_SETFL, O_NONBLOCK); // the process callback must never wait
+    m_inputPending = false;
+    m_stopNotify = false;
+    m_notifyThread = std::thread(&CMidiDeviceJack::notifyThread, this);
+    if (jack_activate(m_client) != 0)
+    {
+        ppLogError("Cannot activate the JACK client");
+        close();
+        return;
+    }
+    ppLogInfo("JACK client started at %.0f Hz with %u frames a period", m_sampleRate, m_bufferSize.load());
+}
+
+void CMidiDeviceJack::close()
+{
+    if (m_client != nullptr)
+        jack_client_close(m_client); // this also unregisters the ports
+    if (m_notifyThread.joinable())
+    {
+        m_stopNotify = true;
+        const char wake = 0;
+        if (write(m_notifyPipe[1], &wake, 1) != 1)
+            ppLogError("Cannot stop the JACK notify thread");
+        m_notifyThread.join();
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (m_notifyPipe[i] >= 0)
+            ::close(m_notifyPipe[i]);
+        m_notifyPipe[i] = -1;
+    }
+    m_client = nullptr;
+    m_ports[0] = nullptr;
+    m_ports[1] = nullptr;
+
+    // the process callback has stopped so anything it did not play can be thrown away
+    jackOutput_t output;
+    while (m_outputEvents.pop(&output))
+        ;
+    while (m_pianistEvents.pop(&output))
+        ;
+    m_havePendingOutput = false;
+    m_connectedPort[0].clear();
+    m_connectedPort[1].clear();
+    m_serverGone = false;
+    m_validConnection = false;
+}
+
+int CMidiDeviceJack::processCallback(jack_nframes_t nframes, void* data)
+{
+    static_cast<CMidiDeviceJack*>(data)->process(nframes);
+    return 0;
+}
+
+int CMidiDeviceJack::bufferSizeCallback(jack_nframes_t nframes, void* data)
+{
+    static_cast<CMidiDeviceJack*>(data)->m_bufferSize = nframes;
+    return 0;
+}
+
+// the server has gone away, the client is closed the next time init() is called
+void CMidiDeviceJack::shutdownCallback(void* data)
+{
+    static_cast<CMidiDeviceJack*>(data)->m_serverGone = true;
+}
+
+QStringList CMidiDeviceJack::getMidiPortList(midiType_t type)
+{
+    init();
+    QStringList portNameList;
+    if (m_client == nullptr)
+        return portNameList;
+
+    // we play to the ports that take input and listen to the ports that give output
+    const char** ports = jack_get_ports(m_client, nullptr, JACK_DEFAULT_MIDI_TYPE,
+                                        (type == MIDI_OUTPUT) ? JackPortIsInput : JackPortIsOutput);
+    if (ports == nullptr)
+        return portNameList;
+    for (int i = 0; ports[i] != nullptr; i++)
+    {
+        if (jack_port_is_mine(m_client, jack_port_by_name(m_client, ports[i])))
+            continue;
+        portNameList << QString(JACK_PORT_PREFIX) + ports[i];
+    }
+    jack_free(ports);
+    return portNameList;
+}
+
+bool CMidiDeviceJack::openMidiPort(midiType_t type, const QString &portName)
+{
+    if (!portName.startsWith(JACK_PORT_PREFIX))
+        return false;
+    init();
+    if (m_client == nullptr)
+        return false;
+
+    const int dev = (type == MIDI_INPUT) ? 0 : 1;
+    closeMidiPort(type, -1);
+    const QString otherPort = portName.mid(static_cast<int>(strlen(JACK_PORT_PREFIX)));
+    const char* ourPort = jack_port_name(m_ports[dev]);
+    const int result = (type == MIDI_INPUT) ? jack_connect(m_client, qPrintable(otherPort), ourPort)
+                                            : jack_connect(m_client, ourPort, qPrintable(otherPort));
+    if (result != 0 && result != EEXIST)
+        return false;
+
+    m_connectedPort[dev] = otherPort;
+    m_rawDataIndex = 0;
+    m_validConnection = true;
+    return true;
+}
+
+void CMidiDeviceJack::closeMidiPort(midiType_t type, int index)
+{
+    Q_UNUSED(index)
+    const int dev = (type == MIDI_INPUT) ? 0 : 1;
+    if (m_client == nullptr || m_connectedPort[dev].isEmpty())
+        return;
+
+    const char* ourPort = jack_port_name(m_ports[dev]);
+    if (type == MIDI_INPUT)
+        jack_disconnect(m_client, qPrintable(m_connectedPort[dev]), ourPort);
+    else
+    {
+        jack_disconnect(m_client, ourPort, qPrintable(m_connectedPort[dev]));
+        m_validConnection = false;
+    }
+    m_connectedPort[dev].clear();
+}
+
+//! add a midi event to be played immediately
+void CMidiDeviceJack::playMidiEvent(const CMidiEvent & event)
+{
+    if (m_client == nullptr || m_connectedPort[1].isEmpty())
+        return;
+
+    jackOutput_t output;
+    unsigned char* message = output.bytes;
+    unsigned int length = 0;
+    const unsigned char channel = static_cast<unsigned char>(event.channel() & 0x0f);
+
+    switch(event.type())
+    {
+        case MIDI_NOTE_OFF:
+        case MIDI_NOTE_ON:
+            message[length++] = static_cast<unsigned char>(channel | event.type());
+            message[length++] = static_cast<unsigned char>(event.note());
+            message[length++] = static_cast<unsigned char>(event.velocity());
+            break;
+
+        case MIDI_NOTE_PRESSURE:
+        case MIDI_CONTROL_CHANGE:
+        case MIDI_PITCH_BEND:
+            message[length++] = static_cast<unsigned char>(channel | event.type());
+            message[length++] = static_cast<unsigned char>(event.data1());
+            message[length++] = static_cast<unsigned char>(event.data2());
+            break;
+
+        case MIDI_PROGRAM_CHANGE:
+            message[length++] = static_cast<unsigned char>(channel | MIDI_PROGRAM_CHANGE);
+            message[length++] = static_cast<unsigned char>(event.programme());
+            break;
+
+        case MIDI_CHANNEL_PRESSURE:
+            message[length++] = static_cast<unsigned char>(channel | MIDI_CHANNEL_PRESSURE);
+            message[length++] = static_cast<unsigned char>(event.data1());
+            break;
+
+        case MIDI_PB_collateRawMidiData: //used for a SYSTEM_EVENT
+            if (m_rawDataIndex < arraySizeAs<unsigned int>(m_savedRawBytes))
+                m_savedRawBytes[m_rawDataIndex++] = static_cast<unsigned char>(event.data1());
+            return; // Don't output any thing yet so just return
+
+        case MIDI_PB_outputRawMidiData: //used for a SYSTEM_EVENT
+            for (size_t i = 0; i < m_rawDataIndex; i++)
+                message[length++] = m_savedRawBytes[i];
+            m_rawDataIndex = 0;
+            break;
+
+        default:
+            return;
+    }
+    if (length == 0)
+        return;
+
+    output.length = length;
+    output.frame = jack_frame_time(m_client);
+    if (m_outputPriority == MIDI_PRIORITY_pianist)
+    {
+        m_pianistEvents.push(output); // never waits, drops the event if the process callback has stopped
+        return;
+    }
+    // The music is played one period after it was due so each event keeps its place in time
+    const qint64 period = m_bufferSize.load();
+    const qint64 lateFrames = static_cast<qint64>(m_eventLateness * m_sampleRate / 1000000.0);
+    output.frame += static_cast<jack_nframes_t>(period - qBound<qint64>(0, lateFrames, period));
+    m_outputEvents.push(output);
+}
+
+// Runs on the JACK process thread, so no locks and no allocation
+void CMidiDeviceJack::process(jack_nframes_t nframes)
+{
+    void* outputBuffer = jack_port_get_buffer(m_ports[1], nframes);
+    jack_midi_clear_buffer(outputBuffer);
+
+    // the pianist's notes go first, the music is never due before the start of the cycle
+    jackOutput_t pianistOutput;
+    while (m_pianistEvents.pop(&pianistOutput))
+        jack_midi_event_write(outputBuffer, 0, pianistOutput.bytes, pianistOutput.length);
+
+    const jack_nframes_t cycleStart = jack_last_frame_time(m_client);
+    int lastOffset = 0;
+    while (m_havePendingOutput || m_outputEvents.pop(&m_pendingOutput))
+    {
+        m_havePendingOutput = true;
+        // the frame times wrap around so only the difference is used
+        const int offset = static_cast<qint32>(m_pendingOutput.frame - cycleStart);
+        if (offset >= static_cast<int>(nframes))
+            break; // it is for a later cycle
+        lastOffset = qMax(offset, lastOffset); // the events must not go backwards in the buffer
+        jack_midi_event_write(outputBuffer, static_cast<jack_nframes_t>(lastOffset), m_pendingOutput.bytes, m_pendingOutput.length);
+        m_havePendingOutput = false;
+    }
+
+    void* inputBuffer = jack_port_get_buffer(m_ports[0], nframes);
+    const jack_nframes_t count = jack_midi_get_event_count(inputBuffer);
+    if (count == 0)
+        return;
+
+    jack_nframes_t currentFrames;
+    jack_time_t currentUsecs;
+    jack_time_t nextUsecs;
+    float periodUsecs;
+    jack_get_cycle_times(m_client, &currentFrames, &currentUsecs, &nextUsecs, &periodUsecs);
+    const double usecsPerFrame = static_cast<double>(nextUsecs - currentUsecs) / nframes;
+    bool arrived = false;
+    for (jack_nframes_t i = 0; i < count; i++)
+    {
+        jack_midi_event_t midiEvent;
+        jackInput_t input;
+        if (jack_midi_event_get(&midiEvent, inputBuffer, i) != 0 || !decodeInput(midiEvent, &input.event))
+            continue;
+        input.time = static_cast<qint64>(currentUsecs + midiEvent.time * usecsPerFrame);
+        m_inputEvents.push(input);
+        arrived = true;
+    }
+    if (arrived)
+        wakeNotifyThread();
+}
+
+// Called from the process callback
+void CMidiDeviceJack::wakeNotifyThread()
+{
+    if (m_inputPending.exchange(true))
+        return; // the notify thread has not got round to the last lot yet
+    const char wake = 1;
+    // a full pipe already has a wake up waiting in it
+    if (write(m_notifyPipe[1], &wake, 1) != 1 && errno != EAGAIN)
+        m_inputPending = false;
+}
+
+bool CMidiDeviceJack::decodeInput(const jack_midi_event_t &midiEvent, CMidiEvent* event)
+{
+    if (midiEvent.size == 0 || midiEvent.size > 3)
+        return false; // sysex is ignored
+    const unsigned char* message = midiEvent.buffer;
+    const int data1 = (midiEvent.size > 1) ? message[1] : 0;
+    const int data2 = (midiEvent.size > 2) ? message[2] : 0;
+    const int channel = message[0] & 0x0f;
+
+    switch (message[0] & 0xf0)
+    {
+    case MIDI_NOTE_ON:
+        if (data2 != 0)
+            event->noteOnEvent(0, channel, data1, data2);
+        else
+            event->noteOffEvent(0, channel, data1, data2);
+        break;
+    case MIDI_NOTE_OFF:
+        event->noteOffEvent(0, channel, data1, data2);
+        break;
+    case MIDI_NOTE_PRESSURE:
+        event->notePressure(0, channel, data1, data2);
+        break;
+    case MIDI_CONTROL_CHANGE:
+        event->controlChangeEvent(0, channel, data1, data2);
+        break;
+    case MIDI_PROGRAM_CHANGE:
+        event->programChangeEvent(0, channel, data1);
+        break;
+    case MIDI_CHANNEL_PRESSURE:
+        event->channelPressure(0, channel, data1);
+        break;
+    case MIDI_PITCH_BEND:
+        event->pitchBendEvent(0, channel, data1, data2);
+        break;
+    default:
+        return false; // the timing messages are ignored
+    }
+    return true;
+}
+
+// Passes the input on to the GUI, it sleeps in read() until there is input or the device is closed
+void CMidiDeviceJack::notifyThread()
+{
+    char wake;
+    while (!m_stopNotify.load())
+    {
+        const ssize_t result = read(m_notifyPipe[0], &wake, 1);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result != 1 || m_stopNotify.load())
+            break;
+        m_inputPending = false; // cleared before the input is read, so nothing is missed
+        notifyInput();
+    }
+}
+
+// Return the number of events waiting to be read from the midi device
+int CMidiDeviceJack::checkMidiInput()
+{
+    jackInput_t input;
+    if (m_connectedPort[0].isEmpty() || !m_inputEvents.pop(&input))
+        return 0;
+    m_inputEvent = input.event;
+    m_inputTimeStamp = input.time;
+    return 1;
+}
+
+CMidiEvent CMidiDeviceJack::readMidiInput()
+{
+    if (Cfg::midiInputDump)
+        ppLogInfo("midi input %lld : type 0x%x chan %d data %d %d", m_inputTimeStamp, m_inputEvent.type(),
+                  m_inputEvent.channel(), m_inputEvent.data1(), m_inputEvent.data2());
+    return m_inputEvent;
+}
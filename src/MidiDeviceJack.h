@@ -0,0 +1,136 @@
+/*********************************************************************************/
+/*!
+@file           MidiDeviceJack.h
+
+@brief          Plays and records MIDI through JACK with frame accurate timing.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __MIDI_DEVICE_JACK_H__
+#define __MIDI_DEVICE_JACK_H__
+
+#include <atomic>
+#include <thread>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#include "MidiDeviceBase.h"
+#include "RingBuffer.h"
+
+#define JACK_PORT_PREFIX        "JACK: "
+#define JACK_QUEUE_SIZE         1024
+#define JACK_OUTPUT_MAX_BYTES   40      // the longest raw message (see m_savedRawBytes)
+
+/*!
+ * @brief   A MIDI device with its own JACK client and a MIDI port each way.
+ *
+ * Each output event is given the JACK frame time it is due and the process callback writes it
+ * at that offset inside the cycle, one period after it was played less its lateness
+ * (see setEventLateness()). The pianist's own notes have a queue of their own and go out
+ * at the start of the next cycle, so they never wait behind the music. The input is stamped with the frame it arrived on. The process
+ * callback never locks or allocates, everything goes through lock-free ring buffers and
+ * the notify thread is woken through a pipe.
+ */
+class CMidiDeviceJack : public CMidiDeviceBase
+{
+public:
+    CMidiDeviceJack();
+    ~CMidiDeviceJack();
+
+    virtual void init();
+    //! add a midi event to be played immediately
+    virtual void playMidiEvent(const CMidiEvent & event);
+    virtual void setOutputPriority(midiPriority_t priority) {m_outputPriority = priority;}
+    virtual void setEventLateness(qint64 usec) {m_eventLateness = usec;}
+    virtual int checkMidiInput();
+    virtual CMidiEvent readMidiInput();
+    virtual qint64 midiInputTimeStamp() {return m_inputTimeStamp;}
+
+    virtual QStringList getMidiPortList(midiType_t type);
+
+    virtual bool openMidiPort(midiType_t type, const QString &portName);
+    virtual void closeMidiPort(midiType_t type, int index);
+
+    virtual bool validMidiConnection() {return m_validConnection && !m_serverGone.load();}
+
+    virtual int     midiSettingsSetStr(const QString &name, const QString &str) { Q_UNUSED(name) Q_UNUSED(str) return 0; }
+    virtual int     midiSettingsSetNum(const QString &name, double val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual int     midiSettingsSetInt(const QString &name, int val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual QString midiSettingsGetStr(const QString &name) { Q_UNUSED(name) return QString(); }
+    virtual double  midiSettingsGetNum(const QString &name) { Q_UNUSED(name) return 0.0; }
+    virtual int     midiSettingsGetInt(const QString &name) { Q_UNUSED(name) return 0; }
+
+private:
+    typedef struct
+    {
+        jack_nframes_t frame;   // the JACK frame time it is to be played
+        unsigned int length;
+        unsigned char bytes[JACK_OUTPUT_MAX_BYTES];
+    } jackOutput_t;
+
+    typedef struct
+    {
+        qint64 time;            // in usec on the JACK clock
+        CMidiEvent event;
+    } jackInput_t;
+
+    void close();
+    void notifyThread();
+    static int processCallback(jack_nframes_t nframes, void* data);
+    static int bufferSizeCallback(jack_nframes_t nframes, void* data);
+    static void shutdownCallback(void* data);
+    void process(jack_nframes_t nframes);
+    bool decodeInput(const jack_midi_event_t &midiEvent, CMidiEvent* event);
+
+    jack_client_t* m_client;
+    jack_port_t* m_ports[2];        // 0 for input, 1 for output
+    QString m_connectedPort[2];     // the other end, without the JACK_PORT_PREFIX
+    std::atomic<jack_nframes_t> m_bufferSize;
+    std::atomic<bool> m_serverGone;
+    double m_sampleRate;
+
+    midiPriority_t m_outputPriority;
+    qint64 m_eventLateness;
+    unsigned char m_savedRawBytes[JACK_OUTPUT_MAX_BYTES]; // Raw data is used for used for a SYSTEM_EVENT
+    unsigned int m_rawDataIndex;
+    CRingBuffer<jackOutput_t> m_outputEvents;
+    CRingBuffer<jackOutput_t> m_pianistEvents;
+    // only used by the process callback
+    jackOutput_t m_pendingOutput;
+    bool m_havePendingOutput;
+
+    // The process callback cannot post to the GUI so another thread does it for it
+    void wakeNotifyThread();
+    CRingBuffer<jackInput_t> m_inputEvents;
+    std::thread m_notifyThread;
+    int m_notifyPipe[2];                // a write() is safe from the realtime thread, unlike a mutex
+    std::atomic<bool> m_inputPending;   // only one wake up is written for each lot of input
+    std::atomic<bool> m_stopNotify;
+    CMidiEvent m_inputEvent;
+    qint64 m_inputTimeStamp;
+
+    bool m_validConnection;
+};
+
+#endif //__MIDI_DEVICE_JACK_H__
@@ -28,9 +28,10 @@
 
 #include "MidiDeviceRt.h"
 
+#include <algorithm>
 #include <limits>
 
-CMidiDeviceRt::CMidiDeviceRt()
+CMidiDeviceRt::CMidiDeviceRt() : m_inputQueue(RT_INPUT_QUEUE_SIZE)
 {
     m_validConnection = false;
     m_midiout = nullptr;
@@ -38,6 +39,18 @@ CMidiDeviceRt::CMidiDeviceRt()
     m_midiPorts[0] = -1;
     m_midiPorts[1] = -1;
     m_rawDataIndex = 0;
+    m_stamp = 0.0;
+    m_inputTimeStamp = 0;
+    m_holdOutput = false;
+    m_outputPriority = MIDI_PRIORITY_normal;
+    m_heldCount = 0;
+    m_deferredHead = 0;
+    m_deferredCount = 0;
+    std::fill(m_deferredChannels, m_deferredChannels + arraySize(m_deferredChannels), 0);
+    m_dinLink = false;
+    m_runningStatus = 0;
+    m_wireFreeTime = 0;
+    m_wireClock.start();
     init();
 }
 
@@ -71,6 +84,8 @@ void CMidiDeviceRt::init()
         }
         try {
             m_midiin = new RtMidiIn();
+            // the input is pushed to us so the GUI can sleep until something arrives
+            m_midiin->setCallback(&CMidiDeviceRt::inputCallback, this);
         }
         catch(RtMidiError &error){
             error.printMessage();
@@ -79,6 +94,20 @@ void CMidiDeviceRt::init()
     }
 }
 
+void CMidiDeviceRt::inputCallback(double deltaTime, std::vector<unsigned char> *message, void *userData)
+{
+    auto device = static_cast<CMidiDeviceRt*>(userData);
+    if (message->empty() || message->size() > RT_INPUT_MAX_BYTES)
+        return;
+
+    rtInput_t input;
+    input.stamp = deltaTime;
+    input.length = static_cast<unsigned int>(message->size());
+    std::copy(message->begin(), message->end(), input.bytes);
+    device->m_inputQueue.push(input);
+    device->notifyInput();
+}
+
 QString CMidiDeviceRt::addIndexToString(const QString &name, int index)
 {
     QString ret;
@@ -160,6 +189,11 @@ bool CMidiDeviceRt::openMidiPort(midiType_t type, const QString &portName)
 
             m_midiPorts[dev] = static_cast<int>(i);
             m_rawDataIndex = 0;
+            if (type == MIDI_OUTPUT)
+            {
+                m_dinLink = qsettings != nullptr && qsettings->value("Midi/DinLink", false).toBool();
+                m_runningStatus = 0;
+            }
 
             midiDevice->openPort( i );
             m_validConnection = true;
@@ -176,7 +210,16 @@ void CMidiDeviceRt::closeMidiPort(midiType_t type, int index)
     if (type == MIDI_INPUT)
         m_midiin->closePort();
     else
+    {
+        // anything held back is for the port being closed
+        m_heldCount = 0;
+        m_holdOutput = false;
+        m_deferredHead = 0;
+        m_deferredCount = 0;
+        std::fill(m_deferredChannels, m_deferredChannels + arraySize(m_deferredChannels), 0);
+        m_runningStatus = 0;
         m_midiout->closePort();
+    }
 }
 
 //! add a midi event to be played immediately
@@ -186,49 +229,51 @@ void CMidiDeviceRt::playMidiEvent(const CMidiEvent & event)
         return;
 
     unsigned int channel;
-    std::vector<unsigned char> message;
+    rtOutput_t output;
+    unsigned char* message = output.bytes;
+    unsigned int length = 0;
 
     channel = event.channel() & 0x0f;
 
     switch(event.type())
     {
         case MIDI_NOTE_OFF: // NOTE_OFF
-            message.push_back(static_cast<unsigned char>(channel | MIDI_NOTE_OFF));
-            message.push_back(static_cast<unsigned char>(event.note()));
-            message.push_back(static_cast<unsigned char>(event.velocity()));
+            message[length++] = static_cast<unsigned char>(channel | MIDI_NOTE_OFF);
+            message[length++] = static_cast<unsigned char>(event.note());
+            message[length++] = static_cast<unsigned char>(event.velocity());
             break;
         case MIDI_NOTE_ON:      // NOTE_ON
-            message.push_back(static_cast<unsigned char>(channel | MIDI_NOTE_ON));
-            message.push_back(static_cast<unsigned char>(event.note()));
-            message.push_back(static_cast<unsigned char>(event.velocity()));
+            message[length++] = static_cast<unsigned char>(channel | MIDI_NOTE_ON);
+            message[length++] = static_cast<unsigned char>(event.note());
+            message[length++] = static_cast<unsigned char>(event.velocity());
             break;
 
         case MIDI_NOTE_PRESSURE: //POLY_AFTERTOUCH: 3 bytes
-            message.push_back(static_cast<unsigned char>(channel | MIDI_NOTE_PRESSURE));
-            message.push_back(static_cast<unsigned char>(event.data1()));
-            message.push_back(static_cast<unsigned char>(event.data2()));
+            message[length++] = static_cast<unsigned char>(channel | MIDI_NOTE_PRESSURE);
+            message[length++] = static_cast<unsigned char>(event.data1());
+            message[length++] = static_cast<unsigned char>(event.data2());
             break;
 
         case MIDI_CONTROL_CHANGE: //CONTROL_CHANGE:
-            message.push_back(static_cast<unsigned char>(channel | MIDI_CONTROL_CHANGE));
-            message.push_back(static_cast<unsigned char>(event.data1()));
-            message.push_back(static_cast<unsigned char>(event.data2()));
+            message[length++] = static_cast<unsigned char>(channel | MIDI_CONTROL_CHANGE);
+            message[length++] = static_cast<unsigned char>(event.data1());
+            message[length++] = static_cast<unsigned char>(event.data2());
             break;
 
         case MIDI_PROGRAM_CHANGE: //PROGRAM_CHANGE:
-            message.push_back(static_cast<unsigned char>(channel | MIDI_PROGRAM_CHANGE));
-            message.push_back(static_cast<unsigned char>(event.programme()));
+            message[length++] = static_cast<unsigned char>(channel | MIDI_PROGRAM_CHANGE);
+            message[length++] = static_cast<unsigned char>(event.programme());
             break;
 
         case MIDI_CHANNEL_PRESSURE: //AFTERTOUCH: 2 bytes only
-            message.push_back(static_cast<unsigned char>(channel | MIDI_CHANNEL_PRESSURE));
-            message.push_back(static_cast<unsigned char>(event.data1()));
+            message[length++] = static_cast<unsigned char>(channel | MIDI_CHANNEL_PRESSURE);
+            message[length++] = static_cast<unsigned char>(event.data1());
             break;
 
         case MIDI_PITCH_BEND: //PITCH_BEND:
-            message.push_back(static_cast<unsigned char>(channel | MIDI_PITCH_BEND));
-            message.push_back(static_cast<unsigned char>(event.data1()));
-            message.push_back(static_cast<unsigned char>(event.data2()));
+            message[length++] = static_cast<unsigned char>(channel | MIDI_PITCH_BEND);
+            message[length++] = static_cast<unsigned char>(event.data1());
+            message[length++] = static_cast<unsigned char>(event.data2());
             break;
 
         case  MIDI_PB_collateRawMidiData: //used for a SYSTEM_EVENT
@@ -238,7 +283,7 @@ void CMidiDeviceRt::playMidiEvent(const CMidiEvent & event)
 
         case  MIDI_PB_outputRawMidiData: //used for a SYSTEM_EVENT
             for (size_t i = 0; i < m_rawDataIndex; i++)
-                message.push_back( m_savedRawBytes[i]);
+                message[length++] = m_savedRawBytes[i];
             m_rawDataIndex = 0;
             break;
 
@@ -246,31 +291,171 @@ void CMidiDeviceRt::playMidiEvent(const CMidiEvent & event)
             return;
 
     }
+    if (length == 0)
+        return;
+
+    output.length = length;
+    if (m_outputPriority == MIDI_PRIORITY_pianist)
+        output.sendClass = RT_SEND_pianist;
+    else if (m_outputPriority == MIDI_PRIORITY_background)
+        output.sendClass = RT_SEND_background;
+    else
+        output.sendClass = (event.type() == MIDI_NOTE_ON || event.type() == MIDI_NOTE_OFF) ? RT_SEND_notes : RT_SEND_control;
+
+    if (!m_holdOutput)
+    {
+        if (m_deferredChannels[outputChannel(output)] > 0)
+            sendDeferred(true); // keep the order on the channel
+        if (output.sendClass == RT_SEND_background)
+            deferOutput(output);
+        else
+            sendToWire(output);
+        sendDeferred(false);
+        return;
+    }
+
+    if (m_heldCount >= arraySizeAs<unsigned int>(m_heldOutput))
+        sendHeldOutput();
+    m_heldOutput[m_heldCount++] = output;
+
+    //event.printDetails(); // useful for debugging
+}
+
+void CMidiDeviceRt::flushMidiOutput()
+{
+    sendHeldOutput();
+    m_holdOutput = false;
+}
+
+// The engine has to run again when the link goes quiet, or the deferred output (the lights) would wait for the next event
+qint64 CMidiDeviceRt::mSecToPendingOutput()
+{
+    if (m_deferredCount == 0)
+        return -1;
+    const qint64 now = m_wireClock.nsecsElapsed() / 1000;
+    return qMax(static_cast<qint64>(0), (m_wireFreeTime - now + 999) / 1000);
+}
+
+// the system messages get their own slot after the channels
+int CMidiDeviceRt::outputChannel(const rtOutput_t &output)
+{
+    return (output.bytes[0] < 0xf0) ? (output.bytes[0] & 0x0f) : MAX_MIDI_CHANNELS;
+}
+
+// Sends the held output with the most urgent first, the background output waits for the link to go quiet
+void CMidiDeviceRt::sendHeldOutput()
+{
+    // Nothing may overtake an earlier message on its own channel (eg a program change before its notes)
+    // so each message is moved up to the most urgent class that follows it on the same channel
+    int laterClass[MAX_MIDI_CHANNELS + 1];
+    std::fill(laterClass, laterClass + arraySize(laterClass), static_cast<int>(RT_SEND_background));
+    bool overtakesDeferred = false;
+    for (unsigned int i = m_heldCount; i-- > 0;)
+    {
+        rtOutput_t &output = m_heldOutput[i];
+        const int channel = outputChannel(output);
+        output.sendClass = qMin(output.sendClass, laterClass[channel]);
+        laterClass[channel] = output.sendClass;
+        if (output.sendClass != RT_SEND_background && m_deferredChannels[channel] > 0)
+            overtakesDeferred = true;
+    }
+    if (overtakesDeferred)
+        sendDeferred(true);
+
+    for (int sendClass = RT_SEND_pianist; sendClass < RT_SEND_background; sendClass++)
+    {
+        for (unsigned int i = 0; i < m_heldCount; i++)
+        {
+            if (m_heldOutput[i].sendClass == sendClass)
+                sendToWire(m_heldOutput[i]);
+        }
+    }
+    for (unsigned int i = 0; i < m_heldCount; i++)
+    {
+        if (m_heldOutput[i].sendClass == RT_SEND_background)
+            deferOutput(m_heldOutput[i]);
+    }
+    m_heldCount = 0;
+    sendDeferred(false);
+}
+
+void CMidiDeviceRt::deferOutput(const rtOutput_t &output)
+{
+    if (m_deferredCount >= arraySizeAs<unsigned int>(m_deferredOutput))
+        sendFirstDeferred(); // the link is never quiet, so they have to go anyway
+    m_deferredOutput[(m_deferredHead + m_deferredCount) % arraySizeAs<unsigned int>(m_deferredOutput)] = output;
+    m_deferredCount++;
+    m_deferredChannels[outputChannel(output)]++;
+}
+
+void CMidiDeviceRt::sendFirstDeferred()
+{
+    const rtOutput_t &output = m_deferredOutput[m_deferredHead];
+    m_deferredChannels[outputChannel(output)]--;
+    m_deferredHead = (m_deferredHead + 1) % arraySizeAs<unsigned int>(m_deferredOutput);
+    m_deferredCount--;
+    sendToWire(output);
+}
+
+// Sends the deferred output while the link is idle (or all of it)
+void CMidiDeviceRt::sendDeferred(bool all)
+{
+    while (m_deferredCount > 0 && (all || m_wireFreeTime <= m_wireClock.nsecsElapsed() / 1000))
+        sendFirstDeferred();
+}
+
+// Keeps track of when the 31.25 kbaud link will have finished sending everything
+void CMidiDeviceRt::sendToWire(rtOutput_t output)
+{
+    if (!m_dinLink)
+    {
+        // a USB or virtual port is not slowed down by the bytes and keeps the note off velocity
+        sendMessage(output.bytes, output.length);
+        return;
+    }
+    unsigned char status = output.bytes[0];
+    // a note off as a note on with no velocity can reuse the running status of the notes before it
+    if ((status & 0xf0) == MIDI_NOTE_OFF && m_runningStatus == (MIDI_NOTE_ON | (status & 0x0f)) && output.length == 3)
+    {
+        status = m_runningStatus;
+        output.bytes[0] = status;
+        output.bytes[2] = 0;
+    }
+    unsigned int bytes = output.length;
+    if (status == m_runningStatus)
+        bytes--; // the port leaves out the repeated status byte
+    m_runningStatus = (status < 0xf0) ? status : 0;
+
+    const qint64 now = m_wireClock.nsecsElapsed() / 1000;
+    m_wireFreeTime = qMax(now, m_wireFreeTime) + bytes * MIDI_WIRE_BYTE_USEC;
+    sendMessage(output.bytes, output.length);
+}
+
+void CMidiDeviceRt::sendMessage(const unsigned char* message, unsigned int length)
+{
     try {
-        m_midiout->sendMessage( &message );
+        m_midiout->sendMessage(message, length);
     }
     catch(RtMidiError &error){
         error.printMessage();
         m_validConnection = false;
     }
-
-    //event.printDetails(); // useful for debugging
 }
 
 // Return the number of events waiting to be read from the midi device
 int CMidiDeviceRt::checkMidiInput()
 {
+    m_inputMessage.clear();
     if (m_midiPorts[0] < 0)
         return 0;
 
-    try {
-        m_stamp = m_midiin->getMessage( &m_inputMessage );
-    }
-    catch(RtMidiError &error){
-        error.printMessage();
-        m_validConnection = false;
+    rtInput_t input;
+    if (!m_inputQueue.pop(&input))
         return 0;
-    }
+    m_stamp = input.stamp;
+    m_inputMessage.assign(input.bytes, input.bytes + input.length);
+    // RtMidi gives the time in seconds since the previous message
+    m_inputTimeStamp += static_cast<qint64>(m_stamp * 1000000.0);
 
     return m_inputMessage.size() > std::numeric_limits<int>::max() ? std::numeric_limits<int>::max() : static_cast<int>(m_inputMessage.size());
 }
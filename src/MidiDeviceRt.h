@@ -27,16 +27,31 @@
 #ifndef __MIDI_DEVICE_RT_H__
 #define __MIDI_DEVICE_RT_H__
 
+#include <QElapsedTimer>
+
 #include "MidiDeviceBase.h"
+#include "RingBuffer.h"
 #include "rtmidi/RtMidi.h"
 
+#define RT_INPUT_QUEUE_SIZE     256
+#define RT_INPUT_MAX_BYTES      3   // sysex and the timing messages are ignored by RtMidi
+#define RT_OUTPUT_MAX_BYTES     40  // the longest raw message (see m_savedRawBytes)
+#define RT_OUTPUT_HELD_MAX      128 // messages held back in one tick
+#define RT_OUTPUT_DEFERRED_MAX  64  // background messages waiting for the link to go quiet
+#define MIDI_WIRE_BYTE_USEC     320 // a byte is 10 bits at 31.25 kbaud
+
 class CMidiDeviceRt : public CMidiDeviceBase
 {
     virtual void init();
     //! add a midi event to be played immediately
     virtual void playMidiEvent(const CMidiEvent & event);
+    virtual void holdMidiOutput() {m_holdOutput = true;}
+    virtual void flushMidiOutput();
+    virtual qint64 mSecToPendingOutput();
+    virtual void setOutputPriority(midiPriority_t priority) {m_outputPriority = priority;}
     virtual int checkMidiInput();
     virtual CMidiEvent readMidiInput();
+    virtual qint64 midiInputTimeStamp() {return m_inputTimeStamp;}
 
     virtual QStringList getMidiPortList(midiType_t type);
 
@@ -64,16 +79,65 @@ private:
     RtMidiIn *m_midiin;
 
     double m_stamp;
+    qint64 m_inputTimeStamp; // all the m_stamp deltas added up (in usec)
 
     // 0 for input, 1 for output
     int m_midiPorts[2];      // select which MIDI output port to open
     std::vector<unsigned char> m_inputMessage;
-    unsigned char m_savedRawBytes[40]; // Raw data is used for used for a SYSTEM_EVENT
+    unsigned char m_savedRawBytes[RT_OUTPUT_MAX_BYTES]; // Raw data is used for used for a SYSTEM_EVENT
     unsigned int m_rawDataIndex;
 
+    // The order the held output is sent in, the most urgent first
+    enum {
+        RT_SEND_pianist,    // the pianist's own notes
+        RT_SEND_notes,      // the accompaniment notes and note offs
+        RT_SEND_control,    // the controllers, program changes and the rest
+        RT_SEND_background  // the keyboard lights, sent when the link is quiet
+    };
+    typedef struct
+    {
+        int sendClass;
+        unsigned int length;
+        unsigned char bytes[RT_OUTPUT_MAX_BYTES];
+    } rtOutput_t;
+
+    static int outputChannel(const rtOutput_t &output);
+    void sendHeldOutput();
+    void deferOutput(const rtOutput_t &output);
+    void sendFirstDeferred();
+    void sendDeferred(bool all);
+    void sendToWire(rtOutput_t output);
+    void sendMessage(const unsigned char* message, unsigned int length);
+
+    // the output held back until the end of the tick, so nothing is allocated on the way out
+    bool m_holdOutput;
+    midiPriority_t m_outputPriority;
+    rtOutput_t m_heldOutput[RT_OUTPUT_HELD_MAX];
+    unsigned int m_heldCount;
+    rtOutput_t m_deferredOutput[RT_OUTPUT_DEFERRED_MAX]; // a FIFO
+    unsigned int m_deferredHead;
+    unsigned int m_deferredCount;
+    int m_deferredChannels[MAX_MIDI_CHANNELS + 1];      // how many are deferred on each channel
+    // a model of the hardware MIDI link
+    bool m_dinLink;         // the output goes down a 31.25 kbaud DIN cable (a USB link is not modelled)
+    QElapsedTimer m_wireClock;
+    qint64 m_wireFreeTime;  // usec on m_wireClock when everything sent so far is on the wire
+    unsigned char m_runningStatus;
+
     // kotechnology added function to create indexed string. Format: "1 - Example"
     QString addIndexToString(const QString &name, int index);
 
+    // RtMidi calls this from its own thread for each message
+    static void inputCallback(double deltaTime, std::vector<unsigned char> *message, void *userData);
+
+    typedef struct
+    {
+        double stamp;
+        unsigned int length;
+        unsigned char bytes[RT_INPUT_MAX_BYTES];
+    } rtInput_t;
+    CRingBuffer<rtInput_t> m_inputQueue;
+
     bool m_validConnection;
 };
 
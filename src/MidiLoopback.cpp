@@ -0,0 +1,290 @@
+/*********************************************************************************/
+/*!
+@file           MidiLoopback.cpp
+
+@brief          A MIDI loopback with a model of the link and a virtual pianist for testing without hardware.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <chrono>
+#include <thread>
+
+#include "MidiLoopback.h"
+#include "Song.h"
+
+#define LOOPBACK_SEED                   1       // the same every time so the runs can be compared
+#define LOOPBACK_CALIBRATION_TICK_MSEC  1
+#define LOOPBACK_MAX_SONG_USEC          (3600LL * 1000000)  // give up on a song that never finishes
+#define PIANIST_VELOCITY                80
+#define PIANIST_HOLD_USEC               150000  // how long each key is held down
+#define PIANIST_CHORD_SPREAD_USEC       5000    // the notes of a chord are never quite together
+#define PIANIST_NEW_CHORD_USEC          10000   // the wanted chord moving this much later is a new chord
+
+CMidiLoopback::CMidiLoopback(const loopbackModel_t &model) : m_model(model)
+{
+    reset(false, false);
+}
+
+void CMidiLoopback::reset(bool virtualClock, bool loopOutput)
+{
+    m_random.seed(LOOPBACK_SEED);
+    m_virtualClock = virtualClock;
+    m_virtualTime = 0;
+    m_clock.start();
+    m_loopOutput = loopOutput;
+    m_link.clear();
+    m_linkFreeTime = 0;
+    m_keys.clear();
+    m_answeredChord.clear();
+    m_answeredDueIn = 0;
+    m_outputCount = 0;
+    m_inputCount = 0;
+    m_chordCount = 0;
+}
+
+// The events come out of the link in the order they went in
+void CMidiLoopback::sendToLink(const CMidiEvent &event, qint64 time)
+{
+    std::uniform_int_distribution<int> jitter(0, qMax(0, m_model.jitter * 1000));
+    const qint64 arrival = qMax(time + m_model.delay * 1000 + jitter(m_random), m_linkFreeTime);
+    m_linkFreeTime = arrival;
+    m_link.emplace(arrival, event);
+}
+
+void CMidiLoopback::playMidiEvent(const CMidiEvent & event)
+{
+    m_outputCount++;
+    if (!m_loopOutput)
+        return;
+
+    switch (event.type())
+    {
+    case MIDI_NOTE_OFF:
+    case MIDI_NOTE_ON:
+    case MIDI_NOTE_PRESSURE:
+    case MIDI_CONTROL_CHANGE:
+    case MIDI_PROGRAM_CHANGE:
+    case MIDI_CHANNEL_PRESSURE:
+    case MIDI_PITCH_BEND:
+        sendToLink(event, now());
+        break;
+    default:
+        break; // our own meta events and the raw sysex data never reach the link
+    }
+}
+
+// the keys the virtual pianist has pressed or let go of so far go on to the link
+void CMidiLoopback::pressKeys()
+{
+    const qint64 time = now();
+    while (!m_keys.empty() && m_keys.begin()->first <= time)
+    {
+        sendToLink(m_keys.begin()->second, m_keys.begin()->first);
+        m_keys.erase(m_keys.begin());
+    }
+}
+
+int CMidiLoopback::checkMidiInput()
+{
+    pressKeys();
+    if (m_link.empty() || m_link.begin()->first > now())
+        return 0;
+    return 1;
+}
+
+CMidiEvent CMidiLoopback::readMidiInput()
+{
+    const CMidiEvent event = m_link.begin()->second;
+    m_link.erase(m_link.begin());
+    m_inputCount++;
+    return event;
+}
+
+qint64 CMidiLoopback::midiInputTimeStamp()
+{
+    if (m_link.empty())
+        return -1;
+    return m_link.begin()->first;
+}
+
+static bool sameNotes(CChord &a, CChord &b)
+{
+    if (a.length() != b.length())
+        return false;
+    for (int i = 0; i < a.length(); i++)
+    {
+        if (a.getNote(i).pitch() != b.getNote(i).pitch())
+            return false;
+    }
+    return true;
+}
+
+// The virtual pianist plays each chord when it is due, give or take the chosen timing
+void CMidiLoopback::pianistTask(CSong* song)
+{
+    CChord chord = song->getWantedChord();
+    const qint64 dueIn = song->wantedChordDueIn();
+    if (chord.length() == 0)
+    {
+        m_answeredChord.clear();
+        return;
+    }
+
+    // the next chord can have the same notes, but then it is further away
+    const bool newChord = !sameNotes(chord, m_answeredChord) || dueIn > m_answeredDueIn + PIANIST_NEW_CHORD_USEC;
+    m_answeredDueIn = dueIn;
+    if (!newChord)
+        return;
+    m_answeredChord = chord;
+    m_chordCount++;
+
+    // with no spread the pianist is perfect, the notes of the chord go down together right on time
+    qint64 offset = m_model.pianistOffset * 1000;
+    if (m_model.pianistSpread > 0)
+    {
+        std::normal_distribution<double> timing(static_cast<double>(offset), m_model.pianistSpread * 1000.0);
+        offset = static_cast<qint64>(timing(m_random));
+    }
+    std::uniform_int_distribution<int> chordSpread(0, (m_model.pianistSpread > 0) ? PIANIST_CHORD_SPREAD_USEC : 0);
+    const qint64 time = now();
+    const qint64 playTime = qMax(time, time + qMax<qint64>(0, dueIn) + offset);
+    for (int i = 0; i < chord.length(); i++)
+    {
+        const int note = chord.getNote(i).pitch() + song->getTranspose();
+        const qint64 pressTime = playTime + chordSpread(m_random);
+
+        // a key still held from the last chord has to be let go of first
+        for (auto key = m_keys.begin(); key != m_keys.end(); ++key)
+        {
+            if (key->second.type() == MIDI_NOTE_OFF && key->second.note() == note && key->first >= pressTime)
+            {
+                const CMidiEvent release = key->second;
+                m_keys.erase(key);
+                m_keys.emplace(pressTime - 1, release);
+                break;
+            }
+        }
+
+        CMidiEvent event;
+        event.noteOnEvent(0, 0, note, PIANIST_VELOCITY);
+        m_keys.emplace(pressTime, event);
+        event.noteOffEvent(0, 0, note, 0);
+        m_keys.emplace(pressTime + PIANIST_HOLD_USEC, event);
+    }
+}
+
+bool CMidiLoopback::runLatency(CSong* song, QTextStream &report)
+{
+    reset(false, true);
+    report << "# PianoBooster loopback latency\n";
+    report << QString::asprintf("# model delay %d jitter %d msec\n", m_model.delay, m_model.jitter);
+
+    // the clicks are sent and timed in real time, just like with a loopback cable
+    song->setReplayDevice(this);
+    song->startLatencyCalibration(CALIBRATE_loopback);
+    CLatencyCalibration* calibration = song->getLatencyCalibration();
+    while (!calibration->isFinished())
+    {
+        song->latencyCalibrationTask();
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOOPBACK_CALIBRATION_TICK_MSEC));
+    }
+    song->stopLatencyCalibration();
+    song->setReplayDevice(nullptr);
+
+    int latency;
+    int jitter;
+    const bool ok = calibration->getResult(&latency, &jitter);
+    if (ok)
+        report << QString::asprintf("# result latency %d jitter %d msec (expected %.1f), %d clicks ignored\n",
+                                    latency, jitter, m_model.delay + m_model.jitter / 2.0, calibration->getRejectedClicks());
+    else
+        report << QString::asprintf("# result failed, %d clicks were lost\n", calibration->getRejectedClicks());
+    report << QString::asprintf("# events out %lld in %lld\n", m_outputCount, m_inputCount);
+    report.flush();
+    return ok;
+}
+
+bool CMidiLoopback::runFollow(CSong* song, QTextStream &report)
+{
+    const qint64 tickRate = (Cfg::tickRate > 0) ? Cfg::tickRate : 4;
+    const playMode_t savedMode = CConductor::getPlayMode();
+
+    reset(true, false);
+    report << "# PianoBooster loopback follow\n";
+    report << "# song: " << song->getSongTitle() << "\n";
+    report << QString::asprintf("# model delay %d jitter %d msec, pianist offset %d spread %d msec, tick %lld msec\n",
+                                m_model.delay, m_model.jitter, m_model.pianistOffset, m_model.pianistSpread, tickRate);
+
+    song->setReplayDevice(this);
+    song->setPlayMode(PB_PLAY_MODE_followYou);
+    song->rewind();
+    song->playMusic(true);
+
+    QElapsedTimer realTime;
+    realTime.start();
+    qint64 ticks = 0;
+    qint64 waitingTime = 0;
+    bool finished = false;
+    while (m_virtualTime <= LOOPBACK_MAX_SONG_USEC)
+    {
+        pianistTask(song);
+        const eventBits_t eventBits = song->task(tickRate);
+        ticks++;
+        if (song->isWaitingForPianist())
+            waitingTime += tickRate * 1000;
+        if ((eventBits & EVENT_BITS_UptoBarReached) != 0)
+            song->playFromStartBar();
+        if ((eventBits & EVENT_BITS_playingStopped) != 0)
+        {
+            finished = true;
+            break;
+        }
+        m_virtualTime += tickRate * 1000;
+    }
+    const double realSeconds = static_cast<double>(realTime.nsecsElapsed()) / 1e9;
+
+    song->playMusic(false);
+    song->setPlayMode(savedMode);
+    song->setReplayDevice(nullptr);
+
+    const double songSeconds = static_cast<double>(m_virtualTime) / 1e6;
+    CRating* rating = song->getRating();
+    report << QString::asprintf("# result %s after %.1f sec, %lld chords played, waited for the pianist for %.1f sec\n",
+                                finished ? "finished" : "gave up", songSeconds, m_chordCount,
+                                static_cast<double>(waitingTime) / 1e6);
+    report << QString::asprintf("# rating total %d wrong %d late %d rating %.1f%%\n",
+                                rating->totalNoteCount(), rating->wrongNoteCount(), rating->lateNoteCount(),
+                                rating->rating());
+    report << QString::asprintf("# throughput %lld ticks in %.3f sec (%.1f usec a tick, %.0f times real time), events out %lld in %lld\n",
+                                ticks, realSeconds, (ticks > 0) ? realSeconds * 1e6 / ticks : 0.0,
+                                (realSeconds > 0.0) ? songSeconds / realSeconds : 0.0, m_outputCount, m_inputCount);
+    // a perfect pianist is only ever behind by the link, which is well inside the play zone
+    bool ok = finished;
+    if (m_model.pianistOffset == 0 && m_model.pianistSpread == 0 && rating->lateNoteCount() > 0)
+    {
+        report << "# error the perfect pianist was late\n";
+        ok = false;
+    }
+    report.flush();
+    return ok;
+}
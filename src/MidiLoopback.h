@@ -0,0 +1,119 @@
+/*********************************************************************************/
+/*!
+@file           MidiLoopback.h
+
+@brief          A MIDI loopback with a model of the link and a virtual pianist for testing without hardware.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __MIDI_LOOPBACK_H__
+#define __MIDI_LOOPBACK_H__
+
+#include <map>
+#include <random>
+
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include "Chord.h"
+#include "MidiDeviceBase.h"
+
+class CSong;
+
+typedef struct
+{
+    int delay;          // msec for an event to get along the MIDI link
+    int jitter;         // up to this many msec more at random
+    int pianistOffset;  // msec the virtual pianist plays after each chord is due (negative is early)
+    int pianistSpread;  // msec, the standard deviation of the virtual pianist's timing
+} loopbackModel_t;
+
+/*!
+ * @brief   A MIDI device that needs no hardware, for measuring the MIDI path anywhere.
+ *
+ * Everything going into the MIDI input is passed along a modelled MIDI link with a fixed
+ * delay plus some random jitter (the events can't overtake each other on the link).
+ * In the latency test the MIDI output is looped straight back and measured with
+ * CLatencyCalibration in real time. In the follow test a virtual pianist plays each wanted
+ * chord with the chosen timing and the song is run as fast as possible on a virtual clock.
+ * The random numbers always start from the same seed so the runs can be compared.
+ */
+class CMidiLoopback : public CMidiDeviceBase
+{
+public:
+    explicit CMidiLoopback(const loopbackModel_t &model);
+
+    static loopbackModel_t defaultModel() {return {5, 2, 0, 30};}
+
+    //! measure the round trip latency of the loopback, returns false on an error
+    bool runLatency(CSong* song, QTextStream &report);
+    //! the virtual pianist plays the song in follow you mode, returns false on an error
+    bool runFollow(CSong* song, QTextStream &report);
+
+    virtual void init() {}
+    virtual void playMidiEvent(const CMidiEvent & event);
+    virtual int checkMidiInput();
+    virtual CMidiEvent readMidiInput();
+    virtual qint64 midiInputTimeStamp();
+
+    virtual QStringList getMidiPortList(midiType_t type) { Q_UNUSED(type) return QStringList(); }
+    virtual bool openMidiPort(midiType_t type, const QString &portName) { Q_UNUSED(type) Q_UNUSED(portName) return true; }
+    virtual bool validMidiConnection() {return true;}
+    virtual void closeMidiPort(midiType_t type, int index) { Q_UNUSED(type) Q_UNUSED(index) }
+
+    virtual int     midiSettingsSetStr(const QString &name, const QString &str) { Q_UNUSED(name) Q_UNUSED(str) return 0; }
+    virtual int     midiSettingsSetNum(const QString &name, double val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual int     midiSettingsSetInt(const QString &name, int val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual QString midiSettingsGetStr(const QString &name) { Q_UNUSED(name) return QString(); }
+    virtual double  midiSettingsGetNum(const QString &name) { Q_UNUSED(name) return 0.0; }
+    virtual int     midiSettingsGetInt(const QString &name) { Q_UNUSED(name) return 0; }
+
+private:
+    void reset(bool virtualClock, bool loopOutput);
+    qint64 now() {return m_virtualClock ? m_virtualTime : m_clock.nsecsElapsed() / 1000;}
+    void sendToLink(const CMidiEvent &event, qint64 time);
+    void pianistTask(CSong* song);
+    void pressKeys();
+
+    loopbackModel_t m_model;
+    std::mt19937 m_random;
+
+    bool m_virtualClock;
+    qint64 m_virtualTime;   // usec
+    QElapsedTimer m_clock;
+    bool m_loopOutput;
+
+    std::multimap<qint64, CMidiEvent> m_link;   // by the time they come out of the link (usec)
+    qint64 m_linkFreeTime;                      // when the last event comes out of the link
+    std::multimap<qint64, CMidiEvent> m_keys;   // the virtual pianist's key presses and releases to come
+
+    // the virtual pianist
+    CChord m_answeredChord;
+    qint64 m_answeredDueIn;
+
+    qint64 m_outputCount;
+    qint64 m_inputCount;
+    qint64 m_chordCount;
+};
+
+#endif //__MIDI_LOOPBACK_H__
@@ -0,0 +1,322 @@
+/*********************************************************************************/
+/*!
+@file           MidiRecorder.cpp
+
+@brief          Records the pianist and the accompaniment to a standard MIDI file.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <chrono>
+#include <cstring>
+
+#include <QFile>
+
+#include "MidiRecorder.h"
+
+#define RECORDER_QUEUE_SIZE     8192    // about 10 seconds of very busy music
+#define RECORDER_POLL_MSEC      20      // how often the writer thread empties the queue
+#define DEVICE_CLOCK_SLACK      50000   // usec the device clock may lag before it is re-synced
+
+static const char* const trackNames[CMidiRecorder::RECORDED_TRACKS] = {"Pianist", "Accompaniment"};
+
+CMidiRecorder::CMidiRecorder() : m_eventQueue(RECORDER_QUEUE_SIZE)
+{
+    m_recording = false;
+    m_stopWriter = false;
+    m_deviceTimeOffset = 0;
+    m_deviceTimeSynced = false;
+    for (int track = 0; track < RECORDED_TRACKS; track++)
+    {
+        m_spoolFile[track] = nullptr;
+        m_spoolTick[track] = 0;
+    }
+}
+
+CMidiRecorder::~CMidiRecorder()
+{
+    stop();
+}
+
+bool CMidiRecorder::start(const QString &fileName)
+{
+    stop();
+
+    for (int track = 0; track < RECORDED_TRACKS; track++)
+    {
+        m_spoolFile[track] = std::tmpfile();
+        m_spoolTick[track] = 0;
+        if (m_spoolFile[track] == nullptr)
+        {
+            ppLogError("Cannot create the recording spool file");
+            closeSpoolFiles();
+            return false;
+        }
+    }
+
+    // throw away anything left over from the last recording
+    recordedEvent_t record;
+    while (m_eventQueue.pop(&record))
+        ;
+
+    m_fileName = fileName;
+    m_deviceTimeOffset = 0;
+    m_deviceTimeSynced = false;
+    m_clock.start();
+    m_stopWriter = false;
+    m_writerThread = std::thread(&CMidiRecorder::writerThread, this);
+    m_recording = true;
+    ppLogInfo("Recording to \"%s\"", qPrintable(m_fileName));
+    return true;
+}
+
+void CMidiRecorder::stop()
+{
+    if (!m_writerThread.joinable())
+        return;
+
+    m_recording = false;
+    m_stopWriter = true;
+    m_writerThread.join();
+
+    if (m_eventQueue.dropped() > 0)
+        ppLogWarn("The recorder could not keep up, %u events were lost", m_eventQueue.dropped());
+}
+
+void CMidiRecorder::recordPianist(const CMidiEvent &event, qint64 deviceTime)
+{
+    if (!isRecording())
+        return;
+
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    qint64 time = now;
+    if (deviceTime >= 0)
+    {
+        if (!m_deviceTimeSynced)
+        {
+            m_deviceTimeOffset = now - deviceTime;
+            m_deviceTimeSynced = true;
+        }
+        time = deviceTime + m_deviceTimeOffset;
+
+        // The two clocks drift apart (or the device was reopened) so re-sync them
+        if (time > now || time < now - DEVICE_CLOCK_SLACK)
+        {
+            m_deviceTimeOffset = now - deviceTime;
+            time = now;
+        }
+    }
+    pushEvent(TRACK_PIANIST, event, time);
+}
+
+void CMidiRecorder::recordAccompaniment(const CMidiEvent &event)
+{
+    if (!isRecording())
+        return;
+
+    pushEvent(TRACK_ACCOMPANIMENT, event, m_clock.nsecsElapsed() / 1000);
+}
+
+void CMidiRecorder::recordMarker(const char* text)
+{
+    if (!isRecording())
+        return;
+
+    pushEvent(TRACK_PIANIST, CMidiEvent(), m_clock.nsecsElapsed() / 1000, text);
+}
+
+void CMidiRecorder::pushEvent(int track, const CMidiEvent &event, qint64 time, const char* marker)
+{
+    recordedEvent_t record;
+    record.time = time;
+    record.track = track;
+    record.event = event;
+    record.marker = marker;
+    m_eventQueue.push(record); // never waits, drops the event if the writer is too far behind
+}
+
+void CMidiRecorder::writerThread()
+{
+    recordedEvent_t record;
+
+    while (true)
+    {
+        const bool stopping = m_stopWriter.load();
+        while (m_eventQueue.pop(&record))
+            spoolEvent(record);
+        if (stopping)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(RECORDER_POLL_MSEC));
+    }
+
+    if (!writeMidiFile())
+        ppLogError("Cannot write the recording \"%s\"", qPrintable(m_fileName));
+    closeSpoolFiles();
+}
+
+static void putVarLen(std::FILE* file, quint32 value)
+{
+    quint32 buffer = value & 0x7f;
+    while ((value >>= 7) > 0)
+    {
+        buffer <<= 8;
+        buffer |= 0x80 | (value & 0x7f);
+    }
+    while (true)
+    {
+        std::fputc(static_cast<int>(buffer & 0xff), file);
+        if ((buffer & 0x80) == 0)
+            break;
+        buffer >>= 8;
+    }
+}
+
+void CMidiRecorder::spoolEvent(recordedEvent_t &record)
+{
+    CMidiEvent &event = record.event;
+    int dataBytes = 0;
+
+    switch (event.type())
+    {
+    case MIDI_NONE:
+        if (record.marker == nullptr)
+            return;
+        break;
+    case MIDI_NOTE_OFF:
+    case MIDI_NOTE_ON:
+    case MIDI_NOTE_PRESSURE:
+    case MIDI_CONTROL_CHANGE:
+    case MIDI_PITCH_BEND:
+        dataBytes = 2;
+        break;
+    case MIDI_PROGRAM_CHANGE:
+    case MIDI_CHANNEL_PRESSURE:
+        dataBytes = 1;
+        break;
+    default:
+        return; // our own meta events and the raw sysex data are not recorded
+    }
+
+    std::FILE* file = m_spoolFile[record.track];
+    // one tick per msec, events on the same track must never go backwards
+    qint64 tick = record.time / 1000;
+    if (tick < m_spoolTick[record.track])
+        tick = m_spoolTick[record.track];
+    putVarLen(file, static_cast<quint32>(tick - m_spoolTick[record.track]));
+    m_spoolTick[record.track] = tick;
+
+    if (record.marker != nullptr)
+    {
+        const auto length = strlen(record.marker);
+        std::fputc(METAEVENT, file);
+        std::fputc(METAMARKER, file);
+        putVarLen(file, static_cast<quint32>(length));
+        std::fwrite(record.marker, 1, length, file);
+        return;
+    }
+
+    std::fputc(event.type() | (event.channel() & 0x0f), file);
+    std::fputc(event.data1() & 0x7f, file);
+    if (dataBytes == 2)
+        std::fputc(event.data2() & 0x7f, file);
+}
+
+static void writeBytes(QFile &file, const unsigned char *bytes, size_t length)
+{
+    file.write(reinterpret_cast<const char*>(bytes), static_cast<qint64>(length));
+}
+
+static void writeWord(QFile &file, int value)
+{
+    const unsigned char bytes[2] = {static_cast<unsigned char>(value >> 8), static_cast<unsigned char>(value)};
+    writeBytes(file, bytes, sizeof(bytes));
+}
+
+static void writeDWord(QFile &file, quint32 value)
+{
+    writeWord(file, static_cast<int>(value >> 16));
+    writeWord(file, static_cast<int>(value & 0xffff));
+}
+
+bool CMidiRecorder::writeMidiFile()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    file.write("MThd", 4);
+    writeDWord(file, 6);
+    writeWord(file, 1);                    // type 1 MIDI file
+    writeWord(file, RECORDED_TRACKS + 1);  // the tempo track plus the recorded tracks
+    writeWord(file, RECORDER_PPQN);
+
+    // The tempo track
+    const unsigned char tempoTrack[] = {
+        0, METAEVENT, METATEMPO, 3,
+            (RECORDER_MIDI_TEMPO >> 16) & 0xff, (RECORDER_MIDI_TEMPO >> 8) & 0xff, RECORDER_MIDI_TEMPO & 0xff,
+        0, METAEVENT, METATIMESIG, 4, 4, 2, 24, 8,
+        0, METAEVENT, METAEOT, 0
+    };
+    file.write("MTrk", 4);
+    writeDWord(file, sizeof(tempoTrack));
+    writeBytes(file, tempoTrack, sizeof(tempoTrack));
+
+    const unsigned char endOfTrack[] = {0, METAEVENT, METAEOT, 0};
+    char buffer[4096];
+    for (int track = 0; track < RECORDED_TRACKS; track++)
+    {
+        std::FILE* spool = m_spoolFile[track];
+        const long spoolLength = std::ftell(spool);
+        const auto nameLength = static_cast<unsigned char>(strlen(trackNames[track]));
+
+        file.write("MTrk", 4);
+        writeDWord(file, static_cast<quint32>(4 + nameLength + spoolLength + sizeof(endOfTrack)));
+        const unsigned char nameHeader[] = {0, METAEVENT, METATNAME, nameLength};
+        writeBytes(file, nameHeader, sizeof(nameHeader));
+        file.write(trackNames[track], nameLength);
+
+        std::rewind(spool);
+        size_t length;
+        while ((length = std::fread(buffer, 1, sizeof(buffer), spool)) > 0)
+            file.write(buffer, static_cast<qint64>(length));
+        writeBytes(file, endOfTrack, sizeof(endOfTrack));
+    }
+
+    file.close();
+    if (file.error() != QFileDevice::NoError)
+    {
+        ppLogError("Cannot write the recording \"%s\"", qPrintable(m_fileName));
+        return false;
+    }
+    ppLogInfo("Recording saved to \"%s\"", qPrintable(m_fileName));
+    return true;
+}
+
+void CMidiRecorder::closeSpoolFiles()
+{
+    for (int track = 0; track < RECORDED_TRACKS; track++)
+    {
+        if (m_spoolFile[track] != nullptr)
+            std::fclose(m_spoolFile[track]);
+        m_spoolFile[track] = nullptr;
+    }
+}
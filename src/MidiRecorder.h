@@ -0,0 +1,109 @@
+/*********************************************************************************/
+/*!
+@file           MidiRecorder.h
+
+@brief          Records the pianist and the accompaniment to a standard MIDI file.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __MIDI_RECORDER_H__
+#define __MIDI_RECORDER_H__
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include "MidiEvent.h"
+#include "RingBuffer.h"
+
+// The recorded file uses one tick per msec (500 ticks per beat at 120 BPM)
+#define RECORDER_PPQN           500
+#define RECORDER_MIDI_TEMPO     500000
+
+// markers saved in the pianist track when the music is started and stopped
+#define RECORDER_MARKER_START   "Start"
+#define RECORDER_MARKER_STOP    "Stop"
+
+/*!
+ * @brief   Taps the events going in and out of the conductor and saves them as a type 1 MIDI file.
+ *
+ * The engine side only pushes into a fixed size lock-free ring buffer, a background thread
+ * drains it into temporary spool files so long sessions don't use any more memory.
+ * The MIDI file is assembled from the spool files when the recording is stopped.
+ */
+class CMidiRecorder
+{
+public:
+    CMidiRecorder();
+    ~CMidiRecorder();
+
+    bool start(const QString &fileName);
+    void stop();
+    bool isRecording() const {return m_recording.load(std::memory_order_relaxed);}
+
+    //! record the pianist input, deviceTime is in usec from the MIDI input device (-1 if not known)
+    void recordPianist(const CMidiEvent &event, qint64 deviceTime);
+    //! record an event that has been sent to the MIDI output
+    void recordAccompaniment(const CMidiEvent &event);
+    //! add a marker to the pianist track (the text must be a string literal)
+    void recordMarker(const char* text);
+
+    enum {
+        TRACK_PIANIST,
+        TRACK_ACCOMPANIMENT,
+        RECORDED_TRACKS
+    };
+
+private:
+    typedef struct
+    {
+        qint64 time; // in usec
+        int track;
+        CMidiEvent event;
+        const char* marker; // only used for markers
+    } recordedEvent_t;
+
+    void pushEvent(int track, const CMidiEvent &event, qint64 time, const char* marker = nullptr);
+    void writerThread();
+    void spoolEvent(recordedEvent_t &record);
+    bool writeMidiFile();
+    void closeSpoolFiles();
+
+    CRingBuffer<recordedEvent_t> m_eventQueue;
+    std::thread m_writerThread;
+    std::atomic<bool> m_recording;
+    std::atomic<bool> m_stopWriter;
+    QElapsedTimer m_clock;
+    qint64 m_deviceTimeOffset;  // maps the MIDI input device clock onto m_clock
+    bool m_deviceTimeSynced;    // the offset can be negative so it needs its own flag
+
+    // only used by the writer thread
+    QString m_fileName;
+    std::FILE* m_spoolFile[RECORDED_TRACKS];
+    qint64 m_spoolTick[RECORDED_TRACKS];
+};
+
+#endif //__MIDI_RECORDER_H__
@@ -94,6 +94,7 @@ void CPiano::drawPianoInputNoteNames()
     {
         drawNoteName(m_noteNameList[i].pitch, Cfg::playZoneX() - PIANO_LINE_LENGTH_SHORT - 14, m_noteNameList[i].posY, m_noteNameList[i].type);
     }
+    flushText();
 }
 
 void CPiano::drawPianoInputLines(CChord* chord, CColor color, int lineLength)
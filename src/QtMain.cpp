@@ -25,6 +25,7 @@
 
 #include "QtWindow.h"
 #include "version.h"
+#include "Trace.h"
 
 int main(int argc, char *argv[]){
     QCoreApplication::setOrganizationName(QStringLiteral("PianoBooster"));
@@ -49,6 +50,7 @@ int main(int argc, char *argv[]){
     window.show();
 
     int value = app.exec();
+    CTrace::stop();
     closeLogs();
     return value;
 }
@@ -27,6 +27,10 @@
 #include "GlView.h"
 #include "QtWindow.h"
 #include "version.h"
+#include "Trace.h"
+#if WITH_INTERNAL_FLUIDSYNTH
+#include "AudioRender.h"
+#endif
 
 #include <QDebug>
 #include <QSurfaceFormat>
@@ -63,6 +67,7 @@ QtWindow::QtWindow()
     setWindowTitle(tr("Piano Booster"));
 
     Cfg::setDefaults();
+    m_loopbackModel = CMidiLoopback::defaultModel();
 
     decodeCommandLine();
 
@@ -127,7 +132,7 @@ QtWindow::QtWindow()
     m_song->setPianoSoundPatches(m_settings->value("Keyboard/RightSound", Cfg::defaultRightPatch()).toInt() - 1,
                                  m_settings->value("Keyboard/WrongSound", Cfg::defaultWrongPatch()).toInt() - 1, true);
 
-    m_song->setLatencyFix(m_settings->value("Midi/Latency", 0).toInt());
+    m_song->setLatencyFix(m_settings->getLatencyFix(m_settings->value("Midi/Output").toString()));
 
     m_song->cfg_timingMarkersFlag = m_settings->value("Score/TimingMarkers", m_song->cfg_timingMarkersFlag ).toBool();
     m_song->cfg_stopPointMode = static_cast<stopPointMode_t> (m_settings->value("Score/StopPointMode", m_song->cfg_stopPointMode ).toInt());
@@ -141,6 +146,12 @@ QtWindow::QtWindow()
         QString songName = m_settings->value("CurrentSong").toString();
         if (!songName.isEmpty())
             m_settings->openSongFile( songName );
+        if (!m_replayFile.isEmpty())
+            runReplay();
+        else if (!m_renderFile.isEmpty())
+            runRender();
+        else if (!m_loopbackTest.isEmpty())
+            runLoopback();
     });
 }
 
@@ -159,6 +170,8 @@ void QtWindow::init()
 
 QtWindow::~QtWindow()
 {
+    if (!m_engineStatsFile.isEmpty())
+        m_song->getEngineStats()->dump(m_engineStatsFile);
     delete m_settings;
 }
 
@@ -169,11 +182,29 @@ void QtWindow::displayUsage()
     fprintf(stdout, "Usage: pianobooster [flags] [midifile]\n");
     fprintf(stdout, "  -d, --debug             Increase the debug level.\n");
     fprintf(stdout, "      --Xnote-length      Displays the note length (experimental)\n");
+    fprintf(stdout, "      --Xaudio-clock      Places the internal sound events by the audio clock (experimental)\n");
     fprintf(stdout, "  -h, --help              Displays this help message.\n");
     fprintf(stdout, "  -v, --version           Displays version number and then exits.\n");
     fprintf(stdout, "  -l   --log              Write debug info to the \"pb.log\" log file.\n");
     fprintf(stdout, "       --midi-input-dump  Displays the midi input in hex.\n");
     fprintf(stdout, "       --lights           Turns on the keyboard lights.\n");
+    fprintf(stdout, "       --trace=FILE       Writes a trace of the timing that can be viewed in Perfetto.\n");
+    fprintf(stdout, "       --engine-stats=FILE  Writes the engine timing histograms to a file on exit.\n");
+    fprintf(stdout, "       --replay=FILE      Replays a recorded performance of the midifile as fast as possible\n");
+    fprintf(stdout, "                          then exits (a report is written to stdout).\n");
+    fprintf(stdout, "       --replay-report=FILE  Writes the replay report to a file.\n");
+    fprintf(stdout, "       --loopback=TEST    Tests the MIDI path without any hardware then exits (a report is\n");
+    fprintf(stdout, "                          written to stdout). TEST is \"latency\" to measure the round trip or\n");
+    fprintf(stdout, "                          \"follow\" for a virtual pianist to play the midifile in follow you mode.\n");
+    fprintf(stdout, "       --loopback-delay=MSEC  --loopback-jitter=MSEC  The model of the MIDI link.\n");
+    fprintf(stdout, "       --pianist-offset=MSEC  --pianist-spread=MSEC   The average and the standard\n");
+    fprintf(stdout, "                          deviation of the virtual pianist's timing. With both at 0 the\n");
+    fprintf(stdout, "                          follow test fails if any note is late.\n");
+#if WITH_INTERNAL_FLUIDSYNTH
+    fprintf(stdout, "       --render=FILE      Renders the midifile to an audio file (eg .wav or .flac) with the\n");
+    fprintf(stdout, "                          internal sound as fast as possible then exits. The muted parts and\n");
+    fprintf(stdout, "                          the volume settings are used just as when playing along.\n");
+#endif
 }
 
 int QtWindow::decodeIntegerParam(const QString &arg, int defaultParam)
@@ -267,6 +298,8 @@ void QtWindow::decodeCommandLine()
                 Cfg::logLevel++;
             else if (arg.startsWith("--Xnote-length"))
                 Cfg::experimentalNoteLength = true;
+            else if (arg.startsWith("--Xaudio-clock"))
+                Cfg::experimentalAudioClock = true;
             else if (arg.startsWith("--Xtick-rate")) {
                 if (validateIntegerParamWithMessage(arg)) {
                     Cfg::tickRate = decodeIntegerParam(arg, 12);
@@ -283,6 +316,28 @@ void QtWindow::decodeCommandLine()
             else if (arg.startsWith("--lights"))
                 Cfg::keyboardLightsChan = 1-1;  // Channel 1 (really a zero)
 
+            else if (arg.startsWith("--trace="))
+                CTrace::start(arg.mid(arg.indexOf('=') + 1));
+            else if (arg.startsWith("--engine-stats="))
+                m_engineStatsFile = arg.mid(arg.indexOf('=') + 1);
+
+            else if (arg.startsWith("--replay-report="))
+                m_replayReportFile = arg.mid(arg.indexOf('=') + 1);
+            else if (arg.startsWith("--replay="))
+                m_replayFile = arg.mid(arg.indexOf('=') + 1);
+            else if (arg.startsWith("--render="))
+                m_renderFile = arg.mid(arg.indexOf('=') + 1);
+            else if (arg.startsWith("--loopback-delay="))
+                m_loopbackModel.delay = decodeIntegerParam(arg, m_loopbackModel.delay);
+            else if (arg.startsWith("--loopback-jitter="))
+                m_loopbackModel.jitter = decodeIntegerParam(arg, m_loopbackModel.jitter);
+            else if (arg.startsWith("--loopback="))
+                m_loopbackTest = arg.mid(arg.indexOf('=') + 1);
+            else if (arg.startsWith("--pianist-offset="))
+                m_loopbackModel.pianistOffset = decodeIntegerParam(arg, m_loopbackModel.pianistOffset);
+            else if (arg.startsWith("--pianist-spread="))
+                m_loopbackModel.pianistSpread = decodeIntegerParam(arg, m_loopbackModel.pianistSpread);
+
             else if (arg.startsWith("-h") || arg.startsWith("-?") || arg.startsWith("--help"))
             {
                 displayUsage();
@@ -370,6 +425,11 @@ void QtWindow::createActions()
     }
     connect(m_viewPianoKeyboard, SIGNAL(triggered()), this, SLOT(onViewPianoKeyboard()));
 
+    m_engineStatsAct = new QAction(tr("&Engine Statistics"), this);
+    m_engineStatsAct->setToolTip(tr("Show how well the MIDI timing is keeping up"));
+    m_engineStatsAct->setCheckable(true);
+    connect(m_engineStatsAct, SIGNAL(triggered()), this, SLOT(onViewEngineStats()));
+
     m_setupPreferencesAct = new QAction(tr("&Preferences ..."), this);
     m_setupPreferencesAct->setToolTip(tr("Settings"));
     m_setupPreferencesAct->setShortcut(tr("Ctrl+P"));
@@ -380,6 +440,11 @@ void QtWindow::createActions()
     m_songDetailsAct->setShortcut(tr("Ctrl+D"));
     connect(m_songDetailsAct, SIGNAL(triggered()), this, SLOT(showSongDetailsDialog()));
 
+    m_recordSessionAct = new QAction(tr("&Record Session ..."), this);
+    m_recordSessionAct->setToolTip(tr("Save what you play and the accompaniment to a MIDI file"));
+    m_recordSessionAct->setCheckable(true);
+    connect(m_recordSessionAct, SIGNAL(triggered()), this, SLOT(onRecordSession()));
+
     QAction* act = new QAction(this);
     act->setShortcut(tr("Shift+F1"));
     connect(act, SIGNAL(triggered()), this, SLOT(enableFollowTempo()));
@@ -427,10 +492,12 @@ void QtWindow::createMenus()
     m_viewMenu->addAction(m_sidePanelStateAct);
     m_viewMenu->addAction(m_fullScreenStateAct);
     m_viewMenu->addAction(m_viewPianoKeyboard);
+    m_viewMenu->addAction(m_engineStatsAct);
 
     m_songMenu = menuBar()->addMenu(tr("&Song"));
     m_songMenu->setToolTipsVisible(true);
     m_songMenu->addAction(m_songDetailsAct);
+    m_songMenu->addAction(m_recordSessionAct);
 
     m_setupMenu = menuBar()->addMenu(tr("Set&up"));
     m_setupMenu->setToolTipsVisible(true);
@@ -475,6 +542,111 @@ void QtWindow::showMidiSetup(){
     m_glWidget->startTimerEvent();
 }
 
+// Replays a recorded performance (see CReplay) and then exits
+void QtWindow::runReplay()
+{
+    // the score needs the GL context
+    if (!m_glWidget->isValid())
+    {
+        QTimer::singleShot(100, this, &QtWindow::runReplay);
+        return;
+    }
+
+    m_glWidget->stopTimerEvent();
+    CReplay replay;
+    bool ok = replay.loadPerformance(m_replayFile);
+    if (ok)
+    {
+        QFile reportFile(m_replayReportFile);
+        QTextStream report(stdout);
+        if (!m_replayReportFile.isEmpty())
+        {
+            if (reportFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+                report.setDevice(&reportFile);
+            else
+                fprintf(stderr, "ERROR: Cannot write the replay report \"%s\".\n", qPrintable(m_replayReportFile));
+        }
+        m_glWidget->makeCurrent();
+        ok = replay.run(m_song, report);
+        m_glWidget->doneCurrent();
+    }
+    QCoreApplication::exit(ok ? 0 : 1);
+}
+
+// Renders the song to an audio file (see CAudioRender) and then exits
+void QtWindow::runRender()
+{
+    // the score needs the GL context
+    if (!m_glWidget->isValid())
+    {
+        QTimer::singleShot(100, this, &QtWindow::runRender);
+        return;
+    }
+
+    bool ok = false;
+#if WITH_INTERNAL_FLUIDSYNTH
+    m_glWidget->stopTimerEvent();
+    CAudioRender render;
+    render.setQSettings(m_settings);
+    m_glWidget->makeCurrent();
+    ok = render.run(m_song, m_renderFile);
+    m_glWidget->doneCurrent();
+#else
+    fprintf(stderr, "ERROR: Rendering needs the internal sound.\n");
+#endif
+    if (!ok)
+        fprintf(stderr, "ERROR: Cannot render to \"%s\".\n", qPrintable(m_renderFile));
+    QCoreApplication::exit(ok ? 0 : 1);
+}
+
+// Tests the MIDI path through the loopback (see CMidiLoopback) and then exits
+void QtWindow::runLoopback()
+{
+    // the score needs the GL context
+    if (!m_glWidget->isValid())
+    {
+        QTimer::singleShot(100, this, &QtWindow::runLoopback);
+        return;
+    }
+
+    m_glWidget->stopTimerEvent();
+    CMidiLoopback loopback(m_loopbackModel);
+    QTextStream report(stdout);
+    bool ok = false;
+    m_glWidget->makeCurrent();
+    if (m_loopbackTest == "latency")
+        ok = loopback.runLatency(m_song, report);
+    else if (m_loopbackTest == "follow")
+        ok = loopback.runFollow(m_song, report);
+    else
+        fprintf(stderr, "ERROR: Unknown loopback test \"%s\".\n", qPrintable(m_loopbackTest));
+    m_glWidget->doneCurrent();
+    QCoreApplication::exit(ok ? 0 : 1);
+}
+
+void QtWindow::onRecordSession()
+{
+    if (!m_recordSessionAct->isChecked())
+    {
+        m_song->stopRecording();
+        return;
+    }
+
+    m_glWidget->stopTimerEvent();
+    const auto dir = m_settings->value("Recording/Dir", QDir::homePath()).toString();
+    const auto fileName = QFileDialog::getSaveFileName(this, tr("Record Session"),
+                            dir, tr("MIDI Files") + " (*.mid *.MID *.midi *.MIDI)");
+    if (!fileName.isEmpty())
+    {
+        m_settings->setValue("Recording/Dir", QFileInfo(fileName).path());
+        if (!m_song->startRecording(fileName))
+            QMessageBox::warning(this, tr("Record Session"), tr("Cannot start the recording"));
+    }
+    m_recordSessionAct->setChecked(m_song->isRecording());
+    m_song->flushMidiInput();
+    m_glWidget->startTimerEvent();
+}
+
 // load the recent file list from the config file into the file menu
 void QtWindow::updateRecentFileActions()
 {
@@ -680,6 +852,7 @@ void QtWindow::closeEvent(QCloseEvent *event)
     {
         m_song->playMusic(false);
     }
+    m_song->stopRecording();
 
     writeSettings();
 }
@@ -39,6 +39,8 @@
 #include "GuiSongDetailsDialog.h"
 #include "GuiLoopingPopup.h"
 #include "Settings.h"
+#include "Replay.h"
+#include "MidiLoopback.h"
 
 class CGLView;
 class QAction;
@@ -86,6 +88,10 @@ private slots:
     void openRecentFile();
 
     void showMidiSetup();
+    void onRecordSession();
+    void runReplay();
+    void runRender();
+    void runLoopback();
 
     void showPreferencesDialog()
     {
@@ -124,6 +130,13 @@ private slots:
         }
     }
 
+    void onViewEngineStats()
+    {
+        if (m_engineStatsAct->isChecked())
+            m_song->getEngineStats()->reset();
+        m_glWidget->showEngineStats(m_engineStatsAct->isChecked());
+    }
+
     void onFullScreenStateAct () {
         if (m_fullScreenStateAct->isChecked())
             showFullScreen();
@@ -133,11 +146,11 @@ private slots:
 
     void enableFollowTempo()
     {
-        CTempo::enableFollowTempo(Cfg::experimentalTempo);
+        m_song->enableFollowTempo(Cfg::experimentalTempo);
     }
     void disableFollowTempo()
     {
-        CTempo::enableFollowTempo(false);
+        m_song->enableFollowTempo(false);
     }
 
     void on_rightHand()  {  m_sidePanel->setActiveHand(PB_PART_right); }
@@ -205,6 +218,12 @@ private:
     QMap<QAction*,QMap<QString,QString>> listActionsRetranslateUi;
 
     CGLView *m_glWidget;
+    QString m_replayFile;
+    QString m_replayReportFile;
+    QString m_renderFile;
+    QString m_loopbackTest;
+    loopbackModel_t m_loopbackModel;
+    QString m_engineStatsFile;
     QAction *m_openAct;
     QAction *m_exitAct;
     QAction *m_aboutAct;
@@ -214,9 +233,11 @@ private:
     QAction *m_setupKeyboardAct;
     QAction *m_sidePanelStateAct;
     QAction *m_viewPianoKeyboard;
+    QAction *m_engineStatsAct;
     QAction *m_fullScreenStateAct;
     QAction *m_setupPreferencesAct;
     QAction *m_songDetailsAct;
+    QAction *m_recordSessionAct;
 
     QMenu *m_fileMenu;
     QMenu *m_viewMenu;
@@ -0,0 +1,371 @@
+/*********************************************************************************/
+/*!
+@file           Replay.cpp
+
+@brief          Replays a recorded performance through the conductor on a virtual clock.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <algorithm>
+
+#include <QFile>
+
+#include "Replay.h"
+#include "Song.h"
+#include "MidiRecorder.h"
+
+#define REPLAY_DEFAULT_TEMPO    500000  // usec per beat (120 BPM)
+
+CReplay::CReplay()
+{
+    m_ppqn = DEFAULT_PPQN;
+    m_nextEvent = 0;
+    m_virtualTime = 0;
+    m_report = nullptr;
+}
+
+static int readWord(const QByteArray &data, int pos)
+{
+    return (static_cast<unsigned char>(data[pos]) << 8) | static_cast<unsigned char>(data[pos + 1]);
+}
+
+static qint64 readDWord(const QByteArray &data, int pos)
+{
+    return (static_cast<qint64>(readWord(data, pos)) << 16) | readWord(data, pos + 2);
+}
+
+bool CReplay::loadPerformance(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        ppLogError("Cannot open the performance \"%s\"", qPrintable(fileName));
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    if (data.size() < 14 || !data.startsWith("MThd") || readDWord(data, 4) != 6)
+    {
+        ppLogError("The performance \"%s\" is not a MIDI file", qPrintable(fileName));
+        return false;
+    }
+    const int ntrks = readWord(data, 10);
+    m_ppqn = readWord(data, 12);
+    if (m_ppqn <= 0 || (m_ppqn & 0x8000) != 0)
+    {
+        ppLogError("SMPTE time division is not supported");
+        return false;
+    }
+
+    m_performance.clear();
+    m_tempoMap.clear();
+    std::vector<std::vector<performanceEvent_t>> tracks;
+    int pianistTrack = -1;
+    int pos = 14;
+    for (int trk = 0; trk < ntrks; trk++)
+    {
+        if (pos + 8 > data.size() || data.mid(pos, 4) != "MTrk")
+            break;
+        const qint64 length = readDWord(data, pos + 4);
+        pos += 8;
+        if (pos + length > data.size())
+            break;
+
+        tracks.emplace_back();
+        QByteArray trackName;
+        if (!decodeTrack(data, pos, static_cast<int>(length), tracks.back(), trackName))
+        {
+            ppLogError("The performance \"%s\" is corrupted", qPrintable(fileName));
+            return false;
+        }
+        if (pianistTrack < 0 && trackName == "Pianist")
+            pianistTrack = trk;
+        pos += static_cast<int>(length);
+    }
+    if (tracks.empty())
+        return false;
+
+    // Not one of our recordings so guess that the pianist is on the first track with some notes on it
+    for (size_t trk = 0; pianistTrack < 0 && trk < tracks.size(); trk++)
+    {
+        for (const auto &perfEvent : tracks[trk])
+        {
+            if (perfEvent.event.type() == MIDI_NOTE_ON)
+            {
+                pianistTrack = static_cast<int>(trk);
+                break;
+            }
+        }
+    }
+    if (pianistTrack < 0)
+        pianistTrack = 0;
+    m_performance = tracks[static_cast<size_t>(pianistTrack)];
+
+    // now convert the ticks into usec using the tempo map
+    std::stable_sort(m_tempoMap.begin(), m_tempoMap.end(),
+                     [](const std::pair<qint64, int> &a, const std::pair<qint64, int> &b) {return a.first < b.first;});
+    for (auto &perfEvent : m_performance)
+    {
+        const qint64 tick = perfEvent.time;
+        qint64 lastTick = 0;
+        qint64 usec = 0;
+        int tempo = REPLAY_DEFAULT_TEMPO;
+        for (const auto &change : m_tempoMap)
+        {
+            if (change.first > tick)
+                break;
+            usec += (change.first - lastTick) * tempo / m_ppqn;
+            lastTick = change.first;
+            tempo = change.second;
+        }
+        perfEvent.time = usec + (tick - lastTick) * tempo / m_ppqn;
+    }
+
+    ppLogInfo("Loaded %d pianist events from \"%s\"", static_cast<int>(m_performance.size()), qPrintable(fileName));
+    return true;
+}
+
+bool CReplay::decodeTrack(const QByteArray &data, int pos, int length,
+                          std::vector<performanceEvent_t> &events, QByteArray &trackName)
+{
+    const int end = pos + length;
+    qint64 tick = 0;
+    int runningStatus = 0;
+
+    auto readVarLen = [&]() -> qint64 {
+        qint64 value = 0;
+        for (int i = 0; i < 4 && pos < end; i++)
+        {
+            const int c = static_cast<unsigned char>(data[pos++]);
+            value = (value << 7) | (c & 0x7f);
+            if ((c & 0x80) == 0)
+                break;
+        }
+        return value;
+    };
+
+    while (pos < end)
+    {
+        tick += readVarLen();
+        if (pos >= end)
+            return false;
+
+        int status = static_cast<unsigned char>(data[pos]);
+        if ((status & 0x80) == 0)
+            status = runningStatus; // running status, the data byte is read below
+        else
+            pos++;
+
+        if (status == METAEVENT)
+        {
+            if (pos >= end)
+                return false;
+            const int type = static_cast<unsigned char>(data[pos++]);
+            const int metaLength = static_cast<int>(readVarLen());
+            if (pos + metaLength > end)
+                return false;
+            if (type == METATEMPO && metaLength == 3)
+                m_tempoMap.emplace_back(tick, (static_cast<unsigned char>(data[pos]) << 16) | readWord(data, pos + 1));
+            else if (type == METATNAME)
+                trackName = data.mid(pos, metaLength);
+            else if (type == METAMARKER)
+            {
+                performanceEvent_t marker;
+                marker.time = tick;
+                marker.marker = data.mid(pos, metaLength);
+                events.push_back(marker);
+            }
+            pos += metaLength;
+            continue;
+        }
+        if (status == MIDI_SYSEXEVENT || status == 0xf7)
+        {
+            pos += static_cast<int>(readVarLen());
+            runningStatus = 0;
+            continue;
+        }
+        if ((status & 0x80) == 0)
+            return false;
+
+        runningStatus = status;
+        const int type = status & 0xf0;
+        const int channel = status & 0x0f;
+        const int dataBytes = (type == MIDI_PROGRAM_CHANGE || type == MIDI_CHANNEL_PRESSURE) ? 1 : 2;
+        if (pos + dataBytes > end)
+            return false;
+        const int data1 = static_cast<unsigned char>(data[pos]);
+        const int data2 = (dataBytes == 2) ? static_cast<unsigned char>(data[pos + 1]) : 0;
+        pos += dataBytes;
+
+        performanceEvent_t perfEvent;
+        perfEvent.time = tick;
+        switch (type)
+        {
+        case MIDI_NOTE_ON:
+            if (data2 != 0)
+                perfEvent.event.noteOnEvent(0, channel, data1, data2);
+            else
+                perfEvent.event.noteOffEvent(0, channel, data1, 0);
+            break;
+        case MIDI_NOTE_OFF:
+            perfEvent.event.noteOffEvent(0, channel, data1, data2);
+            break;
+        case MIDI_NOTE_PRESSURE:
+            perfEvent.event.notePressure(0, channel, data1, data2);
+            break;
+        case MIDI_CONTROL_CHANGE:
+            perfEvent.event.controlChangeEvent(0, channel, data1, data2);
+            break;
+        case MIDI_PROGRAM_CHANGE:
+            perfEvent.event.programChangeEvent(0, channel, data1);
+            break;
+        case MIDI_CHANNEL_PRESSURE:
+            perfEvent.event.channelPressure(0, channel, data1);
+            break;
+        case MIDI_PITCH_BEND:
+            perfEvent.event.pitchBendEvent(0, channel, data1, data2);
+            break;
+        }
+        events.push_back(perfEvent);
+    }
+    return true;
+}
+
+void CReplay::reportEvent(const char* direction, CMidiEvent event)
+{
+    if (m_report == nullptr)
+        return;
+
+    *m_report << QString::asprintf("%8lld %-3s chan %2d %-21s %3d %3d\n", m_virtualTime / 1000, direction,
+                                   event.channel() + 1, event.event_type_str(event.type()).c_str(),
+                                   event.data1(), event.data2());
+}
+
+void CReplay::playMidiEvent(const CMidiEvent & event)
+{
+    reportEvent("out", event);
+}
+
+int CReplay::checkMidiInput()
+{
+    if (m_nextEvent >= m_performance.size())
+        return 0;
+    const performanceEvent_t &perfEvent = m_performance[m_nextEvent];
+    if (!perfEvent.marker.isEmpty() || perfEvent.time > m_virtualTime)
+        return 0;
+    return 1;
+}
+
+CMidiEvent CReplay::readMidiInput()
+{
+    CMidiEvent event = m_performance[m_nextEvent++].event;
+    reportEvent("in", event);
+    return event;
+}
+
+qint64 CReplay::midiInputTimeStamp()
+{
+    if (m_nextEvent >= m_performance.size())
+        return -1;
+    return m_performance[m_nextEvent].time;
+}
+
+bool CReplay::run(CSong* song, QTextStream &report)
+{
+    const qint64 tickRate = (Cfg::tickRate > 0) ? Cfg::tickRate : 4;
+    const bool hasMarkers = std::any_of(m_performance.begin(), m_performance.end(),
+                                        [](const performanceEvent_t &perfEvent) {return !perfEvent.marker.isEmpty();});
+    // give up once the pianist has stopped playing for long enough
+    const qint64 endTime = (m_performance.empty() ? 0 : m_performance.back().time) + Cfg::silenceTimeOut() * 1000;
+
+    m_report = &report;
+    m_nextEvent = 0;
+    m_virtualTime = 0;
+
+    report << "# PianoBooster replay\n";
+    report << "# song: " << song->getSongTitle() << "\n";
+    report << QString::asprintf("# mode %d hand %d speed %.2f transpose %d tick %lld msec\n",
+                                CConductor::getPlayMode(), static_cast<int>(song->getActiveHand()), static_cast<double>(song->getSpeed()),
+                                song->getTranspose(), tickRate);
+
+    song->setReplayDevice(this);
+    song->rewind();
+    if (!hasMarkers)
+        song->playMusic(true);
+
+    bool waiting = false;
+    int barNumber = song->getBarNumber();
+    while (m_virtualTime <= endTime)
+    {
+        while (m_nextEvent < m_performance.size() && !m_performance[m_nextEvent].marker.isEmpty()
+                && m_performance[m_nextEvent].time <= m_virtualTime)
+        {
+            const QByteArray &marker = m_performance[m_nextEvent++].marker;
+            report << QString::asprintf("%8lld %s\n", m_virtualTime / 1000, marker.constData());
+            if (marker == RECORDER_MARKER_START)
+                song->playMusic(true);
+            else if (marker == RECORDER_MARKER_STOP)
+                song->playMusic(false);
+        }
+
+        const eventBits_t eventBits = song->task(tickRate);
+
+        if ((eventBits & EVENT_BITS_forceRatingRedraw) != 0)
+        {
+            CRating* rating = song->getRating();
+            report << QString::asprintf("%8lld rating total %d wrong %d late %d accuracy %.3f\n", m_virtualTime / 1000,
+                                        rating->totalNoteCount(), rating->wrongNoteCount(), rating->lateNoteCount(),
+                                        static_cast<double>(rating->getAccuracyValue()));
+        }
+        if (song->isWaitingForPianist() != waiting)
+        {
+            waiting = !waiting;
+            report << QString::asprintf("%8lld %s\n", m_virtualTime / 1000, waiting ? "stop point" : "continue");
+        }
+        if (song->getBarNumber() != barNumber)
+        {
+            barNumber = song->getBarNumber();
+            report << QString::asprintf("%8lld bar %d\n", m_virtualTime / 1000, barNumber);
+        }
+        if ((eventBits & EVENT_BITS_UptoBarReached) != 0)
+            song->playFromStartBar();
+        if ((eventBits & EVENT_BITS_playingStopped) != 0)
+        {
+            report << QString::asprintf("%8lld end of song\n", m_virtualTime / 1000);
+            break;
+        }
+        m_virtualTime += tickRate * 1000;
+    }
+
+    song->playMusic(false);
+    CRating* rating = song->getRating();
+    report << QString::asprintf("# result total %d wrong %d late %d rating %.1f%%\n",
+                                rating->totalNoteCount(), rating->wrongNoteCount(), rating->lateNoteCount(),
+                                rating->rating());
+    report.flush();
+
+    song->setReplayDevice(nullptr);
+    m_report = nullptr;
+    return true;
+}
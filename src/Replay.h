@@ -0,0 +1,96 @@
+/*********************************************************************************/
+/*!
+@file           Replay.h
+
+@brief          Replays a recorded performance through the conductor on a virtual clock.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <vector>
+
+#include <QByteArray>
+#include <QTextStream>
+
+#include "MidiDeviceBase.h"
+
+class CSong;
+
+/*!
+ * @brief   A MIDI device that plays back the pianist part of a recorded performance.
+ *
+ * The song is run as fast as possible using a virtual clock, the pianist input is taken
+ * from the recording (see CMidiRecorder) and everything the conductor does is written
+ * to a plain text report. Two reports from different builds can then be compared with diff.
+ */
+class CReplay : public CMidiDeviceBase
+{
+public:
+    CReplay();
+
+    bool loadPerformance(const QString &fileName);
+    //! run the loaded performance through the song, returns false on an error
+    bool run(CSong* song, QTextStream &report);
+
+    virtual void init() {}
+    //! the output events are written to the report instead of being played
+    virtual void playMidiEvent(const CMidiEvent & event);
+    virtual int checkMidiInput();
+    virtual CMidiEvent readMidiInput();
+    virtual qint64 midiInputTimeStamp();
+
+    virtual QStringList getMidiPortList(midiType_t type) { Q_UNUSED(type) return QStringList(); }
+    virtual bool openMidiPort(midiType_t type, const QString &portName) { Q_UNUSED(type) Q_UNUSED(portName) return true; }
+    virtual bool validMidiConnection() {return true;}
+    virtual void closeMidiPort(midiType_t type, int index) { Q_UNUSED(type) Q_UNUSED(index) }
+
+    virtual int     midiSettingsSetStr(const QString &name, const QString &str) { Q_UNUSED(name) Q_UNUSED(str) return 0; }
+    virtual int     midiSettingsSetNum(const QString &name, double val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual int     midiSettingsSetInt(const QString &name, int val) { Q_UNUSED(name) Q_UNUSED(val) return 0; }
+    virtual QString midiSettingsGetStr(const QString &name) { Q_UNUSED(name) return QString(); }
+    virtual double  midiSettingsGetNum(const QString &name) { Q_UNUSED(name) return 0.0; }
+    virtual int     midiSettingsGetInt(const QString &name) { Q_UNUSED(name) return 0; }
+
+private:
+    typedef struct
+    {
+        qint64 time; // in usec from the start of the recording
+        CMidiEvent event;
+        QByteArray marker;
+    } performanceEvent_t;
+
+    bool decodeTrack(const QByteArray &data, int pos, int length,
+                     std::vector<performanceEvent_t> &events, QByteArray &trackName);
+    void reportEvent(const char* direction, CMidiEvent event);
+
+    std::vector<performanceEvent_t> m_performance;
+    std::vector<std::pair<qint64, int>> m_tempoMap; // the tick and the usec per beat
+    int m_ppqn;
+    size_t m_nextEvent;
+    qint64 m_virtualTime; // usec
+    QTextStream* m_report;
+};
+
+#endif //__REPLAY_H__
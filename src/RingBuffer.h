@@ -0,0 +1,105 @@
+/*********************************************************************************/
+/*!
+@file           RingBuffer.h
+
+@brief          A lock-free single producer, single consumer ring buffer.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+
+#include <atomic>
+
+// Unlike CQueue this is safe to use with one thread pushing and a different thread popping.
+// The size is rounded up to a power of two. It never allocates after construction and
+// push() never waits, if the buffer is full the item is dropped and counted instead.
+template <class TYPE>
+class CRingBuffer
+{
+public:
+    explicit CRingBuffer(unsigned int size)
+    {
+        m_size = 1;
+        while (m_size < size)
+            m_size <<= 1;
+        m_mask = m_size - 1;
+        m_buffer = new TYPE[m_size];
+        m_head = 0;
+        m_tail = 0;
+        m_dropped = 0;
+    }
+
+    ~CRingBuffer()
+    {
+        delete [] m_buffer;
+    }
+
+    CRingBuffer(const CRingBuffer&) = delete;
+    CRingBuffer& operator=(const CRingBuffer&) = delete;
+
+    // Only call from the producer thread
+    bool push(const TYPE &item)
+    {
+        const unsigned int head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= m_size)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_buffer[head & m_mask] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only call from the consumer thread
+    bool pop(TYPE *item)
+    {
+        const unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+        *item = m_buffer[tail & m_mask];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    unsigned int length() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+    unsigned int size() const {return m_size;}
+
+    // the number of items thrown away because the consumer was not keeping up
+    unsigned int dropped() const {return m_dropped.load(std::memory_order_relaxed);}
+    void clearDropped() {m_dropped.store(0, std::memory_order_relaxed);}
+
+private:
+    TYPE * m_buffer;
+    unsigned int m_size;
+    unsigned int m_mask;
+    std::atomic<unsigned int> m_head;
+    std::atomic<unsigned int> m_tail;
+    std::atomic<unsigned int> m_dropped;
+};
+
+#endif //__RING_BUFFER_H__
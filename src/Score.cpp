@@ -29,6 +29,7 @@
 #include "Cfg.h"
 #include "Draw.h"
 #include "Score.h"
+#include "Trace.h"
 
 CScore::CScore(CSettings* settings) : CDraw(settings)
 {
@@ -43,6 +44,10 @@ CScore::CScore(CSettings* settings) : CDraw(settings)
     m_activeScroll = -1;
     m_stavesDisplayListId = 0;
     m_scoreDisplayListId = 0;//glGenLists (1);
+    m_keyboardStartX = -1.0f;
+    m_keyboardEndX = -1.0f;
+    memset(m_keyState, 0, sizeof(m_keyState));
+    m_keyboardStopped = false;
 }
 
 CScore::~CScore()
@@ -91,137 +96,123 @@ void CScore::drawScroll(bool refresh)
     else
         glCallList(m_stavesDisplayListId);
 
-    if (m_settings->value("View/PianoKeyboard").toString()=="on"){
-        drawPianoKeyboard();
-    }
     drawScrollingSymbols(true);
     m_piano->drawPianoInput();
 }
 
-void CScore::drawPianoKeyboard(){
-    const static int keysCount = 88;
-    struct PianoKeyboard {
-        int i, k;
-        float yStart;
-        float xSize;
-        float ySize;
-
-        float xPlaceSize;
-        float xKeySize;
-        char state[keysCount];
-        bool stopped;
-
-        PianoKeyboard() {
-            i = 0; k = 0;
-            yStart = 0.0f;
-            xSize = Cfg::staveEndX() - Cfg::staveStartX();
-            ySize = 30;
-
-            xPlaceSize = xSize / 52.0f;
-            xKeySize = xPlaceSize - xPlaceSize * 0.1f;
-            stopped = false;
-        }
+#define PIANO_LOWEST_NOTE   21  // A0
+#define PIANO_WHITE_KEYS    52
 
-        void drawBlackKey(int i, int k) {
-            glPushMatrix();
-            float yBlackShift = ySize / 2.5f;
-            float yBlackSize = ySize - yBlackShift;
-            glScalef(1.0f, 1.4f, 1.0f);
-            glTranslatef(Cfg::staveStartX() + xPlaceSize * static_cast<float>(i) - xPlaceSize / 3.0f,
-                yStart + yBlackShift, 0.0f);
-
-            float xKeySize = this->xKeySize / 1.5f;
-
-            CDraw::drColor (CColor(0.0, 0.0, 0.0));
-            if(state[k]==1) CDraw::drColor(stopped ? Cfg::playedStoppedColor() : Cfg::noteColor());
-            if(state[k]==2) CDraw::drColor(Cfg::playedBadColor());
-            glBegin(GL_QUADS);
-            glVertex2f(0, yBlackSize);
-            glVertex2f(xKeySize, yBlackSize);
-            glVertex2f(xKeySize, 0);
-            glVertex2f(0, 0);
-            glEnd();
-
-            glPopMatrix();
-            state[k] = 0;
-        }
+static bool isBlackKey(int key)
+{
+    switch ((key + PIANO_LOWEST_NOTE) % MIDI_OCTAVE)
+    {
+    case 1: case 3: case 6: case 8: case 10:
+        return true;
+    default:
+        return false;
+    }
+}
 
-        void drawWhiteKey() {
-            glPushMatrix();
-            glScalef(1.0f, 1.4f, 1.0f);
-            glTranslatef(Cfg::staveStartX() + xPlaceSize * static_cast<float>(i++), yStart, 0.0f);
-
-            CDraw::drColor (CColor(1.0, 1.0, 1.0));
-            if(state[k]==1) CDraw::drColor(stopped ? Cfg::playedStoppedColor() : Cfg::noteColor());
-            if(state[k]==2) CDraw::drColor(Cfg::playedBadColor());
-            glBegin(GL_QUADS);
-            glVertex2f(0, ySize);
-            glVertex2f(xKeySize, ySize);
-            glVertex2f(xKeySize, 0);
-            glVertex2f(0, 0);
-            glEnd();
-
-            glPopMatrix();
-            state[k++] = 0;
-        }
+static void addKeyQuad(CDrawBatch &batch, int key, float x1, float y1, float x2, float y2, CColor color)
+{
+    const batchVertex_t corners[4] = {
+        {x1, y1, color.red, color.green, color.blue, key},
+        {x2, y1, color.red, color.green, color.blue, key},
+        {x2, y2, color.red, color.green, color.blue, key},
+        {x1, y2, color.red, color.green, color.blue, key},
+    };
+    batch.setAttribute(key);
+    for (int i : {0, 1, 2, 0, 2, 3})
+        batch.addVertex(BATCH_LAYER_FOREGROUND, GL_TRIANGLES, 1.0f, corners[i]);
+}
 
-        void drawOctave() {
-            drawWhiteKey();
-            int b1 = i, k1 = k++;
-            drawWhiteKey();
-            int b2 = i, k2 = k++;
-            drawWhiteKey();
-            drawWhiteKey();
-            int b3 = i, k3 = k++;
-            drawWhiteKey();
-            int b4 = i, k4 = k++;
-            drawWhiteKey();
-            int b5 = i, k5 = k++;
-            drawWhiteKey();
-            drawBlackKey(b1, k1);
-            drawBlackKey(b2, k2);
-            drawBlackKey(b3, k3);
-            drawBlackKey(b4, k4);
-            drawBlackKey(b5, k5);
-        }
+// All the keys go in one batch with the white keys first so the black keys are drawn on top
+void CScore::buildPianoKeyboard()
+{
+    m_keyboardStartX = Cfg::staveStartX();
+    m_keyboardEndX = Cfg::staveEndX();
+    m_keyboard.clear();
+
+    const float xPlaceSize = (m_keyboardEndX - m_keyboardStartX) / PIANO_WHITE_KEYS;
+    const float xWhiteSize = xPlaceSize * 0.9f;
+    const float xBlackSize = xWhiteSize / 1.5f;
+    const float yBlackStart = PIANO_KEYBOARD_HEIGHT / 2.5f;
 
-        void drawKeyboard() {
-            i = k = 0;
-            drawWhiteKey();
-            int b1 = i, k1 = k++;
-            drawWhiteKey();
-            drawBlackKey(b1, k1);
-            for(int i=0; i<7; ++i) drawOctave();
-            drawWhiteKey();
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int whiteKeys = 0;
+        for (int key = 0; key < PIANO_KEYS; key++)
+        {
+            const bool black = isBlackKey(key);
+            const float x = m_keyboardStartX + xPlaceSize * static_cast<float>(whiteKeys);
+            if (!black)
+                whiteKeys++;
+            if (pass == 0 && !black)
+                addKeyQuad(m_keyboard, key, x, 0.0f, x + xWhiteSize, PIANO_KEYBOARD_HEIGHT, CColor(1.0, 1.0, 1.0));
+            else if (pass == 1 && black)
+                addKeyQuad(m_keyboard, key, x - xPlaceSize / 3.0f, yBlackStart,
+                           x - xPlaceSize / 3.0f + xBlackSize, PIANO_KEYBOARD_HEIGHT, CColor(0.0, 0.0, 0.0));
         }
-    };
-    static PianoKeyboard pianoKeyboard;
+    }
+    m_keyboard.setAttribute(-1);
+    memset(m_keyState, 0, sizeof(m_keyState));
+}
+
+void CScore::setPianoKeyState(int key, int state)
+{
+    CColor color = isBlackKey(key) ? CColor(0.0, 0.0, 0.0) : CColor(1.0, 1.0, 1.0);
+    if (state == 1)
+        color = m_keyboardStopped ? Cfg::playedStoppedColor() : Cfg::noteColor();
+    else if (state == 2)
+        color = Cfg::playedBadColor();
+    m_keyboard.setAttributeColor(key, color);
+    m_keyState[key] = static_cast<char>(state);
+}
+
+void CScore::drawPianoKeyboard()
+{
+    if (m_keyboardStartX != Cfg::staveStartX() || m_keyboardEndX != Cfg::staveEndX())
+        buildPianoKeyboard();
+
+    char state[PIANO_KEYS];
+    memset(state, 0, sizeof(state));
 
     CChord chord = m_piano->getBadChord();
     for(int n=0; n<chord.length(); ++n) {
-        int pitch = chord.getNote(n).pitch();
-        int k = pitch - 21;
-        k = k < 0 ? 0 : (k >= keysCount ? (keysCount-1) : k);
-        pianoKeyboard.state[k] = 2;
+        int k = chord.getNote(n).pitch() - PIANO_LOWEST_NOTE;
+        k = k < 0 ? 0 : (k >= PIANO_KEYS ? (PIANO_KEYS-1) : k);
+        state[k] = 2;
     }
 
+    bool stopped = m_keyboardStopped;
     for (auto *const scroll : m_scroll) {
         int notes[64];
         memset(notes, 0, sizeof(notes));
-        bool stopped = scroll->getKeyboardInfo(notes);
+        bool scrollStopped = scroll->getKeyboardInfo(notes);
         for(int *note=notes; *note; ++note) {
-            pianoKeyboard.stopped = stopped;
-            int k = *note - 21;
-            k = k < 0 ? 0 : (k >= keysCount ? (keysCount-1) : k);
-            pianoKeyboard.state[k] = 1;
+            stopped = scrollStopped;
+            int k = *note - PIANO_LOWEST_NOTE;
+            k = k < 0 ? 0 : (k >= PIANO_KEYS ? (PIANO_KEYS-1) : k);
+            state[k] = 1;
         }
     }
 
-    pianoKeyboard.drawKeyboard();
+    // only the keys that have changed are recoloured
+    const bool stoppedChanged = (stopped != m_keyboardStopped);
+    m_keyboardStopped = stopped;
+    for (int k = 0; k < PIANO_KEYS; k++)
+    {
+        if (state[k] != m_keyState[k] || (stoppedChanged && state[k] == 1))
+            setPianoKeyState(k, state[k]);
+    }
+
+    drawBatch(m_keyboard);
 }
 
 void CScore::drawScore()
 {
+    TRACE_SPAN("drawScore");
     if (getCompileRedrawCount())
     {
         if (m_scoreDisplayListId == 0)
@@ -33,6 +33,9 @@
 #include "Piano.h"
 #include "Settings.h"
 
+#define PIANO_KEYS              88
+#define PIANO_KEYBOARD_HEIGHT   42.0f
+
 class CScore : public CDraw
 {
 public:
@@ -89,6 +92,12 @@ public:
             scroll->scrollDeltaTime(ticks);
     }
 
+    void setScrollAhead(qint64 ticks)
+    {
+        for (auto *const scroll : m_scroll)
+            scroll->setDrawAhead(ticks);
+    }
+
     void setRatingObject(CRating* rating)
     {
         m_rating = rating;
@@ -139,12 +148,21 @@ protected:
     CPiano* m_piano;
 
 private:
+    void buildPianoKeyboard();
+    void setPianoKeyState(int key, int state);
+
     CRating* m_rating;
     CScroll* m_scroll[MAX_MIDI_CHANNELS];
     int m_activeScroll;
     GLuint m_scoreDisplayListId;
     GLuint m_stavesDisplayListId;
 
+    // The keyboard is built once, only the keys that change colour are updated
+    CDrawBatch m_keyboard;
+    float m_keyboardStartX; // the stave extents the keyboard was built for
+    float m_keyboardEndX;
+    char m_keyState[PIANO_KEYS]; // 0 up, 1 a note to play, 2 a wrong note
+    bool m_keyboardStopped;
 };
 
 #endif // _SCORE_H_
@@ -28,39 +28,36 @@
 
 #include "Cfg.h"
 #include "Scroll.h"
+#include "Trace.h"
 
 //#define NOTE_AHEAD_GAP          50
 //#define NOTE_BEHIND_GAP          14
 
 #define NOTE_AHEAD_GAP          22 // the notes on the left hand side of the score
 #define NOTE_BEHIND_GAP         14
+#define SCROLL_CULL_MARGIN      100 // a slot never draws further than this to the left of its x position
 
-void CScroll::compileSlot(CSlotDisplayList info)
+void CScroll::compileSlot(CSlotGeometry* info)
 {
-
-    if (m_show == false || info.m_displayListId == 0)
+    if (m_show == false || info->m_geometry == nullptr)
         return;
 
-    glNewList (info.m_displayListId, GL_COMPILE);
-    glTranslatef (static_cast<float>(info.getDeltaTime()) * m_noteSpacingFactor, 0.0f, 0.0f); /*  move position  */
+    // Only the geometry is rebuilt, it is drawn later with all the other slots.
+    // It does not depend on the pitch so it is not built again when transposing.
+    info->m_geometry->clear();
+    setBatch(info->m_geometry);
+    drawSlotLayout(info);
+    setBatch(nullptr);
+    info->m_colorTranspose = 0;
+}
 
-    info.transpose(m_transpose);
-    drawSlot(&info);
-    /*
-    int i;
-    CStavePos stavePos;
-    int av8Left = info.getAv8Left();
-    for (i=0; i < info.length(); i++)
+void CScroll::deleteGeometry()
+{
+    for (int i = 0; i < m_scrollQueue->length(); i++)
     {
-        stavePos.notePos(info.getSymbol(i).getHand(), info.getSymbol(i).getNote());
-        //ppLogTrace ("compileSlot len %d id %2d next %2d time %2d type %2d note %2d", info.length(), info.m_displayListId,
-        //info.m_nextDisplayListId, info.getDeltaTime(), info.getSymbol(i).getType(), info.getSymbol(i).getNote());
-
-        drawSymbol(info.getSymbol(i), 0.0, stavePos.getPosYRelative()); // we add this  back when drawing this symbol
+        delete m_scrollQueue->indexPtr(i)->m_geometry;
+        m_scrollQueue->indexPtr(i)->m_geometry = nullptr;
     }
-    */
-    glCallList (info.m_nextDisplayListId);    /* Automatically draw the next slot even if it is not there yet */
-    glEndList ();
 }
 
 /*! Insert a symbol into the display list
@@ -68,8 +65,6 @@ void CScroll::compileSlot(CSlotDisplayList info)
  */
 bool CScroll::insertSlots()
 {
-    GLuint nextListId = 0;
-
     if (m_headSlot.length() == 0)
         m_headSlot = m_notation->nextSlot();
     if (m_headSlot.length() == 0 || m_headSlot.getSymbolType(0) == PB_SYMBOL_theEndMarker) // this means we have reached the end of the file
@@ -83,26 +78,13 @@ bool CScroll::insertSlots()
         if (headDelta > slotDetlta)
             break;
 
-        if (m_show)
-        {
-            if (m_symbolID == 0)
-                m_symbolID = glGenLists (1);
-
-            nextListId = glGenLists (1);
-        }
-        else
-        {
-            nextListId = m_symbolID = 0;
-        }
-
-        CSlotDisplayList info(m_headSlot, m_symbolID, nextListId);
+        CSlotGeometry info(m_headSlot, m_show ? new CDrawBatch : nullptr);
 
         m_deltaHead += info.getDeltaTime() * SPEED_ADJUST_FACTOR;
 
-        compileSlot(info);
+        compileSlot(&info);
 
         m_scrollQueue->push(info);
-        m_symbolID  = nextListId;
 
         m_headSlot = m_notation->nextSlot();
         if (m_headSlot.length() == 0 || m_headSlot.getSymbolType(0) == PB_SYMBOL_theEndMarker) // this means we have reached the end of the file
@@ -118,10 +100,7 @@ void CScroll::removeEarlyTimingMakers()
     for (int i = 0; i < 10 && i < m_scrollQueue->length(); i++ )
     {
         if (delta < -(static_cast<float>(m_scrollQueue->index(i).getLeftSideDeltaTime()) * m_noteSpacingFactor))
-        {
-            m_scrollQueue->indexPtr(i)->clearAllNoteTimmings();
-            compileSlot(m_scrollQueue->index(i));
-        }
+            m_scrollQueue->indexPtr(i)->clearAllNoteTimmings(); // the markers are not in the slot geometry
         delta += static_cast<float>(m_scrollQueue->index(i).getDeltaTime()) * m_noteSpacingFactor;
     }
 }
@@ -133,14 +112,11 @@ void CScroll::removeSlots()
         if (deltaAdjustF(m_deltaTail) * m_noteSpacingFactor > -Cfg::playZoneX() + Cfg::scrollStartX() + NOTE_AHEAD_GAP -(static_cast<float>(m_scrollQueue->index(0).getLeftSideDeltaTime()) * m_noteSpacingFactor) )
             break;
 
-        CSlotDisplayList info = m_scrollQueue->pop();
+        CSlotGeometry info = m_scrollQueue->pop();
 
         m_deltaTail += info.getDeltaTime() * SPEED_ADJUST_FACTOR;
 
-        //ppLogTrace("Remove slot id %2d time %2d type %2d note %2d", info.m_displayListId, info.getDeltaTime(), info.getSymbol(0).getType(), info.getSymbol(0).getNote());
-
-        if (info.m_displayListId)
-            glDeleteLists( info.m_displayListId, 1);
+        delete info.m_geometry;
         if (m_wantedIndex > 0)
             m_wantedIndex--;  // also the Chord has moved down one place
         else
@@ -154,6 +130,7 @@ void CScroll::removeSlots()
 //! Draw all the symbols that we have in the list
 void CScroll::drawScrollingSymbols(bool show)
 {
+    TRACE_SPAN("drawScrollingSymbols");
     insertSlots();  // new symbols at the end of the score
     removeSlots();  // delete old symbols no longer required
     removeEarlyTimingMakers();
@@ -161,18 +138,36 @@ void CScroll::drawScrollingSymbols(bool show)
     if (show == false)   // Just update the queue only
         return;
 
-    if (m_scrollQueue->length() == 0 || m_scrollQueue->indexPtr(0)->m_displayListId == 0)
+    if (m_scrollQueue->length() == 0 || m_scrollQueue->indexPtr(0)->m_geometry == nullptr)
         return;
 
-    glPushMatrix();
-    glTranslatef (Cfg::playZoneX() + deltaAdjustF(m_deltaTail) * m_noteSpacingFactor, CStavePos::getStaveCenterY(), 0.0f);
-
-    BENCHMARK(8, "glTranslatef");
-
-    if (m_scrollQueue->length() > 0)
-        glCallList (m_scrollQueue->indexPtr(0)->m_displayListId);
-    BENCHMARK(9, "glCallList");
+    // Join the slots that can be seen into one batch so it only takes a few draw calls
+    m_frameBatch.clear();
+    setBatch(&m_frameBatch);
+    const float right = static_cast<float>(Cfg::getAppWidth());
+    float x = Cfg::playZoneX() + deltaAdjustF(m_deltaTail - m_drawAhead) * m_noteSpacingFactor;
+    for (int i = 0; i < m_scrollQueue->length(); i++)
+    {
+        CSlotGeometry* info = m_scrollQueue->indexPtr(i);
+        x += static_cast<float>(info->getDeltaTime()) * m_noteSpacingFactor;
+        if (x - SCROLL_CULL_MARGIN > right)
+            break;
+        if (info->m_geometry == nullptr || info->m_geometry->isEmpty())
+            continue;
+        if (x + info->m_geometry->getMaxX() < 0.0f || x + info->m_geometry->getMinX() > right)
+            continue;
+        if (info->m_colorTranspose != m_transpose)
+        {
+            updateNoteColor(info, 0);
+            info->m_colorTranspose = m_transpose;
+        }
+        drawSlotNotes(info, x);
+    }
+    setBatch(nullptr);
 
+    glPushMatrix();
+    glTranslatef (0.0f, CStavePos::getStaveCenterY(), 0.0f);
+    drawBatch(m_frameBatch);
     glPopMatrix();
 }
 
@@ -231,14 +226,52 @@ void CScroll::setPlayedNoteColor(int note, CColor color, qint64 wantedDelta, qin
         return;
     index = findWantedChord(note, color, wantedDelta);
     note -= m_transpose;
-    m_scrollQueue->indexPtr(index)->setNoteColor(note, color);
+    CSlotGeometry* info = m_scrollQueue->indexPtr(index);
+    info->setNoteColor(note, color);
     if (pianistTimming != NOT_USED)
     {
         pianistTimming = deltaAdjustL(pianistTimming) * DEFAULT_PPQN / CMidiFile::getPulsesPerQuarterNote();
 
-        m_scrollQueue->indexPtr(index)->setNoteTimming(note, pianistTimming);
+        info->setNoteTimming(note, pianistTimming);
+    }
+    updateNoteColor(info, note);
+}
+
+// Only recolour the vertices of the note instead of compiling the whole slot again
+void CScroll::updateNoteColor(CSlotGeometry* info, int note)
+{
+    if (m_show == false || info->m_geometry == nullptr)
+        return;
+
+    for (int i = 0; i < info->length(); i++)
+    {
+        CSymbol* symbol = info->getSymbolPtr(i);
+        if (note != symbol->getNote() && note != 0)
+            continue;
+        CSymbol shown = *symbol;
+        shown.transpose(m_transpose);
+        info->m_geometry->setAttributeColor(i, getSymbolColor(shown));
     }
-    compileSlot(m_scrollQueue->index(index));
+}
+
+// Moves the notes to their transposed stave positions and adds everything that depends on the pitch
+void CScroll::drawSlotNotes(CSlotGeometry* info, float x)
+{
+    float noteY[MAX_SYMBOLS];
+    CStavePos stavePos;
+    for (int i = 0; i < info->length(); i++)
+    {
+        noteY[i] = 0.0f;
+        if (!isPitchedSymbol(*info->getSymbolPtr(i)))
+            continue;
+        CSymbol symbol = info->getSymbol(i);
+        symbol.transpose(m_transpose);
+        stavePos.notePos(symbol.getHand(), symbol.getNote()); // just a table look up
+        noteY[i] = stavePos.getPosYRelative();
+        drawNoteDecorations(symbol, x, noteY[i]);
+        drawPianistTiming(symbol, x, noteY[i]);
+    }
+    m_frameBatch.append(*info->m_geometry, x, noteY);
 }
 
 void CScroll::refresh()
@@ -248,15 +281,15 @@ void CScroll::refresh()
         return;
 
     for ( i = 0; i < m_scrollQueue->length(); i++)
-        compileSlot(m_scrollQueue->index(i));
+        compileSlot(m_scrollQueue->indexPtr(i));
 }
 
 bool CScroll::getKeyboardInfo(int *notes)
 {
     int stoppedScrollIdx = -1;
     for(int i=0; i<m_scrollQueue->length(); ++i) {
-        CSlotDisplayList &info = *m_scrollQueue->indexPtr(i);
-        if(m_show == false || info.m_displayListId == 0) continue;
+        CSlotGeometry &info = *m_scrollQueue->indexPtr(i);
+        if(m_show == false || info.m_geometry == nullptr) continue;
 
         CSlot* slot = &info;
         for(int j=0; j<slot->length(); ++j) {
@@ -270,8 +303,8 @@ bool CScroll::getKeyboardInfo(int *notes)
     }
     if(stoppedScrollIdx > -1) {
         for(int i=0; i<stoppedScrollIdx; ++i) {
-            CSlotDisplayList &info = *m_scrollQueue->indexPtr(i);
-            if(m_show == false || info.m_displayListId == 0) continue;
+            CSlotGeometry &info = *m_scrollQueue->indexPtr(i);
+            if(m_show == false || info.m_geometry == nullptr) continue;
 
             CSlot* slot = &info;
             for(int j=0; j<slot->length(); ++j) {
@@ -283,8 +316,8 @@ bool CScroll::getKeyboardInfo(int *notes)
 
     int *note = notes;
     for(int i=0; i<m_scrollQueue->length(); ++i) {
-        CSlotDisplayList &info = *m_scrollQueue->indexPtr(i);
-        if(m_show == false || info.m_displayListId == 0) continue;
+        CSlotGeometry &info = *m_scrollQueue->indexPtr(i);
+        if(m_show == false || info.m_geometry == nullptr) continue;
 
         CSlot* slot = &info;
         bool stopped = false;
@@ -303,86 +336,46 @@ bool CScroll::getKeyboardInfo(int *notes)
 
 void CScroll::transpose(int transpose)
 {
-    if (m_transpose == transpose)
-        return;
-
+    // nothing is rebuilt, the notes are moved and recoloured as they are drawn
     m_transpose = transpose;
-    refresh();
 }
 
 void CScroll::showScroll(bool show)
 {
     int i;
-    GLuint nextListId = 0;
 
     m_show = show;
     if (show == true)
     {
-
-        if (m_symbolID == 0)
-            m_symbolID = glGenLists (1);
-
-        // add in the missing GL display list
+        // add in the missing geometry
         for ( i = 0; i < m_scrollQueue->length(); i++)
         {
-            //assert (m_scrollQueue->indexPtr(i)->m_displayListId == 0);
-            nextListId = glGenLists (1);
-            m_scrollQueue->indexPtr(i)->m_displayListId = m_symbolID;
-            m_scrollQueue->indexPtr(i)->m_nextDisplayListId = nextListId;
-            m_symbolID  = nextListId;
-
-        }
-        // And now compile the slot (remember that each slot points to the next one)
-        for ( i = 0; i < m_scrollQueue->length(); i++)
-        {
-            compileSlot(m_scrollQueue->index(i));
+            if (m_scrollQueue->indexPtr(i)->m_geometry == nullptr)
+                m_scrollQueue->indexPtr(i)->m_geometry = new CDrawBatch;
+            compileSlot(m_scrollQueue->indexPtr(i));
         }
     }
     else
     {
-        // Remove all the gl items
-        for ( i = 0; i < m_scrollQueue->length(); i++)
-        {
-            if (m_scrollQueue->indexPtr(i)->m_displayListId != 0 && m_scrollQueue->indexPtr(i)->m_displayListId != nextListId)
-                glDeleteLists(m_scrollQueue->index(i).m_displayListId, 1);
-            m_scrollQueue->indexPtr(i)->m_displayListId = 0;
-
-            nextListId = m_scrollQueue->indexPtr(i)->m_nextDisplayListId;
-            m_scrollQueue->indexPtr(i)->m_nextDisplayListId = 0;
-
-            if (nextListId != 0)
-                glDeleteLists(nextListId, 1);
-
-        }
-        if (m_symbolID != 0)
-           glDeleteLists(m_symbolID, 1);
-        m_symbolID = 0;
+        deleteGeometry();
     }
 }
 
-CScroll::CSlotDisplayList::CSlotDisplayList(const CSlot& slot, GLuint displayListId, GLuint nextDisplayListId) : CSlot(slot),
-    m_displayListId(displayListId), m_nextDisplayListId(nextDisplayListId)
+CScroll::CSlotGeometry::CSlotGeometry(const CSlot& slot, CDrawBatch* geometry) : CSlot(slot),
+    m_geometry(geometry), m_colorTranspose(0)
 {
     // It is all done in the initialisation list
 }
 
 void CScroll::reset()
 {
-    int i;
     m_wantedIndex = 0;
     m_wantedDelta = 0;
     m_deltaHead = m_deltaTail = 0;
+    m_drawAhead = 0;
     m_notation->reset();
     m_headSlot.clear();
-    for ( i = 0; i < m_scrollQueue->length(); i++)
-    {
-        if (m_scrollQueue->index(i).m_displayListId)
-            glDeleteLists(m_scrollQueue->index(i).m_displayListId, 1);
-    }
-    if (m_symbolID != 0)
-       glDeleteLists(m_symbolID, 1);
-    m_symbolID = 0;
-
+    deleteGeometry();
     m_scrollQueue->clear();
     m_ppqnFactor = static_cast<float>(DEFAULT_PPQN) / static_cast<float>(CMidiFile::getPulsesPerQuarterNote());
     m_noteSpacingFactor = m_ppqnFactor * HORIZONTAL_SPACING_FACTOR;
@@ -43,10 +43,9 @@ public:
     CScroll(int id, CSettings* settings) : CDraw(settings)
     {
         m_id = id;
-        m_symbolID = 0;
 
         m_notation = new CNotation();
-        m_scrollQueue = new CQueue<CSlotDisplayList>(QUEUE_LENGTH);
+        m_scrollQueue = new CQueue<CSlotGeometry>(QUEUE_LENGTH);
         reset();
         m_show = false;
         m_noteSpacingFactor = 1.0;
@@ -56,11 +55,14 @@ public:
 
     ~CScroll()
     {
+        deleteGeometry();
         delete m_scrollQueue;
         delete m_notation;
     }
     void reset();
     void scrollDeltaTime(qint64 ticks);
+    //! draw the notes this many ticks further on than the engine has got to
+    void setDrawAhead(qint64 ticks) { m_drawAhead = ticks; }
     void transpose(int transpose);
     void refresh();
     void setPlayedNoteColor(int note, CColor color, qint64 wantedDelta, qint64 pianistTimming);
@@ -80,17 +82,20 @@ public:
     bool getKeyboardInfo(int *notes);
 
 private:
-    class CSlotDisplayList : public CSlot
+    class CSlotGeometry : public CSlot
     {
         public:
-        CSlotDisplayList(): m_displayListId(0){};
-        CSlotDisplayList(const CSlot &slot, GLuint displayListId, GLuint nextDisplayListId);
+        CSlotGeometry(): m_geometry(nullptr), m_colorTranspose(0){};
+        CSlotGeometry(const CSlot &slot, CDrawBatch* geometry);
 
-        GLuint m_displayListId; // the open GL display list id for this slot
-        GLuint m_nextDisplayListId; // and this points to the next one
+        CDrawBatch* m_geometry; // the lines and triangles for this slot drawn at x = 0
+        int m_colorTranspose; // the transpose the note colours in the geometry were set for
     };
 
-    void compileSlot(CSlotDisplayList info);
+    void compileSlot(CSlotGeometry* info);
+    void deleteGeometry();
+    void updateNoteColor(CSlotGeometry* info, int note);
+    void drawSlotNotes(CSlotGeometry* info, float x);
     bool validPianistChord(int index);
     bool insertSlots();
     void removeSlots();
@@ -101,15 +106,16 @@ private:
     CNotation *m_notation;
     qint64 m_deltaHead;
     qint64 m_deltaTail;
+    qint64 m_drawAhead;
 
-    GLuint m_symbolID; // the next Display List name (or ID) to use
     CSlot m_headSlot;   // The next slot to be put in at the head of the queue;
 
     int m_transpose;
     int m_wantedIndex;  // The index number of the wanted call in the scrollQueue
     qint64 m_wantedDelta; // The running delta time of the wanted chord
 
-    CQueue<CSlotDisplayList>* m_scrollQueue;  // The current active display list of notes/chords on the screen
+    CQueue<CSlotGeometry>* m_scrollQueue;  // The current active list of notes/chords on the screen
+    CDrawBatch m_frameBatch; // the visible slots joined together, refilled every frame
     bool m_show; // set to true to show on the screen
     float m_noteSpacingFactor;
     float m_ppqnFactor; // if PulsesPerQuarterNote is 96 then the factor is 1.0
@@ -528,7 +528,12 @@ void CSettings::setChannelHands(int left, int right)
 
 void CSettings::updateWarningMessages()
 {
-    if (!m_song->validMidiOutput())
+    const int progress = m_song->loadProgress();
+    if (progress > 0)
+        m_warningMessage = tr("Loading the sound font %1% ...").arg(progress);
+    else if (progress == 0)
+        m_warningMessage = tr("Loading the sound font ...");
+    else if (!m_song->validMidiOutput())
         m_warningMessage = tr("ERROR NO SOUND: To fix this use menu Setup/MIDI Setup ...");
     else if (m_currentSongName.isEmpty())
         m_warningMessage = tr("ERROR NO MIDI FILE: To fix this use menu File/Open ...");
@@ -130,6 +130,16 @@ public:
         setValue("FluidSynth/SoundFont", getFluidSoundFontNames());
     }
 
+    /// The latency fix is measured for each MIDI output device (the old global value is only read)
+    int getLatencyFix(const QString &outputName)
+    {
+        return value(latencyFixKey(outputName), value("Midi/Latency", 0)).toInt();
+    }
+    void setLatencyFix(const QString &outputName, int latencyFix)
+    {
+        setValue(latencyFixKey(outputName), latencyFix);
+    }
+
     // has a new sound font been entered that is not the same as the old sound font
     bool isNewSoundFontEntered()
     {
@@ -164,6 +174,13 @@ private:
 
     Q_OBJECT
     QDomElement openDomElement(QDomElement parent, const QString & elementName, const QString & attributeName = QString());
+    static QString latencyFixKey(QString outputName)
+    {
+        if (outputName.isEmpty())
+            return "Midi/Latency";
+        // a slash would start a new settings group
+        return "MidiLatency/" + outputName.replace('/', '_').replace('\\', '_');
+    }
     void loadHandSettings();
     void saveHandSettings();
     void loadPartSettings();
@@ -28,6 +28,7 @@
 
 #include "Song.h"
 #include "Score.h"
+#include "Trace.h"
 
 void CSong::init2(CScore * scoreWin, CSettings* settings)
 {
@@ -161,6 +162,8 @@ void CSong::refreshScroll()
 
 eventBits_t CSong::task(qint64 ticks)
 {
+    TRACE_SPAN("CSong::task");
+    engineStatsTaskStarted();
     realTimeEngine(ticks);
 
     while (true)
@@ -211,6 +214,7 @@ eventBits_t CSong::task(qint64 ticks)
     }
 
 exitTask:
+    engineStatsTaskFinished();
     eventBits_t eventBits = m_realTimeEventBits;
     m_realTimeEventBits = 0;
     return eventBits;
@@ -33,30 +33,41 @@ float CStavePos::m_staveCenterY;
 int CStavePos::m_KeySignature;
 int CStavePos::m_KeySignatureMajorMinor;
 const staveLookup_t*  CStavePos::m_staveLookUpTable;
+CStavePos::staveNote_t CStavePos::m_staveNoteTable[MAX_MIDI_NOTES];
 float CStavePos::m_staveCentralOffset = (staveHeight() * 3)/2;
 
 ////////////////////////////////////////////////////////////////////////////////
 //! @brief Calculates the position of a note on the stave
 void CStavePos::notePos(whichPart_t hand, int midiNote)
 {
-    const int notesInAnOctive = 7; // Don't count middle C twice
-    const int semitonesInAnOctive = 12;
     setHand(hand);
-    int index = midiNote % semitonesInAnOctive;
 
-    const staveLookup_t* lookUpItem;
-
-    lookUpItem = &m_staveLookUpTable[index];
+    staveNote_t note;
+    if (midiNote >= 0 && midiNote < MAX_MIDI_NOTES)
+        note = m_staveNoteTable[midiNote];
+    else
+        note = calcStaveNote(midiNote);
 
     if (m_hand == PB_PART_right)
-        m_staveIndex =   lookUpItem->pianoNote - 7;
+        m_staveIndex = note.index - 7;
     else if (m_hand == PB_PART_left)
-        m_staveIndex = lookUpItem->pianoNote + 5;
+        m_staveIndex = note.index + 5;
+    else
+        m_staveIndex += note.index - note.pianoNote;
+    m_accidental = note.accidental;
+}
+
+CStavePos::staveNote_t CStavePos::calcStaveNote(int midiNote)
+{
+    const int notesInAnOctive = 7; // Don't count middle C twice
+    const int semitonesInAnOctive = 12;
+    const staveLookup_t* lookUpItem = &m_staveLookUpTable[midiNote % semitonesInAnOctive];
 
-    m_staveIndex += (midiNote/semitonesInAnOctive)*notesInAnOctive - notesInAnOctive*5 ;
-    m_accidental = lookUpItem->accidental;
-    //ppLogTrace("chan %d Note %2d - %2d (%d %d %d),\n", midiNote, m_staveIndex, m_accidental,
-        //index%semitonesInAnOctive, lookUpItem->pianoNote, (midiNote/semitonesInAnOctive)*notesInAnOctive);
+    staveNote_t note;
+    note.pianoNote = lookUpItem->pianoNote;
+    note.index = lookUpItem->pianoNote + (midiNote/semitonesInAnOctive)*notesInAnOctive - notesInAnOctive*5;
+    note.accidental = lookUpItem->accidental;
+    return note;
 }
 
 // convert the midi note to the note name C=1, D=2, E=3, F=4, G=5, A=6, B=7
@@ -91,6 +102,8 @@ void CStavePos::setKeySignature(int key, int majorMinor)
     if (key == NOT_USED)
         key = 0;
     m_staveLookUpTable = getstaveLookupTable(key);
+    for (int midiNote = 0; midiNote < MAX_MIDI_NOTES; midiNote++)
+        m_staveNoteTable[midiNote] = calcStaveNote(midiNote);
     CDraw::forceCompileRedraw();
 }
 
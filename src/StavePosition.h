@@ -39,6 +39,8 @@ typedef  struct {
 
 #define NOT_USED 0x7fffffff
 
+#define MAX_MIDI_NOTES  128
+
 #define MAX_STAVE_INDEX 16
 #define MIN_STAVE_INDEX -16
 
@@ -142,6 +144,14 @@ public:
     }
 
 private:
+    typedef struct {
+        int index;      // the stave index not counting the hand
+        int pianoNote;
+        int accidental;
+    } staveNote_t;
+
+    static staveNote_t calcStaveNote(int midiNote);
+
     // fixme TODO This could be improved as the calculations could a done in the constructor
     int m_staveIndex;    // 0 central line, 5 = top line, -5 the bottom line,
     int m_accidental;         // 0 = none, 1=sharp, -1 =flat, 2=natural
@@ -151,6 +161,7 @@ private:
     static int m_KeySignature;
     static int m_KeySignatureMajorMinor;
     static const staveLookup_t*  m_staveLookUpTable;
+    static staveNote_t m_staveNoteTable[MAX_MIDI_NOTES]; // every note in the current key, so transposing is just a look up
     static float m_staveCentralOffset;
     static float m_staveCenterY;
 };
@@ -45,21 +45,50 @@ void CTempo::enableFollowTempo(bool enable)
     }
 }
 
-void CTempo::adjustTempo(qint64 * ticks)
+// The follow tempo is a phase locked loop on the pianist's chords. The error (how early or late the
+// pianist was) nudges the phase straight away and the tempo by a smaller amount, so the music
+// then carries on at the predicted tempo rather than only reacting after the pianist is late.
+#define FOLLOW_PHASE_GAIN       0.5f    // proportion of the phase error that is caught up
+#define FOLLOW_TEMPO_GAIN       0.25f   // proportion of the tempo error that is corrected
+#define FOLLOW_MAX_STEP         0.1f    // the most the tempo can change on one chord
+#define FOLLOW_MIN_SPEED        0.5f
+#define FOLLOW_MAX_SPEED        2.0f
+
+void CTempo::pianistOnset(qint64 earlyTicks)
 {
-    if (m_jumpAheadDelta && m_cfg_maxJumpAhead && m_savedWantedChord)
-    {
-        if (m_jumpAheadDelta > 0)
-            *ticks += m_jumpAheadDelta;
+    if (m_cfg_maxJumpAhead == 0 || m_savedWantedChord == nullptr)
+        return;
 
-        // Automatically adjust the speed
-        m_userSpeed = m_userSpeed + m_userSpeed * static_cast<float>(m_jumpAheadDelta) * 0.00002f;
+    const qint64 error = earlyTicks + m_phaseError;
+    const qint64 interval = m_onsetInterval;
+    m_phaseError = 0;
+    m_onsetInterval = 0;
 
-        if (m_userSpeed> 2.0f) m_userSpeed = 2.0f;
-        if (m_userSpeed < 0.2f) m_userSpeed = 0.2f;
-        printf("%03.0f  %5lld\r", static_cast<double>(m_userSpeed) * 100.0, m_jumpAheadDelta);
-        fflush(stdout);
+    // The music cannot go back so only catch up when the pianist is ahead
+    if (error > 0)
+        m_phaseCorrection += static_cast<qint64>(static_cast<float>(error) * FOLLOW_PHASE_GAIN);
+
+    // Ignore grace notes and chords that are more than a whole gap out (they are mistakes not tempo)
+    if (interval < CMidiFile::ppqnAdjust(DEFAULT_PPQN/4) * SPEED_ADJUST_FACTOR || qAbs(error) > interval)
+        return;
+
+    float step = FOLLOW_TEMPO_GAIN * static_cast<float>(error) / static_cast<float>(interval);
+    step = qBound(-FOLLOW_MAX_STEP, step, FOLLOW_MAX_STEP);
+    m_followSpeed = qBound(FOLLOW_MIN_SPEED, m_followSpeed * (1.0f + step), FOLLOW_MAX_SPEED);
+}
 
-        m_jumpAheadDelta = 0;
+void CTempo::adjustTempo(qint64 * ticks)
+{
+    if (m_cfg_maxJumpAhead == 0 || m_savedWantedChord == nullptr)
+        return;
+
+    m_onsetInterval += *ticks;
+
+    // spread the catch up over a few calls so the accompaniment does not jump
+    if (m_phaseCorrection > 0)
+    {
+        const qint64 catchUp = qMin(m_phaseCorrection, *ticks / 2 + 1);
+        *ticks += catchUp;
+        m_phaseCorrection -= catchUp;
     }
 }
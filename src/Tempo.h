@@ -50,7 +50,14 @@ public:
     {
         // 120 beats per minute is the default
         setMidiTempo(static_cast<int>(( 60 * MICRO_SECOND ) / 120 ));
-        m_jumpAheadDelta = 0;
+        resetFollowSpeed();
+    }
+
+    // forget the pianist's tempo and go back to the user speed
+    void resetFollowSpeed()
+    {
+        m_followSpeed = 1.0f;
+        clearPlayingTicks();
     }
 
     // Tempo, microseconds-per-MIDI-quarter-note
@@ -71,27 +78,41 @@ public:
     }
     float getSpeed() {return m_userSpeed;}
 
+    // the user speed combined with the pianist's tempo (when following the tempo)
+    float getPlayingSpeed() {return (m_cfg_followTempoAmount != 0) ? m_userSpeed * m_followSpeed : m_userSpeed;}
+
     qint64 mSecToTicks(qint64 mSec)
     {
-        return static_cast<qint64>(static_cast<float>(mSec) * m_userSpeed * (100.0f * MICRO_SECOND) / m_midiTempo);
+        return static_cast<qint64>(static_cast<float>(mSec) * getPlayingSpeed() * (100.0f * MICRO_SECOND) / m_midiTempo);
     }
 
-    void insertPlayingTicks(qint64 ticks)
+    qint64 ticksToMSec(qint64 ticks)
     {
-        m_jumpAheadDelta -= ticks;
-        if (m_jumpAheadDelta < CMidiFile::ppqnAdjust(-10)*SPEED_ADJUST_FACTOR)
-            m_jumpAheadDelta = CMidiFile::ppqnAdjust(-10)*SPEED_ADJUST_FACTOR;
+        return static_cast<qint64>(static_cast<float>(ticks) * m_midiTempo / (getPlayingSpeed() * (100.0f * MICRO_SECOND)));
     }
 
-    void removePlayingTicks(qint64 ticks)
+    qint64 ticksToUSec(qint64 ticks)
     {
-        if (m_cfg_maxJumpAhead != 0)
-            m_jumpAheadDelta = ticks;
+        return static_cast<qint64>(static_cast<float>(ticks) * m_midiTempo / (getPlayingSpeed() * (100.0f * 1000.0f)));
     }
 
+    // The music is waiting for the pianist (so the pianist is behind)
+    void insertPlayingTicks(qint64 ticks)
+    {
+        m_phaseError -= ticks;
+        if (m_phaseError < CMidiFile::ppqnAdjust(-10)*SPEED_ADJUST_FACTOR)
+            m_phaseError = CMidiFile::ppqnAdjust(-10)*SPEED_ADJUST_FACTOR;
+    }
+
+    // The pianist has just played the wanted chord, earlyTicks is how far ahead of the music they were
+    void pianistOnset(qint64 earlyTicks);
+
     void clearPlayingTicks()
     {
-        m_jumpAheadDelta = 0;
+        // after a long pause the timing of the next chord tells us nothing about the tempo
+        m_phaseError = 0;
+        m_phaseCorrection = 0;
+        m_onsetInterval = 0;
     }
 
     void adjustTempo(qint64 *ticks);
@@ -101,7 +122,10 @@ public:
 private:
     float m_userSpeed; // controls the speed of the piece playing
     float m_midiTempo; // controls the speed of the piece playing
-    qint64 m_jumpAheadDelta;
+    float m_followSpeed; // the pianist's tempo relative to the user speed
+    qint64 m_phaseError; // the time waited for the pianist since the last chord
+    qint64 m_phaseCorrection; // ticks still to be caught up with the pianist
+    qint64 m_onsetInterval; // ticks since the last chord played by the pianist
     static int m_cfg_maxJumpAhead;
     static int m_cfg_followTempoAmount;
     CChord *m_savedWantedChord; // A copy of the wanted chord complete with both left and right parts
@@ -0,0 +1,192 @@
+/*********************************************************************************/
+/*!
+@file           Trace.cpp
+
+@brief          Low overhead tracing that can be viewed in Chrome or Perfetto.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QFile>
+
+#include "Trace.h"
+#include "RingBuffer.h"
+#include "Util.h"
+
+#define TRACE_BUFFER_SIZE   32768   // spans per thread between each poll
+#define TRACE_POLL_MSEC     50      // how often the writer thread empties the buffers
+
+typedef struct
+{
+    const char* name;
+    qint64 startTime; // nsec
+    qint64 duration;  // nsec
+} traceSpan_t;
+
+typedef struct traceThread_s
+{
+    traceThread_s() : spans(TRACE_BUFFER_SIZE) {}
+    CRingBuffer<traceSpan_t> spans;
+    int threadId;
+    std::atomic<const char*> name;
+    bool nameWritten;
+} traceThread_t;
+
+std::atomic<bool> CTrace::s_enabled(false);
+
+static std::mutex s_threadsMutex;
+static std::vector<std::unique_ptr<traceThread_t>> s_threads; // never freed as they may still be in use
+static thread_local traceThread_t* t_thread = nullptr;
+
+static std::thread s_writerThread;
+static std::atomic<bool> s_stopWriter(false);
+static std::FILE* s_traceFile = nullptr;
+static qint64 s_startTime;
+static bool s_firstEvent;
+
+static traceThread_t* currentThread()
+{
+    if (t_thread == nullptr)
+    {
+        // only happens once for each thread
+        std::lock_guard<std::mutex> lock(s_threadsMutex);
+        s_threads.emplace_back(new traceThread_t);
+        t_thread = s_threads.back().get();
+        t_thread->threadId = static_cast<int>(s_threads.size());
+        t_thread->name = nullptr;
+        t_thread->nameWritten = false;
+    }
+    return t_thread;
+}
+
+void CTrace::addSpan(const char* name, qint64 startTime, qint64 endTime)
+{
+    traceSpan_t span;
+    span.name = name;
+    span.startTime = startTime;
+    span.duration = endTime - startTime;
+    currentThread()->spans.push(span); // never waits, drops the span if the writer is too far behind
+}
+
+void CTrace::setThreadName(const char* name)
+{
+    currentThread()->name = name;
+}
+
+static void writeEvent(const char* format, ...)
+{
+    std::fputs(s_firstEvent ? "\n" : ",\n", s_traceFile);
+    s_firstEvent = false;
+    va_list args;
+    va_start(args, format);
+    std::vfprintf(s_traceFile, format, args);
+    va_end(args);
+}
+
+static void drainBuffers()
+{
+    std::lock_guard<std::mutex> lock(s_threadsMutex);
+    traceSpan_t span;
+    for (auto &thread : s_threads)
+    {
+        const char* name = thread->name.load();
+        if (name != nullptr && !thread->nameWritten)
+        {
+            writeEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                       thread->threadId, name);
+            thread->nameWritten = true;
+        }
+        while (thread->spans.pop(&span))
+        {
+            if (span.startTime < s_startTime)
+                continue; // started before the trace did
+            writeEvent("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                       span.name, thread->threadId,
+                       static_cast<double>(span.startTime - s_startTime) / 1000.0,
+                       static_cast<double>(span.duration) / 1000.0);
+        }
+    }
+}
+
+static void writerThread()
+{
+    while (true)
+    {
+        const bool stopping = s_stopWriter.load();
+        drainBuffers();
+        if (stopping)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_POLL_MSEC));
+    }
+}
+
+bool CTrace::start(const QString &fileName)
+{
+    stop();
+
+    s_traceFile = std::fopen(QFile::encodeName(fileName).constData(), "w");
+    if (s_traceFile == nullptr)
+    {
+        ppLogError("Cannot create the trace file \"%s\"", qPrintable(fileName));
+        return false;
+    }
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", s_traceFile);
+    s_firstEvent = true;
+    s_startTime = now();
+    setThreadName("main");
+
+    s_stopWriter = false;
+    s_writerThread = std::thread(writerThread);
+    s_enabled = true;
+    ppLogInfo("Tracing to \"%s\"", qPrintable(fileName));
+    return true;
+}
+
+void CTrace::stop()
+{
+    if (!s_writerThread.joinable())
+        return;
+
+    s_enabled = false;
+    s_stopWriter = true;
+    s_writerThread.join();
+
+    {
+        std::lock_guard<std::mutex> lock(s_threadsMutex);
+        unsigned int dropped = 0;
+        for (auto &thread : s_threads)
+            dropped += thread->spans.dropped();
+        if (dropped > 0)
+            ppLogWarn("The trace could not keep up, %u spans were lost", dropped);
+    }
+
+    std::fputs("\n]}\n", s_traceFile);
+    std::fclose(s_traceFile);
+    s_traceFile = nullptr;
+}
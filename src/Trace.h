@@ -0,0 +1,96 @@
+/*********************************************************************************/
+/*!
+@file           Trace.h
+
+@brief          Low overhead tracing that can be viewed in Chrome or Perfetto.
+
+@author         L. J. Barman
+
+    Copyright (c)   2008-2020, L. J. Barman and others, all rights reserved
+
+    This file is part of the PianoBooster application
+
+    PianoBooster is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    PianoBooster is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with PianoBooster.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*********************************************************************************/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <atomic>
+#include <chrono>
+
+#include <QString>
+
+/*!
+ * @brief   Records how long the engine and the display take, without rebuilding.
+ *
+ * Tracing is turned on with the --trace=FILE command line option. Each thread that
+ * records a span gets its own lock-free ring buffer (so the engine never waits) and a
+ * background thread drains them into a Chrome trace (JSON) file. The file can be opened
+ * with chrome://tracing or https://ui.perfetto.dev
+ * When tracing is off a span costs one relaxed atomic load.
+ */
+class CTrace
+{
+public:
+    static bool start(const QString &fileName);
+    static void stop();
+
+    static bool isEnabled() {return s_enabled.load(std::memory_order_relaxed);}
+
+    static qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //! name must be a string literal, the times are in nsec
+    static void addSpan(const char* name, qint64 startTime, qint64 endTime);
+    //! the name shown for the calling thread (must be a string literal)
+    static void setThreadName(const char* name);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Records the time from here to the end of the enclosing scope
+class CTraceSpan
+{
+public:
+    explicit CTraceSpan(const char* name)
+    {
+        m_name = name;
+        m_startTime = CTrace::isEnabled() ? CTrace::now() : -1;
+    }
+    ~CTraceSpan()
+    {
+        if (m_startTime >= 0)
+            CTrace::addSpan(m_name, m_startTime, CTrace::now());
+    }
+
+    CTraceSpan(const CTraceSpan&) = delete;
+    CTraceSpan& operator=(const CTraceSpan&) = delete;
+
+private:
+    const char* m_name;
+    qint64 m_startTime;
+};
+
+#define TRACE_CONCAT2(a, b)     a##b
+#define TRACE_CONCAT(a, b)      TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(name)        CTraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif //__TRACE_H__
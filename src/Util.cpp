@@ -214,101 +214,6 @@ void ppTiming(const char *msg, ...)
 #endif
 }
 
-////////////////////// BENCH MARK //////////////////////
-static QElapsedTimer s_benchMarkTime;
-static qint64 s_previousTime;
-static qint64 s_previousFrameTime;
-
-typedef struct
-{
-    qint64 time;
-    QString msg;
-    qint64 deltaTotal;
-    qint64 deltaCount;
-    qint64 maxDelta;
-    qint64 minDelta;
-    qint64 frameRatePrevious;
-    qint64 frameRateCurrent;
-
-} benchData_t;
-
-benchData_t s_benchData[20];
-benchData_t s_frameRate;
-
-void benchMarkReset(benchData_t *pBench)
-{
-    pBench->deltaTotal = 0;
-    pBench->deltaCount = 0;
-    pBench->maxDelta = 0;
-    pBench->minDelta = 9999999;
-    pBench->frameRatePrevious = pBench->frameRateCurrent;
-}
-
-void benchMarkInit()
-{
-    s_benchMarkTime.start();
-    s_previousTime = 0;
-    s_previousFrameTime = 0;
-
-    for (int i=0; i <  arraySize( s_benchData ); i++)
-        benchMarkReset(&s_benchData[i]);
-    benchMarkReset(&s_frameRate);
-    s_frameRate.msg = " *** Frame Rate ***";
-}
-
-static qint64 benchMarkUpdate(benchData_t *pBench,  qint64 previousTime)
-{
-    auto time = s_benchMarkTime.elapsed();
-    auto delta = time - previousTime;
-    pBench->deltaTotal += delta;
-    pBench->deltaCount++;
-    pBench->frameRateCurrent = time;
-    pBench->maxDelta = qMax(pBench->maxDelta, delta);
-    pBench->minDelta = qMin(pBench->minDelta, delta);
-    return time;
-}
-
-void benchMark(unsigned int id, const QString &message)
-{
-    if (id >= arraySize(s_benchData))
-        return;
-    if (s_benchData[id].msg.size() == 0 )
-        s_benchData[id].msg = message;
-    s_previousTime = benchMarkUpdate(&s_benchData[id], s_previousTime);
-
-}
-
-void printResult(int i, benchData_t *pBench)
-{
-    if (pBench->deltaCount == 0)
-        return;
-
-    openLogFile();
-    if (i>=0)
-        fprintf(logInfoFile, "Bench%2d: ", i);
-    else
-        fputs("Bench  : ", logInfoFile);
-    fprintf(logInfoFile, "ct %4lld, min %2lld, avg %4.3f, max %2lld frame %4.3f %s\n",  pBench->deltaCount,  pBench->minDelta,
-                    static_cast<double>(pBench->deltaTotal)/static_cast<double>(pBench->deltaCount),
-                    pBench->maxDelta,
-                    (static_cast<double>(pBench->frameRateCurrent - pBench->frameRatePrevious))/static_cast<double>(pBench->deltaCount),
-                    qPrintable(pBench->msg));
-    benchMarkReset(pBench);
-    flushLogs();
-}
-
-void benchMarkResults()
-{
-    const auto ticks = s_benchMarkTime.elapsed();
-    if ( (ticks - s_previousFrameTime) < 5000)
-        return;
-    s_previousFrameTime = ticks;
-    for (int i=0; i <  arraySize(s_benchData); i++)
-    {
-        printResult(i, &s_benchData[i]);
-    }
-}
-
 // Returns the location of where the data is stored
 // for an AppImage the dataDir is must be relative to the applicationDirPath
 QString Util::dataDir() {
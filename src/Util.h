@@ -88,10 +88,6 @@ constexpr int deltaAdjust (int delta) { return delta / SPEED_ADJUST_FACTOR; }
 constexpr qint64 deltaAdjustL (qint64 delta) { return delta / SPEED_ADJUST_FACTOR; }
 constexpr float deltaAdjustF (qint64 delta) { return static_cast<float>(delta) / static_cast<float>(SPEED_ADJUST_FACTOR); }
 
-void benchMarkInit();
-void benchMark(unsigned int id, const QString &message);
-void benchMarkResults();
-
 class Util {
 public:
     static QString dataDir();